@@ -19,15 +19,10 @@
 #include "app.h"
 #include <iostream>
 
-#define SERIAL_TIMER_MS 500 // frequency to call the serial update function in ms
-
 MainWindow::MainWindow() :
 m_grid(),
-m_subbox(),
-m_dataframe_temp("Temperatura"),
-m_dataframe_led("LED"),
-m_dataframe_humid("Humidade"),
-m_controlframe(),
+m_notebook(),
+m_portframes(),
 m_serialframe()
 {
 	set_title("Estufa -- Supervisorio");
@@ -37,66 +32,48 @@ m_serialframe()
 	m_serialmanager->SetMainWindow(this);
 
 	m_grid.set_margin(10);
-	m_grid.attach(m_controlframe, 0, 0);
-	m_grid.attach(m_subbox, 1, 0);
-	m_grid.attach(m_serialframe, 0, 1, 2, 1);
+	m_grid.attach(m_notebook, 0, 0);
+	m_grid.attach(m_serialframe, 0, 1);
 	m_grid.set_expand(true);
 
-	m_subbox.set_margin(5);
-	m_subbox.set_spacing(3);
-	m_subbox.set_vexpand(true);
-	m_subbox.set_valign(Gtk::Align::FILL);
-	m_subbox.set_orientation(Gtk::Orientation::VERTICAL);
-
-	m_subbox.append(m_dataframe_temp);
-	m_dataframe_temp.set_expand(true);
-	m_subbox.append(m_dataframe_led);
-	m_dataframe_led.set_expand(true);
-	m_subbox.append(m_dataframe_humid);
-	m_dataframe_humid.set_expand(true);
-
+	m_notebook.set_expand(true);
 	m_serialframe.set_expand(true);
-
-	m_controlframe.SetParentWindow(this);
 	m_serialframe.SetParentWindow(this);
 
 	set_child(m_grid);
 
-	sigc::slot<bool()> slot_update = sigc::bind(sigc::mem_fun(*this, &MainWindow::OnTimer_Update));
-	m_updatetimer = Glib::signal_timeout().connect(slot_update, SERIAL_TIMER_MS); // Call serial manager update every 500 ms
+	// Creates a page for each configured port
+	m_serialmanager->ReadConfigFile();
 }
 
 MainWindow::~MainWindow()
 {
-	m_updatetimer.disconnect();
 }
 
-bool MainWindow::OnTimer_Update()
+void MainWindow::OnReceiveSerialCommand(const std::size_t port, const SerialSample& sample)
 {
-	m_serialmanager->Update();
-	return true;
+	if (port < m_portframes.size())
+	{
+		m_portframes[port]->OnReceiveSample(sample);
+	}
 }
 
-void MainWindow::OnReceiveSerialCommand(CSerialCommand *command)
+void MainWindow::OnPortsChanged()
 {
-	switch (command->GetType())
+	while (m_notebook.get_n_pages() > 0)
 	{
-	case SETPOINT_TEMPERATURE:
-		m_dataframe_temp.SetSetpoint(command->GetSetpointData());
-		m_dataframe_temp.SetSensor(command->GetSensorData());
-		m_dataframe_temp.SetPWM(command->GetPWMData());
-		break;
-	case SETPOINT_LED:
-		m_dataframe_led.SetSetpoint(command->GetSetpointData());
-		m_dataframe_led.SetSensor(command->GetSensorData());
-		m_dataframe_led.SetPWM(command->GetPWMData());
-		break;
-	case SETPOINT_HUMIDITY:
-		m_dataframe_humid.SetSetpoint(command->GetSetpointData());
-		m_dataframe_humid.SetSensor(command->GetSensorData());
-		m_dataframe_humid.SetPWM(command->GetPWMData());
-		break;
-	default:
-		break;
+		m_notebook.remove_page(-1);
 	}
-}
\ No newline at end of file
+
+	m_portframes.clear();
+
+	for (std::size_t i = 0; i < m_serialmanager->GetPortCount(); i++)
+	{
+		const CSerialConfiguration& config = m_serialmanager->GetPort(i)->GetConfig();
+		m_portframes.push_back(std::make_unique<CPortFrame>(this, i));
+		m_notebook.append_page(*m_portframes.back(), config.name.empty() ? config.devicename : config.name);
+	}
+
+	// Tabs are only useful when there is more than one port
+	m_notebook.set_show_tabs(m_portframes.size() > 1);
+}
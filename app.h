@@ -21,9 +21,9 @@
 #include <gtkmm.h>
 #include <string>
 #include <memory>
+#include <vector>
 
-#include "dataframe.h"
-#include "controlframe.h"
+#include "portframe.h"
 #include "serialcontrol.h"
 #include "serialmanager.h"
 
@@ -34,20 +34,16 @@ public:
 	virtual ~MainWindow();
 
 	CSerialManager* GetSerialManager();
-	void OnReceiveSerialCommand(CSerialCommand* command);
-protected:
-	bool OnTimer_Update();
+	void OnReceiveSerialCommand(const std::size_t port, const SerialSample& sample);
+	// Rebuilds the port pages after the serial configuration is read
+	void OnPortsChanged();
 
 private:
 	Gtk::Grid m_grid;
-	Gtk::Box m_subbox;
-	CDataFrame m_dataframe_temp;
-	CDataFrame m_dataframe_led;
-	CDataFrame m_dataframe_humid;
-	CControlFrame m_controlframe;
+	Gtk::Notebook m_notebook;
+	std::vector<std::unique_ptr<CPortFrame>> m_portframes;
 	CSerialFrame m_serialframe;
 	std::shared_ptr<CSerialManager> m_serialmanager;
-	sigc::connection m_updatetimer;
 };
 
 inline CSerialManager* MainWindow::GetSerialManager()
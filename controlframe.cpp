@@ -58,7 +58,7 @@ CSerialManager *CControlPanel::GetSerialManager()
 void CControlPanel::OnButtonClicked()
 {
 	// std::cout << get_label() << " -- Clicked! -- " << m_spin.get_value() << std::endl;
-	GetSerialManager()->SendCommand(SERIAL_CMD_SETPOINT, m_type, static_cast<float>(m_spin.get_value()));
+	GetSerialManager()->SendCommand(m_parentframe->GetPort(), SERIAL_CMD_SETPOINT, m_type, static_cast<float>(m_spin.get_value()));
 }
 
 CControlFrame::CControlFrame() :
@@ -78,6 +78,7 @@ m_humid_cpanel("Humidade", 50.0, 0.0, 100.0, 1.0, 10.0, SETPOINT_HUMIDITY)
 
 	set_child(m_grid);
 	m_parentwindow = nullptr;
+	m_port = 0;
 }
 
 CControlFrame::~CControlFrame()
@@ -52,9 +52,12 @@ public:
 	virtual ~CControlFrame();
 
 	void SetParentWindow(MainWindow* window);
+	void SetPort(const std::size_t port) { m_port = port; }
+	std::size_t GetPort() const { return m_port; }
 	CSerialManager* GetSerialManager();
 private:
 	MainWindow* m_parentwindow;
+	std::size_t m_port; // serial port the setpoints are sent to
 	Gtk::Grid m_grid;
 	CControlPanel m_temp_cpanel; // temperature control panel
 	CControlPanel m_led_cpanel; // LED control panel
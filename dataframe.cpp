@@ -17,19 +17,35 @@
 */
 
 #include "dataframe.h"
+#include "latencyprobe.h"
+#include <cstdio>
 
 /**
  * Data frame displays data from a group, such as temperature
 */
 
 CDataFrame::CDataFrame(Glib::ustring str) :
+m_title(str),
+m_label(str),
+m_shownlabel(str),
+m_ratestart(0),
+m_ratecount(0),
+m_setpoint(0.0f),
+m_sensor(0.0f),
+m_pwm(0.0f),
+m_tickid(0),
+m_text_setpoint("--"),
+m_text_sensor("--"),
+m_text_pwm("--"),
+m_layout(),
 m_box(),
 m_frame_sensor("Sensor"),
 m_frame_setpoint("Setpoint"),
 m_frame_pwm("PWM"),
 m_label_sensor("--"),
 m_label_setpoint("--"),
-m_label_pwm("--")
+m_label_pwm("--"),
+m_chart()
 {
 	m_box.set_margin(10);
 	m_box.set_halign(Gtk::Align::FILL);
@@ -45,25 +61,109 @@ m_label_pwm("--")
 	m_box.append(m_frame_pwm);
 	m_frame_pwm.set_expand(true);
 
+	m_layout.set_orientation(Gtk::Orientation::VERTICAL);
+	m_layout.set_spacing(5);
+	m_layout.append(m_box);
+	m_layout.append(m_chart);
+	m_chart.set_margin(10);
+	m_chart.set_expand(true);
+
 	set_label(str);
-	set_child(m_box);
+	set_child(m_layout);
 }
 
 CDataFrame::~CDataFrame()
 {
+	if (m_tickid != 0)
+		remove_tick_callback(m_tickid);
+}
+
+// A label that gets the same text again would still be laid out and redrawn
+void CDataFrame::SetLabelText(Gtk::Label& label, std::string& shown, const char* text)
+{
+	if (shown == text)
+		return;
+
+	shown = text;
+	label.set_text(text);
 }
 
 void CDataFrame::SetSetpoint(Glib::ustring str)
 {
-	m_label_setpoint.set_text(str);
+	SetLabelText(m_label_setpoint, m_text_setpoint, str.c_str());
 }
 
 void CDataFrame::SetSensor(Glib::ustring str)
 {
-	m_label_sensor.set_text(str);
+	SetLabelText(m_label_sensor, m_text_sensor, str.c_str());
 }
 
 void CDataFrame::SetPWM(Glib::ustring str)
 {
-	m_label_pwm.set_text(str);
+	SetLabelText(m_label_pwm, m_text_pwm, str.c_str());
+}
+
+void CDataFrame::SetValues(const float setpoint, const float sensor, const float pwm, const SampleTime& time)
+{
+	UpdateRate(time);
+	m_chart.AddSample(time, setpoint, sensor);
+
+	m_setpoint = setpoint;
+	m_sensor = sensor;
+	m_pwm = pwm;
+
+	// Every sample until the next frame only replaces the snapshot
+	if (m_tickid == 0)
+		m_tickid = add_tick_callback(sigc::mem_fun(*this, &CDataFrame::OnTick));
+}
+
+bool CDataFrame::OnTick(const Glib::RefPtr<Gdk::FrameClock>&)
+{
+	char buffer[32];
+
+	std::snprintf(buffer, sizeof(buffer), "%.2f", m_setpoint);
+	SetSetpoint(buffer);
+	std::snprintf(buffer, sizeof(buffer), "%.2f", m_sensor);
+	SetSensor(buffer);
+	std::snprintf(buffer, sizeof(buffer), "%.2f", m_pwm);
+	SetPWM(buffer);
+
+	if (m_label != m_shownlabel)
+	{
+		m_shownlabel = m_label;
+		set_label(m_label);
+	}
+
+	m_chart.queue_draw();
+
+	// Only the sample that is shown reaches the screen, the ones it replaced since the last frame never do
+	CLatencyProbe::Mark(LATENCY_STAGE_DISPLAYED, m_setpoint);
+
+	// Added again by the next sample, an idle channel doesn't keep the frame clock running
+	m_tickid = 0;
+	return false;
+}
+
+// Shows how many samples per second arrive, measured with the arrival times instead of when the UI got them
+void CDataFrame::UpdateRate(const SampleTime& time)
+{
+	if (m_ratecount == 0)
+	{
+		m_ratestart = time.monotonic;
+	}
+
+	m_ratecount++;
+
+	const std::int64_t elapsed = time.monotonic - m_ratestart;
+
+	if (elapsed < DATAFRAME_RATE_INTERVAL_NS)
+		return;
+
+	char buffer[32];
+	std::snprintf(buffer, sizeof(buffer), " (%.1f Hz)", static_cast<double>(m_ratecount - 1) * 1e9 / static_cast<double>(elapsed));
+	m_label = m_title + buffer;
+
+	// The last sample starts the next interval
+	m_ratestart = time.monotonic;
+	m_ratecount = 1;
 }
@@ -20,7 +20,17 @@
 #define _H_DATAFRAME_
 
 #include <gtkmm.h>
+#include <cstdint>
+#include <string>
 
+#include "protocol.h"
+#include "trendchart.h"
+
+#define DATAFRAME_RATE_INTERVAL_NS 1000000000 // how often the sample rate shown in the title is updated
+
+// Values and trend of a channel.
+// Samples only update a snapshot of the newest values, the labels and the chart are updated once per frame
+// by a frame clock tick callback, and labels whose text didn't change are left alone.
 class CDataFrame : public Gtk::Frame
 {
 public:
@@ -30,11 +40,31 @@ public:
 	void SetSetpoint(Glib::ustring str);
 	void SetSensor(Glib::ustring str);
 	void SetPWM(Glib::ustring str);
+	// Keeps the values of a received sample for the next frame and adds it to the trend chart
+	void SetValues(const float setpoint, const float sensor, const float pwm, const SampleTime& time);
 
 private:
+	void UpdateRate(const SampleTime& time);
+	// Shows the newest values, runs once on the frame after samples arrived
+	bool OnTick(const Glib::RefPtr<Gdk::FrameClock>& clock);
+	// Sets the text of a label unless it already shows it
+	static void SetLabelText(Gtk::Label& label, std::string& shown, const char* text);
+
+	Glib::ustring m_title;
+	Glib::ustring m_label; // title with the sample rate
+	Glib::ustring m_shownlabel;
+	std::int64_t m_ratestart; // arrival time of the first sample counted for the rate
+	unsigned int m_ratecount;
+	float m_setpoint; // newest values, shown on the next frame
+	float m_sensor;
+	float m_pwm;
+	guint m_tickid; // pending tick callback, 0 if there is none
+	std::string m_text_setpoint, m_text_sensor, m_text_pwm; // text the labels show
+	Gtk::Box m_layout; // values above the trend chart
 	Gtk::Box m_box;
 	Gtk::Frame m_frame_sensor, m_frame_setpoint, m_frame_pwm;
 	Gtk::Label m_label_sensor, m_label_setpoint, m_label_pwm;
+	CTrendChart m_chart;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Greenhouse controller simulator, creates a pseudo-terminal that behaves like the microcontroller.
+// Usage: devsim [options], then set DeviceName in serial.cfg to the printed path.
+
+#include "simulator.h"
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static CDeviceSimulator* s_simulator = nullptr;
+
+static void OnSignal(int)
+{
+	if (s_simulator != nullptr)
+		s_simulator->Stop();
+}
+
+static void PrintUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options]\n"
+		<< "  --rate <hz>        frames per second, all channels combined (default 1)\n"
+		<< "  --duration <s>     stop after this many seconds (default: run until interrupted)\n"
+		<< "  --noise <value>    maximum random offset added to the sensor values\n"
+		<< "  --burst <count>    frames written back to back on each tick\n"
+		<< "  --split            write each frame in several pieces\n"
+		<< "  --garbage <0-1>    chance of writing random bytes before a frame\n"
+		<< "  --command-loss <0-1> chance of ignoring a command without acknowledging it\n"
+		<< "  --binary           start in binary mode instead of waiting for the handshake\n"
+		<< "  --sequence         send a frame counter as the setpoint value\n"
+		<< "  --link <path>      create a symlink to the pseudo-terminal, ie: /tmp/greenhouse\n"
+		<< "  --verbose          print every frame sent" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	SimulatorOptions options;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--split") == 0)
+			options.split = true;
+		else if (strcmp(arg, "--binary") == 0)
+			options.binary = true;
+		else if (strcmp(arg, "--sequence") == 0)
+			options.sequence = true;
+		else if (strcmp(arg, "--verbose") == 0)
+			options.verbose = true;
+		else if (value != nullptr && strcmp(arg, "--rate") == 0)
+			options.rate = atof(argv[++i]);
+		else if (value != nullptr && strcmp(arg, "--duration") == 0)
+			options.duration = atof(argv[++i]);
+		else if (value != nullptr && strcmp(arg, "--noise") == 0)
+			options.noise = atof(argv[++i]);
+		else if (value != nullptr && strcmp(arg, "--burst") == 0)
+			options.burst = static_cast<unsigned int>(atoi(argv[++i]));
+		else if (value != nullptr && strcmp(arg, "--garbage") == 0)
+			options.garbage = atof(argv[++i]);
+		else if (value != nullptr && strcmp(arg, "--command-loss") == 0)
+			options.commandloss = atof(argv[++i]);
+		else if (value != nullptr && strcmp(arg, "--link") == 0)
+			options.link = argv[++i];
+		else
+		{
+			PrintUsage(argv[0]);
+			return strcmp(arg, "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (options.rate <= 0.0)
+	{
+		std::cout << "Rate must be greater than zero!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	CDeviceSimulator simulator(options);
+
+	if (!simulator.Open())
+	{
+		return EXIT_FAILURE;
+	}
+
+	std::cout << "Simulating the greenhouse controller at " << simulator.GetSlavePath() << std::endl;
+
+	if (!options.link.empty())
+	{
+		std::cout << "Linked to " << options.link << std::endl;
+	}
+
+	s_simulator = &simulator;
+	std::signal(SIGINT, OnSignal);
+	std::signal(SIGTERM, OnSignal);
+	simulator.Run();
+	s_simulator = nullptr;
+
+	std::cout << "Frames sent: " << simulator.GetFramesSent() << " Frames dropped: " << simulator.GetFramesDropped()
+		<< " Commands received: " << simulator.GetCommandsReceived() << std::endl;
+	simulator.Close();
+	return EXIT_SUCCESS;
+}
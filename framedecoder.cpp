@@ -0,0 +1,133 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "framedecoder.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert((FRAME_DECODER_BUFFER_SIZE & (FRAME_DECODER_BUFFER_SIZE - 1)) == 0, "Frame decoder buffer size must be a power of two!");
+static_assert(FRAME_MAX_LENGTH < FRAME_DECODER_BUFFER_SIZE, "Frame decoder buffer must be able to hold the longest frame!");
+
+// Characters that may appear inside a frame after the start marker
+static inline bool IsFrameCharacter(const char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_' || c == '.' || c == '-';
+}
+
+// Line breaks added by println between frames are expected and not counted as garbage
+static inline bool IsFrameSeparator(const char c)
+{
+	return c == '\r' || c == '\n' || c == ' ';
+}
+
+CFrameDecoder::CFrameDecoder() :
+m_head(0),
+m_size(0),
+m_scan(0),
+m_frames(0),
+m_dropped(0)
+{
+}
+
+void CFrameDecoder::Reset()
+{
+	m_head = 0;
+	m_size = 0;
+	m_scan = 0;
+}
+
+// Copies as much data as it fits in the ring, returns the number of bytes taken
+std::size_t CFrameDecoder::Push(const char* data, std::size_t size)
+{
+	std::size_t count = std::min(size, static_cast<std::size_t>(FRAME_DECODER_BUFFER_SIZE) - m_size);
+	std::size_t tail = (m_head + m_size) & (FRAME_DECODER_BUFFER_SIZE - 1);
+	std::size_t first = std::min(count, static_cast<std::size_t>(FRAME_DECODER_BUFFER_SIZE) - tail);
+
+	std::memcpy(m_ring + tail, data, first);
+	std::memcpy(m_ring, data + first, count - first);
+	m_size += count;
+	return count;
+}
+
+// Finds the next complete frame in the ring
+bool CFrameDecoder::Next(std::string_view& frame)
+{
+	Resync();
+
+	while (m_scan < m_size)
+	{
+		const char c = At(m_scan);
+
+		if (c == FRAME_END_MARKER)
+		{
+			for (std::size_t i = 0; i < m_scan; i++)
+			{
+				m_frame[i] = At(i);
+			}
+
+			frame = std::string_view(m_frame, m_scan);
+			m_head = (m_head + m_scan + 1) & (FRAME_DECODER_BUFFER_SIZE - 1);
+			m_size -= m_scan + 1;
+			m_scan = 0;
+			m_frames++;
+			return true;
+		}
+
+		if (m_scan > 0 && (c == FRAME_START_MARKER || !IsFrameCharacter(c) || m_scan >= FRAME_MAX_LENGTH))
+		{
+			// Truncated or corrupted frame, drop its start marker and look for the next one
+			Discard(1);
+			Resync();
+			continue;
+		}
+
+		m_scan++;
+	}
+
+	return false;
+}
+
+// Drops bytes until the head of the ring is a frame start marker
+void CFrameDecoder::Resync()
+{
+	while (m_size > 0 && At(0) != FRAME_START_MARKER)
+	{
+		if (IsFrameSeparator(At(0)))
+		{
+			m_head = (m_head + 1) & (FRAME_DECODER_BUFFER_SIZE - 1);
+			m_size--;
+		}
+		else
+		{
+			Discard(1);
+		}
+	}
+
+	if (m_size == 0)
+	{
+		m_scan = 0;
+	}
+}
+
+void CFrameDecoder::Discard(std::size_t count)
+{
+	m_head = (m_head + count) & (FRAME_DECODER_BUFFER_SIZE - 1);
+	m_size -= count;
+	m_scan = 0;
+	m_dropped += count;
+}
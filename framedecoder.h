@@ -0,0 +1,82 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_FRAME_DECODER_
+#define _H_FRAME_DECODER_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#define FRAME_DECODER_BUFFER_SIZE 256 // ring buffer size, must be a power of two
+#define FRAME_MAX_LENGTH 64 // longest frame accepted before the decoder gives up and resyncs
+#define FRAME_START_MARKER 's'
+#define FRAME_END_MARKER '?'
+
+// Incremental decoder for the ASCII frames sent by the microcontroller (ie: sdt_24.00_19.83_255.00?)
+// Accepts the serial data in chunks of any size and finds every complete frame in them.
+class CFrameDecoder
+{
+public:
+	CFrameDecoder();
+
+	/// @brief Feeds a chunk of raw serial data to the decoder
+	/// @param onframe Called with each complete frame, from the start marker up to (not including) the end marker.
+	/// The view is only valid during the call.
+	template <typename Callback>
+	void Feed(const char* data, std::size_t size, Callback&& onframe);
+	/// @brief Discards any buffered partial frame
+	void Reset();
+
+	std::uint64_t GetFrameCount() const { return m_frames; }
+	std::uint64_t GetDroppedBytes() const { return m_dropped; }
+private:
+	std::size_t Push(const char* data, std::size_t size);
+	bool Next(std::string_view& frame);
+	void Resync();
+	void Discard(std::size_t count);
+	char At(std::size_t offset) const { return m_ring[(m_head + offset) & (FRAME_DECODER_BUFFER_SIZE - 1)]; }
+
+	char m_ring[FRAME_DECODER_BUFFER_SIZE];
+	char m_frame[FRAME_MAX_LENGTH]; // the frame handed to the callback is copied here so it's contiguous
+	std::size_t m_head; // ring index of the oldest buffered byte
+	std::size_t m_size; // number of bytes in the ring
+	std::size_t m_scan; // number of bytes after the head already checked for the end marker
+	std::uint64_t m_frames;
+	std::uint64_t m_dropped;
+};
+
+template <typename Callback>
+inline void CFrameDecoder::Feed(const char* data, std::size_t size, Callback&& onframe)
+{
+	std::string_view frame;
+
+	while (size > 0)
+	{
+		std::size_t count = Push(data, size);
+		data += count;
+		size -= count;
+
+		while (Next(frame))
+		{
+			onframe(frame);
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,198 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// End to end latency benchmark. Runs the program against the device simulator and measures how long
+// each frame takes from being written to the serial device until its labels are updated.
+// Usage: latencybench [--rate <hz>] [--duration <s>] [--burst <count>] [--split] [--binary]
+
+#include "app.h"
+#include "latencyprobe.h"
+#include "simulator.h"
+#include <gtkmm/application.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#define LATENCY_BENCH_CONFIG_FILE "latencybench.cfg"
+#define LATENCY_BENCH_TIMER_MS 100
+#define LATENCY_BENCH_SETTLE_TICKS 5 // timer ticks to wait for frames still in flight after the simulator stops
+
+static_assert(SIMULATOR_SEQUENCE_MODULO <= LATENCY_PROBE_SLOTS, "The latency probe must track every sequence number");
+
+class CLatencyBenchWindow : public MainWindow
+{
+public:
+	CLatencyBenchWindow(const SimulatorOptions& options);
+	virtual ~CLatencyBenchWindow();
+
+private:
+	bool Start();
+	bool OnTimer();
+
+	SimulatorOptions m_options;
+	CDeviceSimulator m_simulator;
+	CLatencyProbe m_probe;
+	std::thread m_thread;
+	std::atomic<bool> m_finished;
+	int m_settleticks;
+};
+
+CLatencyBenchWindow::CLatencyBenchWindow(const SimulatorOptions& options) :
+m_options(options),
+m_simulator(options),
+m_probe(),
+m_thread(),
+m_finished(false),
+m_settleticks(0)
+{
+	set_title("Estufa -- Latency Benchmark");
+
+	if (!Start())
+	{
+		m_finished = true;
+		m_settleticks = LATENCY_BENCH_SETTLE_TICKS;
+	}
+
+	Glib::signal_timeout().connect(sigc::mem_fun(*this, &CLatencyBenchWindow::OnTimer), LATENCY_BENCH_TIMER_MS);
+}
+
+CLatencyBenchWindow::~CLatencyBenchWindow()
+{
+	CLatencyProbe::Disable();
+	m_simulator.Stop();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	std::remove(LATENCY_BENCH_CONFIG_FILE);
+}
+
+bool CLatencyBenchWindow::Start()
+{
+	if (!m_simulator.Open())
+	{
+		return false;
+	}
+
+	std::ofstream config(LATENCY_BENCH_CONFIG_FILE);
+	config << "DeviceName:" << m_simulator.GetSlavePath() << "\n";
+	config << "BaudRate:115200\n";
+	config << "Databits:SERIAL_DATABITS_8\n";
+	config << "Parity:SERIAL_PARITY_NONE\n";
+	config << "Stopbits:SERIAL_STOPBITS_1\n";
+	config << "Protocol:" << (m_options.binary ? "BINARY" : "ASCII") << "\n";
+	config.close();
+
+	CSerialManager* serialmanager = GetSerialManager();
+	serialmanager->SetConfigFile(LATENCY_BENCH_CONFIG_FILE);
+
+	if (!serialmanager->ReloadConfig() || !serialmanager->OpenConnection())
+	{
+		std::cout << "Failed to connect to the simulator!" << std::endl;
+		return false;
+	}
+
+	CLatencyProbe::Enable(&m_probe);
+	m_simulator.SetFrameCallback([](const std::uint64_t, const SerialSample& sample) {
+		CLatencyProbe::Mark(LATENCY_STAGE_WRITTEN, sample.setpoint);
+	});
+
+	std::cout << "Sending " << m_options.rate << " frames per second for " << m_options.duration << " seconds..." << std::endl;
+
+	m_thread = std::thread([this]() {
+		m_simulator.Run();
+		m_finished = true;
+	});
+
+	return true;
+}
+
+bool CLatencyBenchWindow::OnTimer()
+{
+	if (!m_finished || ++m_settleticks < LATENCY_BENCH_SETTLE_TICKS)
+	{
+		return true;
+	}
+
+	CLatencyProbe::Disable();
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+		m_probe.PrintReport();
+		std::cout << "Simulator frames sent: " << m_simulator.GetFramesSent() << " dropped: " << m_simulator.GetFramesDropped() << std::endl;
+
+		CSerialManager* serialmanager = GetSerialManager();
+
+		for (std::size_t i = 0; i < serialmanager->GetPortCount(); i++)
+		{
+			CSerialPort* port = serialmanager->GetPort(i);
+			std::cout << "Discarded bytes: " << port->GetDroppedBytes() << " Parse errors: " << port->GetParseErrors() << std::endl;
+		}
+
+		std::cout << "Log writer queue depth peak: " << CLogWriterService::Acquire()->GetMaxQueueDepth() << std::endl;
+	}
+
+	close();
+	return false;
+}
+
+int main(int argc, char* argv[])
+{
+	SimulatorOptions options;
+	options.rate = 100.0;
+	options.duration = 10.0;
+	options.sequence = true;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const bool hasvalue = i + 1 < argc;
+
+		if (strcmp(arg, "--split") == 0)
+			options.split = true;
+		else if (strcmp(arg, "--binary") == 0)
+			options.binary = true;
+		else if (hasvalue && strcmp(arg, "--rate") == 0)
+			options.rate = atof(argv[++i]);
+		else if (hasvalue && strcmp(arg, "--duration") == 0)
+			options.duration = atof(argv[++i]);
+		else if (hasvalue && strcmp(arg, "--burst") == 0)
+			options.burst = static_cast<unsigned int>(atoi(argv[++i]));
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [--rate <hz>] [--duration <s>] [--burst <count>] [--split] [--binary]" << std::endl;
+			return strcmp(arg, "--help") == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (options.rate <= 0.0 || options.duration <= 0.0)
+	{
+		std::cout << "Rate and duration must be greater than zero!" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// The options were already read, don't let Gtk complain about them
+	int appargc = 1;
+	auto app = Gtk::Application::create("org.ifsp.supervisorio_estufa.latencybench");
+	return app->make_window_and_run<CLatencyBenchWindow>(appargc, argv, options);
+}
@@ -0,0 +1,195 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "latencyprobe.h"
+#include "protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+static const char* const s_stagenames[LATENCY_STAGE_COUNT] = { "written", "wire -> parsed", "parsed -> logged", "logged -> displayed" };
+
+std::atomic<CLatencyProbe*> CLatencyProbe::s_probe(nullptr);
+
+static std::int64_t GetTimestamp()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CLatencyHistogram::CLatencyHistogram() :
+m_count(0),
+m_max(0)
+{
+	for (std::size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		m_buckets[i] = 0;
+	}
+}
+
+void CLatencyHistogram::Record(const std::uint64_t nanoseconds)
+{
+	m_buckets[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+
+	std::uint64_t max = m_max.load(std::memory_order_relaxed);
+
+	while (nanoseconds > max && !m_max.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+std::uint64_t CLatencyHistogram::GetPercentile(const double percentile) const
+{
+	const std::uint64_t count = GetCount();
+
+	if (count == 0)
+		return 0;
+
+	const std::uint64_t rank = std::max<std::uint64_t>(static_cast<std::uint64_t>(std::ceil(percentile / 100.0 * static_cast<double>(count))), 1);
+	std::uint64_t seen = 0;
+
+	for (std::size_t i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+	{
+		seen += m_buckets[i].load(std::memory_order_relaxed);
+
+		if (seen >= rank)
+			return std::min(GetBucketLimit(i), GetMax());
+	}
+
+	return GetMax();
+}
+
+// Values below the sub bucket count are exact, above that each power of two is split in equal parts
+std::size_t CLatencyHistogram::GetBucket(const std::uint64_t value)
+{
+	if (value < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return static_cast<std::size_t>(value);
+
+	const int msb = 63 - __builtin_clzll(value);
+	const std::size_t sub = static_cast<std::size_t>(value >> (msb - 4)) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1);
+	return static_cast<std::size_t>(msb - 3) * LATENCY_HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+std::uint64_t CLatencyHistogram::GetBucketLimit(const std::size_t bucket)
+{
+	if (bucket < LATENCY_HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+
+	const int shift = static_cast<int>(bucket / LATENCY_HISTOGRAM_SUB_BUCKETS) - 1;
+	const std::uint64_t lower = static_cast<std::uint64_t>(LATENCY_HISTOGRAM_SUB_BUCKETS + bucket % LATENCY_HISTOGRAM_SUB_BUCKETS) << shift;
+	return lower + (std::uint64_t(1) << shift) - 1;
+}
+
+CLatencyProbe::CLatencyProbe() :
+m_frames(new FrameStamps[LATENCY_PROBE_SLOTS]),
+m_written(0)
+{
+	for (std::size_t i = 0; i < LATENCY_PROBE_SLOTS; i++)
+	{
+		for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+		{
+			m_frames[i].stages[stage] = 0;
+		}
+	}
+
+	for (int stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+	{
+		m_unmatched[stage] = 0;
+	}
+}
+
+void CLatencyProbe::Enable(CLatencyProbe* probe)
+{
+	s_probe.store(probe, std::memory_order_release);
+}
+
+void CLatencyProbe::Disable()
+{
+	s_probe.store(nullptr, std::memory_order_release);
+}
+
+void CLatencyProbe::Record(const LatencyStage stage, const float setpoint)
+{
+	const long long sequence = std::llround(setpoint * BINARY_VALUE_SCALE);
+
+	if (sequence < 0)
+		return;
+
+	const std::int64_t now = GetTimestamp();
+	FrameStamps& frame = m_frames[static_cast<std::size_t>(sequence) & (LATENCY_PROBE_SLOTS - 1)];
+
+	if (stage == LATENCY_STAGE_WRITTEN)
+	{
+		for (int i = LATENCY_STAGE_PARSED; i < LATENCY_STAGE_COUNT; i++)
+		{
+			frame.stages[i].store(0, std::memory_order_relaxed);
+		}
+
+		frame.stages[LATENCY_STAGE_WRITTEN].store(now, std::memory_order_release);
+		m_written.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const std::int64_t previous = frame.stages[stage - 1].load(std::memory_order_acquire);
+
+	if (previous == 0 || now < previous)
+	{
+		m_unmatched[stage].fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	frame.stages[stage].store(now, std::memory_order_release);
+	m_histograms[stage].Record(static_cast<std::uint64_t>(now - previous));
+
+	if (stage == LATENCY_STAGE_DISPLAYED)
+	{
+		m_total.Record(static_cast<std::uint64_t>(now - frame.stages[LATENCY_STAGE_WRITTEN].load(std::memory_order_acquire)));
+	}
+}
+
+void CLatencyProbe::PrintReport() const
+{
+	char line[160];
+
+	std::cout << "Frames written: " << GetWrittenCount() << std::endl;
+	snprintf(line, sizeof(line), "%-22s %10s %10s %10s %10s %10s %10s", "stage (us)", "count", "p50", "p99", "p99.9", "max", "unmatched");
+	std::cout << line << std::endl;
+
+	for (int stage = LATENCY_STAGE_PARSED; stage <= LATENCY_STAGE_COUNT; stage++)
+	{
+		const bool total = stage == LATENCY_STAGE_COUNT;
+		const CLatencyHistogram& histogram = total ? m_total : m_histograms[stage];
+
+		snprintf(line, sizeof(line), "%-22s %10llu %10.1f %10.1f %10.1f %10.1f %10llu", total ? "wire -> displayed" : s_stagenames[stage],
+			static_cast<unsigned long long>(histogram.GetCount()),
+			static_cast<double>(histogram.GetPercentile(50.0)) / 1000.0,
+			static_cast<double>(histogram.GetPercentile(99.0)) / 1000.0,
+			static_cast<double>(histogram.GetPercentile(99.9)) / 1000.0,
+			static_cast<double>(histogram.GetMax()) / 1000.0,
+			static_cast<unsigned long long>(total ? 0 : m_unmatched[stage].load(std::memory_order_relaxed)));
+		std::cout << line << std::endl;
+	}
+
+	// Frames that never made it to the screen were dropped by the decoder, the logger or the display queue,
+	// or replaced by a newer frame before the display was refreshed
+	const std::uint64_t written = GetWrittenCount();
+	const std::uint64_t displayed = m_total.GetCount();
+	std::cout << "Frames not displayed: " << (written > displayed ? written - displayed : 0) << std::endl;
+}
@@ -0,0 +1,119 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LATENCY_PROBE_
+#define _H_LATENCY_PROBE_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#define LATENCY_PROBE_SLOTS 32768 // frames tracked at once, must be a power of two larger than the simulator sequence
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 16 // buckets per power of two, about 6% precision
+#define LATENCY_HISTOGRAM_BUCKETS (64 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+// Points of the receive pipeline where a frame is timed
+enum LatencyStage
+{
+	LATENCY_STAGE_WRITTEN = 0, // written to the serial device by the simulator
+	LATENCY_STAGE_PARSED, // parsed by the serial receiver
+	LATENCY_STAGE_LOGGED, // stored by CDataLogger::Log
+	LATENCY_STAGE_DISPLAYED, // shown by the frame clock tick of CDataFrame, newer samples of the same frame replace older ones
+
+	LATENCY_STAGE_COUNT
+};
+
+// Log-linear histogram of durations in nanoseconds.
+// Recording is lock-free, percentiles are the upper bound of the bucket they fall in.
+class CLatencyHistogram
+{
+public:
+	CLatencyHistogram();
+
+	void Record(const std::uint64_t nanoseconds);
+	std::uint64_t GetCount() const { return m_count.load(std::memory_order_relaxed); }
+	std::uint64_t GetMax() const { return m_max.load(std::memory_order_relaxed); }
+	/// @param percentile Percentile between 0 and 100
+	std::uint64_t GetPercentile(const double percentile) const;
+private:
+	static std::size_t GetBucket(const std::uint64_t value);
+	static std::uint64_t GetBucketLimit(const std::size_t bucket);
+
+	std::atomic<std::uint64_t> m_buckets[LATENCY_HISTOGRAM_BUCKETS];
+	std::atomic<std::uint64_t> m_count;
+	std::atomic<std::uint64_t> m_max;
+};
+
+// Measures how long frames take to go through the receive pipeline.
+// Frames are identified by the sequence number the device simulator sends in the setpoint field,
+// so the probe only makes sense when the simulator runs in sequence mode.
+// Each stage must be marked from a single thread.
+class CLatencyProbe
+{
+public:
+	CLatencyProbe();
+
+	/// @brief Starts receiving the marks of the receive pipeline, only one probe can be enabled
+	static void Enable(CLatencyProbe* probe);
+	static void Disable();
+	/// @brief Marks a frame as having reached a stage, does nothing unless a probe is enabled.
+	/// Compiled out unless LATENCY_PROBE is defined, the marks key on the setpoint sent by the simulator.
+	static void Mark(const LatencyStage stage, const float setpoint);
+
+	std::uint64_t GetWrittenCount() const { return m_written.load(std::memory_order_relaxed); }
+	/// @brief Time from the previous stage to this stage
+	const CLatencyHistogram& GetHistogram(const LatencyStage stage) const { return m_histograms[stage]; }
+	/// @brief Time from being written to being displayed
+	const CLatencyHistogram& GetTotal() const { return m_total; }
+	void PrintReport() const;
+private:
+	void Record(const LatencyStage stage, const float setpoint);
+
+	static std::atomic<CLatencyProbe*> s_probe;
+
+	struct FrameStamps
+	{
+		std::atomic<std::int64_t> stages[LATENCY_STAGE_COUNT];
+	};
+
+	std::unique_ptr<FrameStamps[]> m_frames;
+	std::atomic<std::uint64_t> m_written;
+	CLatencyHistogram m_histograms[LATENCY_STAGE_COUNT];
+	CLatencyHistogram m_total;
+	std::atomic<std::uint64_t> m_unmatched[LATENCY_STAGE_COUNT]; // marks without the previous stage
+};
+
+#ifdef LATENCY_PROBE
+inline void CLatencyProbe::Mark(const LatencyStage stage, const float setpoint)
+{
+	CLatencyProbe* probe = s_probe.load(std::memory_order_acquire);
+
+	if (probe != nullptr)
+	{
+		probe->Record(stage, setpoint);
+	}
+}
+#else
+// Only the latency benchmark builds the receive pipeline with the marks
+inline void CLatencyProbe::Mark(const LatencyStage, const float)
+{
+}
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logcsv.h"
+#include "logsegment.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+// Rounds towards negative infinity, timestamps before 1970 are still grouped correctly
+static std::int64_t FloorDivide(const std::int64_t value, const std::int64_t divisor)
+{
+	const std::int64_t quotient = value / divisor;
+	return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+}
+
+// Start of the time step of a sample
+static std::int64_t GetStep(const std::int64_t timestamp, const std::int64_t resolution)
+{
+	return resolution > 0 ? FloorDivide(timestamp, resolution) * resolution : timestamp;
+}
+
+static void AppendValue(std::string& text, const float value)
+{
+	char buffer[32];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 2);
+	text.push_back(',');
+	text.append(buffer, result.ptr);
+}
+
+static bool CompareTime(const LogRecord& a, const LogRecord& b)
+{
+	return a.timestamp < b.timestamp;
+}
+
+CLogCsvExporter::CLogCsvExporter() :
+m_channels(),
+m_rows(0),
+m_samples(0),
+m_damaged(0),
+m_threads(0)
+{
+}
+
+CLogCsvExporter::~CLogCsvExporter()
+{
+}
+
+LogReadResult CLogCsvExporter::AddFile(const std::string& datafile)
+{
+	Channel channel;
+	channel.name = CLogFile::GetChannelName(datafile);
+
+	for (const std::string& segment : CLogSegments::GetSegmentFiles(datafile))
+	{
+		channel.segments.push_back(std::make_unique<CLogQuery>());
+
+		const LogReadResult result = channel.segments.back()->Open(segment);
+
+		if (result != LOGREAD_OK)
+			return result;
+	}
+
+	if (channel.segments.empty())
+		return LOGREAD_OPEN_FAILED;
+
+	m_channels.push_back(std::move(channel));
+	return LOGREAD_OK;
+}
+
+std::size_t CLogCsvExporter::CountChunks(const std::int64_t from, const std::int64_t to) const
+{
+	std::size_t chunks = 0;
+
+	for (const Channel& channel : m_channels)
+	{
+		for (const std::unique_ptr<CLogQuery>& query : channel.segments)
+		{
+			const std::size_t count = query->GetChunkCount();
+
+			for (std::size_t i = query->FindFirst(from); i < count && query->GetEntry(i).mintime <= to; i++)
+			{
+				chunks++;
+			}
+		}
+	}
+
+	return chunks;
+}
+
+bool CLogCsvExporter::Export(std::FILE* output, const LogExportOptions& options)
+{
+	m_rows = 0;
+	m_samples = 0;
+	m_damaged = 0;
+	m_threads = 0;
+
+	std::string header = "time";
+
+	for (const Channel& channel : m_channels)
+	{
+		header += "," + channel.name + "_setpoint," + channel.name + "_sensor," + channel.name + "_pwm";
+	}
+
+	header += "\n";
+
+	if (std::fwrite(header.data(), 1, header.size(), output) != header.size())
+		return false;
+
+	// Clip the range to the samples that exist, the defaults cover all of time
+	std::int64_t first = std::numeric_limits<std::int64_t>::max();
+	std::int64_t last = std::numeric_limits<std::int64_t>::min();
+
+	for (const Channel& channel : m_channels)
+	{
+		for (const std::unique_ptr<CLogQuery>& query : channel.segments)
+		{
+			for (std::size_t i = 0; i < query->GetChunkCount(); i++)
+			{
+				const LogIndexEntry entry = query->GetEntry(i);
+
+				if (entry.count == 0)
+					continue;
+
+				first = std::min(first, entry.mintime);
+				last = std::max(last, entry.maxtime);
+			}
+		}
+	}
+
+	first = std::max(first, options.from);
+	last = std::min(last, options.to);
+
+	if (first > last)
+		return std::fflush(output) == 0;
+
+	unsigned int threads = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+	threads = std::max(threads, 1u);
+
+	// Slice edges fall on the resolution so a time step is never split between two slices.
+	// A slice per chunk at most, otherwise a chunk would be decoded again for every slice it overlaps.
+	const std::int64_t step = options.resolution > 0 ? options.resolution : 1;
+	const std::int64_t start = FloorDivide(first, step) * step;
+	const std::size_t maxslices = std::max<std::size_t>(1, std::min<std::size_t>(CountChunks(first, last), threads * LOGCSV_SLICES_PER_THREAD));
+	const std::uint64_t span = static_cast<std::uint64_t>(last) - static_cast<std::uint64_t>(start) + 1;
+	const std::uint64_t steps = (span + static_cast<std::uint64_t>(step) - 1) / static_cast<std::uint64_t>(step);
+	const std::uint64_t stepsperslice = (steps + maxslices - 1) / maxslices;
+	const std::int64_t width = static_cast<std::int64_t>(stepsperslice) * step;
+
+	std::vector<Slice> slices((steps + stepsperslice - 1) / stepsperslice);
+
+	for (std::size_t i = 0; i < slices.size(); i++)
+	{
+		slices[i].start = start + static_cast<std::int64_t>(i) * width;
+		slices[i].last = i + 1 < slices.size() ? slices[i].start + width - 1 : last;
+	}
+
+	threads = static_cast<unsigned int>(std::min<std::size_t>(threads, slices.size()));
+	m_threads = threads;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::size_t next = 0; // next slice for a worker
+	std::size_t written = 0; // slices already in the output
+	bool failed = false;
+	const std::size_t window = static_cast<std::size_t>(threads) * LOGCSV_PENDING_SLICES_PER_THREAD;
+	std::vector<std::thread> workers;
+
+	for (unsigned int i = 0; i < threads; i++)
+	{
+		workers.emplace_back(
+			[&]
+			{
+				Scratch scratch;
+				scratch.records.resize(m_channels.size());
+				scratch.chunk = std::make_unique<LogChunk>();
+				scratch.minute = std::numeric_limits<std::int64_t>::min();
+
+				while (true)
+				{
+					std::size_t index;
+
+					{
+						// Workers stay a few slices ahead of the output
+						std::unique_lock<std::mutex> lock(mutex);
+						condition.wait(lock, [&] { return failed || next >= slices.size() || next < written + window; });
+
+						if (failed || next >= slices.size())
+							return;
+
+						index = next++;
+					}
+
+					ExportSlice(slices[index], options, scratch);
+
+					std::lock_guard<std::mutex> lock(mutex);
+					slices[index].done = true;
+					condition.notify_all();
+				}
+			});
+	}
+
+	// Slices finish in any order, they are written in time order
+	while (written < slices.size())
+	{
+		Slice* slice;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&] { return slices[written].done; });
+			slice = &slices[written];
+		}
+
+		// The worker is done with it, the text can be written without the lock
+		const bool ok = std::fwrite(slice->text.data(), 1, slice->text.size(), output) == slice->text.size();
+		m_rows += slice->rows;
+		m_samples += slice->samples;
+		m_damaged += slice->damaged;
+		std::string().swap(slice->text);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		written++;
+
+		if (!ok)
+		{
+			failed = true;
+			condition.notify_all();
+			break;
+		}
+
+		condition.notify_all();
+	}
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	return !failed && std::fflush(output) == 0;
+}
+
+void CLogCsvExporter::ExportSlice(Slice& slice, const LogExportOptions& options, Scratch& scratch) const
+{
+	const std::int64_t from = std::max(slice.start, options.from);
+	const std::int64_t to = std::min(slice.last, options.to);
+
+	for (std::size_t c = 0; c < m_channels.size(); c++)
+	{
+		std::vector<LogRecord>& records = scratch.records[c];
+		records.clear();
+
+		for (const std::unique_ptr<CLogQuery>& query : m_channels[c].segments)
+		{
+			const std::size_t count = query->GetChunkCount();
+
+			for (std::size_t i = query->FindFirst(from); i < count; i++)
+			{
+				const LogIndexEntry entry = query->GetEntry(i);
+
+				if (entry.mintime > to)
+					break;
+
+				if (entry.maxtime < from || entry.count == 0)
+					continue;
+
+				if (query->ReadChunk(entry, *scratch.chunk) != LOGREAD_OK)
+				{
+					slice.damaged++;
+					continue;
+				}
+
+				for (std::size_t j = 0; j < scratch.chunk->count; j++)
+				{
+					if (scratch.chunk->timestamp[j] >= from && scratch.chunk->timestamp[j] <= to)
+						records.push_back(scratch.chunk->Get(j));
+				}
+			}
+		}
+
+		// A wall clock adjustment can put samples out of order, equal times keep their file order
+		if (!std::is_sorted(records.begin(), records.end(), CompareTime))
+			std::stable_sort(records.begin(), records.end(), CompareTime);
+	}
+
+	// Merge the channels one time step at a time
+	std::vector<std::size_t> heads(m_channels.size(), 0);
+	std::vector<const LogRecord*> row(m_channels.size(), nullptr);
+	std::string& text = slice.text;
+	text.clear();
+
+	while (true)
+	{
+		std::int64_t time = std::numeric_limits<std::int64_t>::max();
+		bool found = false;
+
+		for (std::size_t c = 0; c < m_channels.size(); c++)
+		{
+			if (heads[c] < scratch.records[c].size())
+			{
+				time = std::min(time, GetStep(scratch.records[c][heads[c]].timestamp, options.resolution));
+				found = true;
+			}
+		}
+
+		if (!found)
+			break;
+
+		for (std::size_t c = 0; c < m_channels.size(); c++)
+		{
+			const std::vector<LogRecord>& records = scratch.records[c];
+			row[c] = nullptr;
+
+			while (heads[c] < records.size() && GetStep(records[heads[c]].timestamp, options.resolution) == time)
+			{
+				row[c] = &records[heads[c]];
+				heads[c]++;
+				slice.samples++;
+			}
+		}
+
+		AppendTime(text, time, scratch);
+
+		for (const LogRecord* record : row)
+		{
+			if (record == nullptr)
+			{
+				text.append(",,,");
+				continue;
+			}
+
+			AppendValue(text, record->setpoint);
+			AppendValue(text, record->sensor);
+			AppendValue(text, record->pwm);
+		}
+
+		text.push_back('\n');
+		slice.rows++;
+	}
+}
+
+// Same format as the text log, ie: 2023-10-17T12:00:00.123456Z
+void CLogCsvExporter::AppendTime(std::string& text, const std::int64_t timestamp, Scratch& scratch) const
+{
+	const std::int64_t second = FloorDivide(timestamp, 1000000000);
+	const std::int64_t minute = FloorDivide(second, 60);
+	const int seconds = static_cast<int>(second - minute * 60);
+	const int microseconds = static_cast<int>((timestamp - second * 1000000000) / 1000);
+
+	// Rows are in time order and time zones move in whole minutes, the local date is only looked up once a minute
+	if (minute != scratch.minute || scratch.prefix.empty())
+	{
+		const std::time_t start = static_cast<std::time_t>(minute * 60);
+		std::tm local;
+
+#ifdef _WIN32
+		localtime_s(&local, &start);
+#else
+		localtime_r(&start, &local);
+#endif
+
+		char buffer[64];
+		const std::size_t size = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:", &local);
+		scratch.prefix.assign(buffer, size);
+		scratch.minute = minute;
+	}
+
+	char digits[10] = { static_cast<char>('0' + seconds / 10), static_cast<char>('0' + seconds % 10), '.' };
+
+	for (int i = 8, value = microseconds; i >= 3; i--, value /= 10)
+	{
+		digits[i] = static_cast<char>('0' + value % 10);
+	}
+
+	digits[9] = 'Z';
+	text.append(scratch.prefix);
+	text.append(digits, sizeof(digits));
+}
@@ -0,0 +1,107 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGCSV_
+#define _H_LOGCSV_
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logfile.h"
+#include "logindex.h"
+
+#define LOGCSV_DEFAULT_RESOLUTION_MS 1000
+#define LOGCSV_SLICES_PER_THREAD 8 // more slices than threads keep every core busy when the sample rate changes over the range
+#define LOGCSV_PENDING_SLICES_PER_THREAD 2 // formatted slices waiting for the output, bounds the memory of a long export
+
+struct LogExportOptions
+{
+	std::int64_t from = std::numeric_limits<std::int64_t>::min();
+	std::int64_t to = std::numeric_limits<std::int64_t>::max();
+	std::int64_t resolution = static_cast<std::int64_t>(LOGCSV_DEFAULT_RESOLUTION_MS) * 1000000; // nanoseconds, 0 joins on exact timestamps
+	unsigned int threads = 0; // 0 uses every core
+};
+
+// Exports log files to a single CSV file, one row per time step and three columns per channel.
+// Channels log at their own pace, so samples are joined on their timestamp rounded down to the
+// resolution, the last sample of a channel in a step wins and a channel without one leaves its columns empty.
+// The time range is cut into slices that worker threads decode and format, the rows are written in time order.
+class CLogCsvExporter
+{
+public:
+	CLogCsvExporter();
+	~CLogCsvExporter();
+
+	/// @brief Adds the columns of a log file and of its rotated segments, channels are exported in the order they were added
+	LogReadResult AddFile(const std::string& datafile);
+	/// @brief Writes the header and every row in the range
+	/// @return false if the output could not be written
+	bool Export(std::FILE* output, const LogExportOptions& options);
+
+	std::uint64_t GetRowCount() const { return m_rows; }
+	/// @brief Samples that went into the rows
+	std::uint64_t GetSampleCount() const { return m_samples; }
+	/// @brief Chunks that failed their checksum and were skipped
+	std::uint64_t GetDamagedCount() const { return m_damaged; }
+	/// @brief Threads used by the last export
+	unsigned int GetThreadCount() const { return m_threads; }
+private:
+	struct Channel
+	{
+		std::string name;
+		std::vector<std::unique_ptr<CLogQuery>> segments; // rotated segments in time order, then the log file
+	};
+
+	struct Slice
+	{
+		std::int64_t start = 0; // start <= timestamp <= last
+		std::int64_t last = 0;
+		std::string text;
+		std::uint64_t rows = 0;
+		std::uint64_t samples = 0;
+		std::uint64_t damaged = 0;
+		bool done = false;
+	};
+
+	// Decoded samples of one slice, kept by each worker thread between slices
+	struct Scratch
+	{
+		std::vector<std::vector<LogRecord>> records; // one list per channel
+		std::unique_ptr<LogChunk> chunk;
+		std::int64_t minute = 0; // minute of the cached time prefix
+		std::string prefix; // formatted local date and time of that minute
+	};
+
+	// Reads and formats one slice, called by the worker threads
+	void ExportSlice(Slice& slice, const LogExportOptions& options, Scratch& scratch) const;
+	void AppendTime(std::string& text, const std::int64_t timestamp, Scratch& scratch) const;
+	// Chunks of every file that overlap the range
+	std::size_t CountChunks(const std::int64_t from, const std::int64_t to) const;
+
+	std::vector<Channel> m_channels;
+	std::uint64_t m_rows;
+	std::uint64_t m_samples;
+	std::uint64_t m_damaged;
+	unsigned int m_threads;
+};
+
+#endif
@@ -0,0 +1,162 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Prints binary log files as text.
+// Usage: logdump [options] log_temperature.dat ...
+
+#include "logfile.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+static void PrintUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options] <file> ...\n"
+		<< "  --summary          print one line per chunk instead of the samples\n"
+		<< "  --verify           only check the chunk checksums" << std::endl;
+}
+
+static void PrintChunkSummary(const std::uint64_t offset, const LogChunkHeader& header)
+{
+	const LogRecord first = { header.mintime, 0.0f, 0.0f, 0.0f };
+	const LogRecord last = { header.maxtime, 0.0f, 0.0f, 0.0f };
+	std::string from = CLogFile::FormatLine(first);
+	std::string to = CLogFile::FormatLine(last);
+
+	// Only keep the time of the formatted lines
+	from.resize(from.find(' '));
+	to.resize(to.find(' '));
+	printf("offset %llu: %u samples %s %.1f bytes/sample from %s to %s setpoint %.2f/%.2f sensor %.2f/%.2f pwm %.2f/%.2f\n",
+		static_cast<unsigned long long>(offset), header.count, CLogFile::GetEncodingName(header.encoding),
+		header.count > 0 ? static_cast<double>(header.size) / header.count : 0.0, from.c_str(), to.c_str(),
+		header.minsetpoint, header.maxsetpoint, header.minsensor, header.maxsensor, header.minpwm, header.maxpwm);
+}
+
+// Returns false if the file has damaged chunks
+static bool DumpFile(const char* filename, const bool summary, const bool verify)
+{
+	CLogFileReader reader;
+	LogReadResult result = reader.Open(filename);
+
+	if (result != LOGREAD_OK)
+	{
+		std::cerr << filename << ": " << CLogFile::GetReadResultName(result) << std::endl;
+		return result == LOGREAD_END; // an empty file is valid
+	}
+
+	std::unique_ptr<LogChunk> chunk = std::make_unique<LogChunk>();
+	LogChunkHeader header;
+	std::uint64_t chunks = 0;
+	std::uint64_t samples = 0;
+	std::uint64_t damaged = 0;
+	std::uint64_t bytes = 0; // column data of the chunks read
+
+	for (;;)
+	{
+		const std::uint64_t offset = reader.GetOffset();
+		result = reader.ReadChunk(header, *chunk);
+
+		if (result == LOGREAD_END)
+			break;
+
+		if (result == LOGREAD_BAD_CHECKSUM)
+		{
+			std::cerr << filename << ": chunk at offset " << offset << ": " << CLogFile::GetReadResultName(result) << ", skipped" << std::endl;
+			damaged++;
+			continue;
+		}
+
+		if (result != LOGREAD_OK)
+		{
+			std::cerr << filename << ": chunk at offset " << offset << ": " << CLogFile::GetReadResultName(result) << ", stopping" << std::endl;
+			damaged++;
+			break;
+		}
+
+		chunks++;
+		samples += chunk->count;
+		bytes += header.size;
+
+		if (verify)
+			continue;
+
+		if (summary)
+		{
+			PrintChunkSummary(offset, header);
+			continue;
+		}
+
+		for (std::size_t i = 0; i < chunk->count; i++)
+		{
+			const std::string line = CLogFile::FormatLine(chunk->Get(i));
+			fwrite(line.c_str(), 1, line.size(), stdout);
+		}
+	}
+
+	if (summary || verify)
+	{
+		std::cout << filename << ": " << chunks << " chunks, " << samples << " samples, " << damaged << " damaged" << std::endl;
+
+		if (bytes > 0)
+			printf("%s: %.2f bytes/sample, %.1fx smaller than raw\n", filename, static_cast<double>(bytes) / samples, static_cast<double>(samples * LOGFILE_RAW_SAMPLE_SIZE) / bytes);
+	}
+
+	return damaged == 0;
+}
+
+int main(int argc, char* argv[])
+{
+	bool summary = false;
+	bool verify = false;
+	bool ok = true;
+	int files = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+
+		if (strcmp(arg, "--summary") == 0)
+			summary = true;
+		else if (strcmp(arg, "--verify") == 0)
+			verify = true;
+		else if (arg[0] == '-')
+		{
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+			continue;
+
+		ok = DumpFile(argv[i], summary, verify) && ok;
+		files++;
+	}
+
+	if (files == 0)
+	{
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,127 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Exports binary log files and their rotated segments to CSV, every channel gets its own columns on a shared time axis.
+// Usage: logexport [options] <channels or files>, ie: logexport --from 2023-10-01 --to 2023-10-17 --output october.csv temperature humidity
+
+#include "logcsv.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static void PrintUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options] <channels or files>\n"
+		<< "  --from <time>        start of the range in local time, ie: 2023-10-17T02:00 (default: start of the logs)\n"
+		<< "  --to <time>          end of the range in local time (default: end of the logs)\n"
+		<< "  --resolution <ms>    length of a row, the last sample of each channel in it is used, 0 keeps every timestamp (default: " << LOGCSV_DEFAULT_RESOLUTION_MS << ")\n"
+		<< "  --threads <count>    worker threads (default: every core)\n"
+		<< "  --output <file>      CSV file to write (default: standard output)\n"
+		<< "A channel name like humidity reads log_humidity" << LOGFILE_EXTENSION << " in the current directory." << std::endl;
+}
+
+static bool ParseNumber(const char* text, long long& value)
+{
+	char* end = nullptr;
+	value = std::strtoll(text, &end, 10);
+	return end != text && *end == '\0' && value >= 0;
+}
+
+int main(int argc, char* argv[])
+{
+	LogExportOptions options;
+	std::vector<std::string> datafiles;
+	const char* outputfile = nullptr;
+	long long number = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (value != nullptr && strcmp(arg, "--from") == 0 && CLogFile::ParseTime(argv[++i], options.from))
+			continue;
+		else if (value != nullptr && strcmp(arg, "--to") == 0 && CLogFile::ParseTime(argv[++i], options.to))
+			continue;
+		else if (value != nullptr && strcmp(arg, "--resolution") == 0 && ParseNumber(argv[++i], number))
+			options.resolution = static_cast<std::int64_t>(number) * 1000000;
+		else if (value != nullptr && strcmp(arg, "--threads") == 0 && ParseNumber(argv[++i], number))
+			options.threads = static_cast<unsigned int>(number);
+		else if (value != nullptr && strcmp(arg, "--output") == 0)
+			outputfile = argv[++i];
+		else if (arg[0] != '-')
+			datafiles.push_back(CLogFile::GetDataFileName(arg));
+		else
+		{
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (datafiles.empty())
+	{
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	CLogCsvExporter exporter;
+
+	for (const std::string& datafile : datafiles)
+	{
+		const LogReadResult result = exporter.AddFile(datafile);
+
+		if (result != LOGREAD_OK)
+		{
+			std::cerr << datafile << ": " << CLogFile::GetReadResultName(result) << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::FILE* output = outputfile != nullptr ? std::fopen(outputfile, "wb") : stdout;
+
+	if (output == nullptr)
+	{
+		std::cerr << "Failed to open " << outputfile << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	bool ok = exporter.Export(output, options);
+
+	if (output != stdout)
+		ok = std::fclose(output) == 0 && ok;
+
+	if (!ok)
+	{
+		std::cerr << "Failed to write " << (outputfile != nullptr ? outputfile : "the output") << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Exported " << exporter.GetRowCount() << " rows from " << exporter.GetSampleCount() << " samples in " << elapsed << " ms using " << exporter.GetThreadCount() << " threads" << std::endl;
+
+	if (exporter.GetDamagedCount() > 0)
+	{
+		std::cerr << exporter.GetDamagedCount() << " damaged chunks were skipped" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1078 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logfile.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <limits>
+
+struct Crc32Table
+{
+	std::uint32_t values[256];
+
+	constexpr Crc32Table() : values()
+	{
+		for (std::uint32_t i = 0; i < 256; i++)
+		{
+			std::uint32_t crc = i;
+
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			}
+
+			values[i] = crc;
+		}
+	}
+};
+
+static constexpr Crc32Table s_crc32table;
+
+// Little-endian field helpers, the file must read the same on any machine
+
+static void PutU16(std::uint8_t* data, const std::uint16_t value)
+{
+	data[0] = static_cast<std::uint8_t>(value & 0xFF);
+	data[1] = static_cast<std::uint8_t>(value >> 8);
+}
+
+static void PutU32(std::uint8_t* data, const std::uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		data[i] = static_cast<std::uint8_t>((value >> (i * 8)) & 0xFF);
+	}
+}
+
+static void PutI64(std::uint8_t* data, const std::int64_t value)
+{
+	const std::uint64_t bits = static_cast<std::uint64_t>(value);
+
+	for (int i = 0; i < 8; i++)
+	{
+		data[i] = static_cast<std::uint8_t>((bits >> (i * 8)) & 0xFF);
+	}
+}
+
+static void PutFloat(std::uint8_t* data, const float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	PutU32(data, bits);
+}
+
+static std::uint16_t GetU16(const std::uint8_t* data)
+{
+	return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+}
+
+static std::uint32_t GetU32(const std::uint8_t* data)
+{
+	std::uint32_t value = 0;
+
+	for (int i = 0; i < 4; i++)
+	{
+		value |= static_cast<std::uint32_t>(data[i]) << (i * 8);
+	}
+
+	return value;
+}
+
+static std::int64_t GetI64(const std::uint8_t* data)
+{
+	std::uint64_t bits = 0;
+
+	for (int i = 0; i < 8; i++)
+	{
+		bits |= static_cast<std::uint64_t>(data[i]) << (i * 8);
+	}
+
+	return static_cast<std::int64_t>(bits);
+}
+
+static float GetFloat(const std::uint8_t* data)
+{
+	const std::uint32_t bits = GetU32(data);
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+std::uint32_t CLogFile::Crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc)
+{
+	crc = ~crc;
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		crc = (crc >> 8) ^ s_crc32table.values[(crc ^ data[i]) & 0xFF];
+	}
+
+	return ~crc;
+}
+
+void CLogFile::EncodeFileHeader(std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGFILE_HEADER_SIZE);
+	std::memcpy(&out[offset], LOGFILE_MAGIC, sizeof(LOGFILE_MAGIC) - 1);
+	PutU16(&out[offset + 6], LOGFILE_VERSION);
+}
+
+void CLogFile::Summarize(const LogChunk& chunk, LogIndexEntry& entry)
+{
+	entry.count = static_cast<std::uint32_t>(chunk.count);
+	entry.size = static_cast<std::uint32_t>(chunk.count * LOGFILE_RAW_SAMPLE_SIZE);
+	entry.mintime = chunk.count > 0 ? chunk.timestamp[0] : 0;
+	entry.maxtime = entry.mintime;
+	entry.setpoint = LogColumnStats();
+	entry.sensor = LogColumnStats();
+	entry.pwm = LogColumnStats();
+
+	for (std::size_t i = 0; i < chunk.count; i++)
+	{
+		entry.mintime = chunk.timestamp[i] < entry.mintime ? chunk.timestamp[i] : entry.mintime;
+		entry.maxtime = chunk.timestamp[i] > entry.maxtime ? chunk.timestamp[i] : entry.maxtime;
+		entry.setpoint.Add(chunk.setpoint[i]);
+		entry.sensor.Add(chunk.sensor[i]);
+		entry.pwm.Add(chunk.pwm[i]);
+	}
+}
+
+// Chunk header layout:
+// 0 magic u32, 4 encoding u16, 6 reserved u16, 8 count u32, 12 size u32, 16 mintime i64, 24 maxtime i64,
+// 32 setpoint min/max f32, 40 sensor min/max f32, 48 pwm min/max f32, 56 reserved u32, 60 checksum u32
+void CLogFile::EncodeChunk(const LogChunk& chunk, std::vector<std::uint8_t>& out, LogIndexEntry* entry, const LogChunkEncoding encoding)
+{
+	const std::size_t count = chunk.count;
+	const std::size_t offset = out.size();
+	LogIndexEntry summary;
+
+	Summarize(chunk, summary);
+	summary.offset = offset;
+	out.resize(offset + LOGFILE_CHUNK_HEADER_SIZE, 0);
+
+	if (encoding == LOGCHUNK_ENCODING_GORILLA)
+	{
+		CGorillaWriter writer(out);
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			writer.Add(chunk.Get(i));
+		}
+
+		writer.Finish();
+	}
+	else
+	{
+		out.resize(offset + LOGFILE_CHUNK_HEADER_SIZE + count * LOGFILE_RAW_SAMPLE_SIZE);
+		std::uint8_t* column = &out[offset + LOGFILE_CHUNK_HEADER_SIZE];
+
+		for (std::size_t i = 0; i < count; i++)
+		{
+			PutI64(column + i * 8, chunk.timestamp[i]);
+		}
+
+		column += count * 8;
+		const float* const columns[3] = { chunk.setpoint, chunk.sensor, chunk.pwm };
+
+		for (int c = 0; c < 3; c++)
+		{
+			for (std::size_t i = 0; i < count; i++)
+			{
+				PutFloat(column + i * 4, columns[c][i]);
+			}
+
+			column += count * 4;
+		}
+	}
+
+	summary.size = static_cast<std::uint32_t>(out.size() - offset - LOGFILE_CHUNK_HEADER_SIZE);
+
+	std::uint8_t* header = &out[offset];
+	const LogColumnStats* const stats[3] = { &summary.setpoint, &summary.sensor, &summary.pwm };
+
+	PutU32(header, LOGFILE_CHUNK_MAGIC);
+	PutU16(header + 4, encoding == LOGCHUNK_ENCODING_GORILLA ? LOGCHUNK_ENCODING_GORILLA : LOGCHUNK_ENCODING_RAW);
+	PutU32(header + 8, summary.count);
+	PutU32(header + 12, summary.size);
+	PutI64(header + 16, summary.mintime);
+	PutI64(header + 24, summary.maxtime);
+
+	for (int c = 0; c < 3; c++)
+	{
+		PutFloat(header + 32 + c * 8, count > 0 ? stats[c]->min : 0.0f);
+		PutFloat(header + 36 + c * 8, count > 0 ? stats[c]->max : 0.0f);
+	}
+
+	std::uint32_t crc = Crc32(header, LOGFILE_CHUNK_HEADER_SIZE - 4);
+	crc = Crc32(header + LOGFILE_CHUNK_HEADER_SIZE, summary.size, crc);
+	PutU32(header + 60, crc);
+
+	if (entry != nullptr)
+		*entry = summary;
+}
+
+LogReadResult CLogFile::DecodeFileHeader(const std::uint8_t* data, std::size_t size)
+{
+	if (size < LOGFILE_HEADER_SIZE)
+		return size == 0 ? LOGREAD_END : LOGREAD_TRUNCATED;
+
+	if (std::memcmp(data, LOGFILE_MAGIC, sizeof(LOGFILE_MAGIC) - 1) != 0)
+		return LOGREAD_BAD_HEADER;
+
+	if (GetU16(data + 6) != LOGFILE_VERSION)
+		return LOGREAD_UNSUPPORTED;
+
+	return LOGREAD_OK;
+}
+
+LogReadResult CLogFile::DecodeChunkHeader(const std::uint8_t* data, LogChunkHeader& header)
+{
+	if (GetU32(data) != LOGFILE_CHUNK_MAGIC)
+		return LOGREAD_BAD_HEADER;
+
+	header.encoding = static_cast<LogChunkEncoding>(GetU16(data + 4));
+	header.count = GetU32(data + 8);
+	header.size = GetU32(data + 12);
+	header.mintime = GetI64(data + 16);
+	header.maxtime = GetI64(data + 24);
+	header.minsetpoint = GetFloat(data + 32);
+	header.maxsetpoint = GetFloat(data + 36);
+	header.minsensor = GetFloat(data + 40);
+	header.maxsensor = GetFloat(data + 44);
+	header.minpwm = GetFloat(data + 48);
+	header.maxpwm = GetFloat(data + 52);
+	header.checksum = GetU32(data + 60);
+
+	if (header.count > LOGFILE_CHUNK_SAMPLES)
+		return LOGREAD_BAD_HEADER;
+
+	if (header.encoding >= LOGCHUNK_ENCODING_COUNT)
+		return LOGREAD_UNSUPPORTED;
+
+	if (header.encoding == LOGCHUNK_ENCODING_RAW && header.size != header.count * LOGFILE_RAW_SAMPLE_SIZE)
+		return LOGREAD_BAD_HEADER;
+
+	if (header.encoding == LOGCHUNK_ENCODING_GORILLA && header.size > header.count * LOGFILE_GORILLA_MAX_SAMPLE_SIZE)
+		return LOGREAD_BAD_HEADER;
+
+	return LOGREAD_OK;
+}
+
+LogReadResult CLogFile::DecodeChunk(const std::uint8_t* data, const LogChunkHeader& header, LogChunk& chunk)
+{
+	std::uint32_t crc = Crc32(data, LOGFILE_CHUNK_HEADER_SIZE - 4);
+	crc = Crc32(data + LOGFILE_CHUNK_HEADER_SIZE, header.size, crc);
+
+	if (crc != header.checksum)
+		return LOGREAD_BAD_CHECKSUM;
+
+	const std::size_t count = header.count;
+	const std::uint8_t* column = data + LOGFILE_CHUNK_HEADER_SIZE;
+
+	if (header.encoding == LOGCHUNK_ENCODING_GORILLA)
+	{
+		CGorillaReader reader(column, header.size, header.count);
+		LogRecord record;
+		std::size_t index = 0;
+
+		while (reader.Next(record))
+		{
+			chunk.timestamp[index] = record.timestamp;
+			chunk.setpoint[index] = record.setpoint;
+			chunk.sensor[index] = record.sensor;
+			chunk.pwm[index] = record.pwm;
+			index++;
+		}
+
+		// The checksum matched, the encoder wrote fewer samples than the header says
+		if (reader.IsDamaged() || index != count)
+			return LOGREAD_BAD_HEADER;
+
+		chunk.count = count;
+		return LOGREAD_OK;
+	}
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		chunk.timestamp[i] = GetI64(column + i * 8);
+	}
+
+	column += count * 8;
+	float* const columns[3] = { chunk.setpoint, chunk.sensor, chunk.pwm };
+
+	for (int c = 0; c < 3; c++)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			columns[c][i] = GetFloat(column + i * 4);
+		}
+
+		column += count * 4;
+	}
+
+	chunk.count = count;
+	return LOGREAD_OK;
+}
+
+const char* CLogFile::GetReadResultName(const LogReadResult result)
+{
+	switch (result)
+	{
+	case LOGREAD_OK:
+		return "OK";
+	case LOGREAD_END:
+		return "end of file";
+	case LOGREAD_TRUNCATED:
+		return "truncated chunk";
+	case LOGREAD_BAD_HEADER:
+		return "invalid header";
+	case LOGREAD_BAD_CHECKSUM:
+		return "checksum mismatch";
+	case LOGREAD_UNSUPPORTED:
+		return "unsupported version or encoding";
+	case LOGREAD_OPEN_FAILED:
+		return "failed to open the file";
+	default:
+		return "unknown error";
+	}
+}
+
+void CLogFile::EncodeIndexHeader(std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGINDEX_HEADER_SIZE);
+	std::memcpy(&out[offset], LOGINDEX_MAGIC, sizeof(LOGINDEX_MAGIC) - 1);
+	PutU16(&out[offset + 6], LOGINDEX_VERSION);
+}
+
+LogReadResult CLogFile::DecodeIndexHeader(const std::uint8_t* data, std::size_t size)
+{
+	if (size < LOGINDEX_HEADER_SIZE)
+		return size == 0 ? LOGREAD_END : LOGREAD_TRUNCATED;
+
+	if (std::memcmp(data, LOGINDEX_MAGIC, sizeof(LOGINDEX_MAGIC) - 1) != 0)
+		return LOGREAD_BAD_HEADER;
+
+	if (GetU16(data + 6) != LOGINDEX_VERSION)
+		return LOGREAD_UNSUPPORTED;
+
+	return LOGREAD_OK;
+}
+
+// Index entry layout:
+// 0 offset u64, 8 count u32, 12 size u32, 16 mintime i64, 24 maxtime i64,
+// 32 setpoint sum f64, 40 sensor sum f64, 48 pwm sum f64, 56 setpoint min/max f32, 64 sensor min/max f32, 72 pwm min/max f32
+void CLogFile::EncodeIndexEntry(const LogIndexEntry& entry, std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGINDEX_ENTRY_SIZE);
+
+	std::uint8_t* data = &out[offset];
+	const LogColumnStats* const stats[3] = { &entry.setpoint, &entry.sensor, &entry.pwm };
+
+	PutI64(data, static_cast<std::int64_t>(entry.offset));
+	PutU32(data + 8, entry.count);
+	PutU32(data + 12, entry.size);
+	PutI64(data + 16, entry.mintime);
+	PutI64(data + 24, entry.maxtime);
+
+	for (int c = 0; c < 3; c++)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &stats[c]->sum, sizeof(bits));
+		PutI64(data + 32 + c * 8, static_cast<std::int64_t>(bits));
+		PutFloat(data + 56 + c * 8, stats[c]->min);
+		PutFloat(data + 60 + c * 8, stats[c]->max);
+	}
+}
+
+void CLogFile::DecodeIndexEntry(const std::uint8_t* data, LogIndexEntry& entry)
+{
+	LogColumnStats* const stats[3] = { &entry.setpoint, &entry.sensor, &entry.pwm };
+
+	entry.offset = static_cast<std::uint64_t>(GetI64(data));
+	entry.count = GetU32(data + 8);
+	entry.size = GetU32(data + 12);
+	entry.mintime = GetI64(data + 16);
+	entry.maxtime = GetI64(data + 24);
+
+	for (int c = 0; c < 3; c++)
+	{
+		const std::uint64_t bits = static_cast<std::uint64_t>(GetI64(data + 32 + c * 8));
+		std::memcpy(&stats[c]->sum, &bits, sizeof(bits));
+		stats[c]->min = GetFloat(data + 56 + c * 8);
+		stats[c]->max = GetFloat(data + 60 + c * 8);
+	}
+}
+
+void CLogFile::EncodeRollupHeader(std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGROLLUP_HEADER_SIZE);
+	std::memcpy(&out[offset], LOGROLLUP_MAGIC, sizeof(LOGROLLUP_MAGIC) - 1);
+	PutU16(&out[offset + 6], LOGROLLUP_VERSION);
+}
+
+LogReadResult CLogFile::DecodeRollupHeader(const std::uint8_t* data, std::size_t size)
+{
+	if (size < LOGROLLUP_HEADER_SIZE)
+		return size == 0 ? LOGREAD_END : LOGREAD_TRUNCATED;
+
+	if (std::memcmp(data, LOGROLLUP_MAGIC, sizeof(LOGROLLUP_MAGIC) - 1) != 0)
+		return LOGREAD_BAD_HEADER;
+
+	if (GetU16(data + 6) != LOGROLLUP_VERSION)
+		return LOGREAD_UNSUPPORTED;
+
+	return LOGREAD_OK;
+}
+
+// Rollup record layout:
+// 0 start i64, 8 end i64, 16 count u32, 20 flags u32, 24 setpoint sum f64, 32 sensor sum f64, 40 pwm sum f64,
+// 48 setpoint min/max/last f32, 60 sensor min/max/last f32, 72 pwm min/max/last f32
+void CLogFile::EncodeRollup(const LogRollup& rollup, std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGROLLUP_RECORD_SIZE);
+
+	std::uint8_t* data = &out[offset];
+	const LogColumnStats* const stats[3] = { &rollup.setpoint, &rollup.sensor, &rollup.pwm };
+	const float last[3] = { rollup.lastsetpoint, rollup.lastsensor, rollup.lastpwm };
+
+	PutI64(data, rollup.start);
+	PutI64(data + 8, rollup.end);
+	PutU32(data + 16, rollup.count);
+	PutU32(data + 20, rollup.partial ? LOGROLLUP_FLAG_PARTIAL : 0);
+
+	for (int c = 0; c < 3; c++)
+	{
+		std::uint64_t bits;
+		std::memcpy(&bits, &stats[c]->sum, sizeof(bits));
+		PutI64(data + 24 + c * 8, static_cast<std::int64_t>(bits));
+		PutFloat(data + 48 + c * 12, stats[c]->min);
+		PutFloat(data + 52 + c * 12, stats[c]->max);
+		PutFloat(data + 56 + c * 12, last[c]);
+	}
+}
+
+void CLogFile::DecodeRollup(const std::uint8_t* data, LogRollup& rollup)
+{
+	LogColumnStats* const stats[3] = { &rollup.setpoint, &rollup.sensor, &rollup.pwm };
+	float* const last[3] = { &rollup.lastsetpoint, &rollup.lastsensor, &rollup.lastpwm };
+
+	rollup.start = GetI64(data);
+	rollup.end = GetI64(data + 8);
+	rollup.count = GetU32(data + 16);
+	rollup.partial = (GetU32(data + 20) & LOGROLLUP_FLAG_PARTIAL) != 0;
+
+	for (int c = 0; c < 3; c++)
+	{
+		const std::uint64_t bits = static_cast<std::uint64_t>(GetI64(data + 24 + c * 8));
+		std::memcpy(&stats[c]->sum, &bits, sizeof(bits));
+		stats[c]->min = GetFloat(data + 48 + c * 12);
+		stats[c]->max = GetFloat(data + 52 + c * 12);
+		*last[c] = GetFloat(data + 56 + c * 12);
+	}
+}
+
+void CLogFile::EncodeJournalHeader(std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGJOURNAL_HEADER_SIZE);
+	std::memcpy(&out[offset], LOGJOURNAL_MAGIC, sizeof(LOGJOURNAL_MAGIC) - 1);
+	PutU16(&out[offset + 6], LOGJOURNAL_VERSION);
+}
+
+LogReadResult CLogFile::DecodeJournalHeader(const std::uint8_t* data, std::size_t size)
+{
+	if (size < LOGJOURNAL_HEADER_SIZE)
+		return size == 0 ? LOGREAD_END : LOGREAD_TRUNCATED;
+
+	if (std::memcmp(data, LOGJOURNAL_MAGIC, sizeof(LOGJOURNAL_MAGIC) - 1) != 0)
+		return LOGREAD_BAD_HEADER;
+
+	if (GetU16(data + 6) != LOGJOURNAL_VERSION)
+		return LOGREAD_UNSUPPORTED;
+
+	return LOGREAD_OK;
+}
+
+std::size_t CLogFile::BeginJournalBlock(std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGJOURNAL_BLOCK_HEADER_SIZE);
+	return offset;
+}
+
+// Journal record layout: 0 timestamp i64, 8 setpoint f32, 12 sensor f32, 16 pwm f32
+void CLogFile::EncodeJournalRecord(const LogRecord& record, std::vector<std::uint8_t>& out)
+{
+	const std::size_t offset = out.size();
+	out.resize(offset + LOGJOURNAL_RECORD_SIZE);
+
+	std::uint8_t* data = &out[offset];
+	PutI64(data, record.timestamp);
+	PutFloat(data + 8, record.setpoint);
+	PutFloat(data + 12, record.sensor);
+	PutFloat(data + 16, record.pwm);
+}
+
+void CLogFile::FinishJournalBlock(std::vector<std::uint8_t>& out, const std::size_t offset)
+{
+	const std::uint8_t* records = out.data() + offset + LOGJOURNAL_BLOCK_HEADER_SIZE;
+	const std::size_t size = out.size() - offset - LOGJOURNAL_BLOCK_HEADER_SIZE;
+
+	PutU32(&out[offset], static_cast<std::uint32_t>(size / LOGJOURNAL_RECORD_SIZE));
+	PutU32(&out[offset + 4], Crc32(records, size, Crc32(&out[offset], 4)));
+}
+
+LogReadResult CLogFile::DecodeJournalBlock(const std::uint8_t* data, std::size_t size, std::uint32_t& count)
+{
+	if (size < LOGJOURNAL_BLOCK_HEADER_SIZE)
+		return size == 0 ? LOGREAD_END : LOGREAD_TRUNCATED;
+
+	count = GetU32(data);
+
+	if (static_cast<std::uint64_t>(count) * LOGJOURNAL_RECORD_SIZE > size - LOGJOURNAL_BLOCK_HEADER_SIZE)
+		return LOGREAD_TRUNCATED;
+
+	// The count is checked too, a block of zeros left by a crash isn't an empty block
+	if (Crc32(data + LOGJOURNAL_BLOCK_HEADER_SIZE, static_cast<std::size_t>(count) * LOGJOURNAL_RECORD_SIZE, Crc32(data, 4)) != GetU32(data + 4))
+		return LOGREAD_BAD_CHECKSUM;
+
+	return LOGREAD_OK;
+}
+
+void CLogFile::DecodeJournalRecord(const std::uint8_t* data, LogRecord& record)
+{
+	record.timestamp = GetI64(data);
+	record.setpoint = GetFloat(data + 8);
+	record.sensor = GetFloat(data + 12);
+	record.pwm = GetFloat(data + 16);
+}
+
+const char* CLogFile::GetRollupLevelName(const LogRollupLevel level)
+{
+	switch (level)
+	{
+	case LOGROLLUP_MINUTE:
+		return "1m";
+	case LOGROLLUP_HOUR:
+		return "1h";
+	case LOGROLLUP_DAY:
+		return "1d";
+	default:
+		return "unknown";
+	}
+}
+
+const char* CLogFile::GetEncodingName(const LogChunkEncoding encoding)
+{
+	switch (encoding)
+	{
+	case LOGCHUNK_ENCODING_RAW:
+		return "raw";
+	case LOGCHUNK_ENCODING_GORILLA:
+		return "gorilla";
+	default:
+		return "unknown";
+	}
+}
+
+std::string CLogFile::GetDataFileName(const std::string& channel)
+{
+	if (channel.find(LOGFILE_EXTENSION) != std::string::npos)
+		return channel;
+
+	return "log_" + channel + LOGFILE_EXTENSION;
+}
+
+std::string CLogFile::GetChannelName(const std::string& datafile)
+{
+	std::string name = datafile.substr(datafile.find_last_of("/\\") == std::string::npos ? 0 : datafile.find_last_of("/\\") + 1);
+	const std::size_t extension = name.rfind(LOGFILE_EXTENSION);
+
+	if (extension != std::string::npos)
+		name.resize(extension);
+
+	if (name.compare(0, 4, "log_") == 0)
+		name.erase(0, 4);
+
+	return name;
+}
+
+bool CLogFile::ParseTime(const char* text, std::int64_t& timestamp)
+{
+	std::tm local = {};
+	char separator = 'T';
+	const int fields = std::sscanf(text, "%d-%d-%d%c%d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday, &separator, &local.tm_hour, &local.tm_min, &local.tm_sec);
+
+	if (fields != 3 && fields != 6 && fields != 7)
+		return false;
+
+	if (fields > 3 && separator != 'T' && separator != ' ')
+		return false;
+
+	local.tm_year -= 1900;
+	local.tm_mon -= 1;
+	local.tm_isdst = -1;
+
+	const std::time_t seconds = std::mktime(&local);
+
+	if (seconds == static_cast<std::time_t>(-1))
+		return false;
+
+	timestamp = static_cast<std::int64_t>(seconds) * 1000000000;
+	return true;
+}
+
+std::string CLogFile::GetRollupFileName(const std::string& datafile, const LogRollupLevel level)
+{
+	const std::size_t size = sizeof(LOGFILE_EXTENSION) - 1;
+	std::string name = datafile;
+
+	if (name.size() >= size && name.compare(name.size() - size, size, LOGFILE_EXTENSION) == 0)
+		name.resize(name.size() - size);
+
+	return name + "." + GetRollupLevelName(level) + LOGROLLUP_EXTENSION;
+}
+
+std::string CLogFile::GetJournalFileName(const std::string& datafile)
+{
+	const std::size_t size = sizeof(LOGFILE_EXTENSION) - 1;
+
+	if (datafile.size() >= size && datafile.compare(datafile.size() - size, size, LOGFILE_EXTENSION) == 0)
+		return datafile.substr(0, datafile.size() - size) + LOGJOURNAL_EXTENSION;
+
+	return datafile + LOGJOURNAL_EXTENSION;
+}
+
+std::string CLogFile::GetIndexFileName(const std::string& datafile)
+{
+	const std::size_t size = sizeof(LOGFILE_EXTENSION) - 1;
+
+	if (datafile.size() >= size && datafile.compare(datafile.size() - size, size, LOGFILE_EXTENSION) == 0)
+		return datafile.substr(0, datafile.size() - size) + LOGINDEX_EXTENSION;
+
+	return datafile + LOGINDEX_EXTENSION;
+}
+
+// Formats a value the same way the microcontroller does, regardless of the user's locale
+static std::string FormatValue(const float value)
+{
+	char buffer[32];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, 2);
+	return std::string(buffer, result.ptr);
+}
+
+// Local time with microseconds, ie: 2023-10-17T12:00:00.123456Z
+static std::string FormatTime(const std::int64_t timestamp)
+{
+	const std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000);
+	const long microseconds = static_cast<long>((timestamp % 1000000000) / 1000);
+	std::tm local;
+
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+
+	char buffer[64];
+	std::size_t size = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &local);
+	std::snprintf(buffer + size, sizeof(buffer) - size, ".%06ldZ", microseconds);
+	return std::string(buffer);
+}
+
+std::string CLogFile::FormatLine(const LogRecord& record)
+{
+	return FormatTime(record.timestamp) + " Setpoint: " + FormatValue(record.setpoint) + " Sensor: " + FormatValue(record.sensor) + " PWM: " + FormatValue(record.pwm) + " \n";
+}
+
+static int CountLeadingZeros(std::uint32_t value)
+{
+	int count = 0;
+
+	while (count < 32 && (value & 0x80000000) == 0)
+	{
+		value <<= 1;
+		count++;
+	}
+
+	return count;
+}
+
+static int CountTrailingZeros(std::uint32_t value)
+{
+	int count = 0;
+
+	while (count < 32 && (value & 1) == 0)
+	{
+		value >>= 1;
+		count++;
+	}
+
+	return count;
+}
+
+static std::int64_t SignExtend(const std::uint64_t value, const int bits)
+{
+	if (bits >= 64)
+		return static_cast<std::int64_t>(value);
+
+	const std::uint64_t sign = static_cast<std::uint64_t>(1) << (bits - 1);
+	return static_cast<std::int64_t>((value ^ sign) - sign);
+}
+
+// Wrapping arithmetic, a broken clock must not overflow
+static std::int64_t Difference(const std::int64_t a, const std::int64_t b)
+{
+	return static_cast<std::int64_t>(static_cast<std::uint64_t>(a) - static_cast<std::uint64_t>(b));
+}
+
+static std::int64_t Sum(const std::int64_t a, const std::int64_t b)
+{
+	return static_cast<std::int64_t>(static_cast<std::uint64_t>(a) + static_cast<std::uint64_t>(b));
+}
+
+CGorillaWriter::CGorillaWriter(std::vector<std::uint8_t>& out) :
+m_out(out),
+m_bits(0),
+m_pending(0),
+m_count(0),
+m_timestamp(0),
+m_delta(0),
+m_columns()
+{
+}
+
+void CGorillaWriter::Add(const LogRecord& record)
+{
+	const float values[3] = { record.setpoint, record.sensor, record.pwm };
+
+	if (m_count++ == 0)
+	{
+		WriteBits(static_cast<std::uint64_t>(record.timestamp), 64);
+		m_timestamp = record.timestamp;
+
+		for (int c = 0; c < 3; c++)
+		{
+			std::memcpy(&m_columns[c].previous, &values[c], sizeof(std::uint32_t));
+			WriteBits(m_columns[c].previous, 32);
+		}
+
+		return;
+	}
+
+	const std::int64_t delta = Difference(record.timestamp, m_timestamp);
+	const std::int64_t deltaofdelta = Difference(delta, m_delta);
+	m_timestamp = record.timestamp;
+	m_delta = delta;
+
+	if (deltaofdelta == 0)
+	{
+		WriteBits(0, 1);
+	}
+	else if (deltaofdelta >= -(1 << 11) && deltaofdelta < (1 << 11))
+	{
+		WriteBits(0x2, 2);
+		WriteBits(static_cast<std::uint64_t>(deltaofdelta), 12);
+	}
+	else if (deltaofdelta >= -(1 << 19) && deltaofdelta < (1 << 19))
+	{
+		WriteBits(0x6, 3);
+		WriteBits(static_cast<std::uint64_t>(deltaofdelta), 20);
+	}
+	else if (deltaofdelta >= std::numeric_limits<std::int32_t>::min() && deltaofdelta <= std::numeric_limits<std::int32_t>::max())
+	{
+		WriteBits(0xE, 4);
+		WriteBits(static_cast<std::uint64_t>(deltaofdelta), 32);
+	}
+	else
+	{
+		WriteBits(0xF, 4);
+		WriteBits(static_cast<std::uint64_t>(deltaofdelta), 64);
+	}
+
+	for (int c = 0; c < 3; c++)
+	{
+		WriteValue(m_columns[c], values[c]);
+	}
+}
+
+void CGorillaWriter::WriteValue(GorillaColumn& column, const float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const std::uint32_t xored = bits ^ column.previous;
+	column.previous = bits;
+
+	if (xored == 0)
+	{
+		WriteBits(0, 1);
+		return;
+	}
+
+	const int leading = CountLeadingZeros(xored);
+	const int trailing = CountTrailingZeros(xored);
+
+	// Reuse the previous window when the changed bits fit in it
+	if (column.leading >= 0 && leading >= column.leading && trailing >= column.trailing)
+	{
+		WriteBits(0x2, 2);
+		WriteBits(xored >> column.trailing, 32 - column.leading - column.trailing);
+		return;
+	}
+
+	const int length = 32 - leading - trailing;
+	WriteBits(0x3, 2);
+	WriteBits(static_cast<std::uint64_t>(leading), 5);
+	WriteBits(static_cast<std::uint64_t>(length - 1), 5);
+	WriteBits(xored >> trailing, length);
+	column.leading = leading;
+	column.trailing = trailing;
+}
+
+void CGorillaWriter::WriteBits(std::uint64_t value, int count)
+{
+	if (count > 32)
+	{
+		WriteBits(value >> 32, count - 32);
+		count = 32;
+	}
+
+	value &= (static_cast<std::uint64_t>(1) << count) - 1;
+	m_bits = (m_bits << count) | value;
+	m_pending += count;
+
+	while (m_pending >= 8)
+	{
+		m_pending -= 8;
+		m_out.push_back(static_cast<std::uint8_t>(m_bits >> m_pending));
+	}
+}
+
+void CGorillaWriter::Finish()
+{
+	if (m_pending > 0)
+		m_out.push_back(static_cast<std::uint8_t>(m_bits << (8 - m_pending)));
+
+	m_bits = 0;
+	m_pending = 0;
+}
+
+CGorillaReader::CGorillaReader(const std::uint8_t* data, std::size_t size, const std::uint32_t count) :
+m_data(data),
+m_size(size),
+m_byte(0),
+m_bit(0),
+m_overflow(false),
+m_count(count),
+m_read(0),
+m_timestamp(0),
+m_delta(0),
+m_columns()
+{
+}
+
+bool CGorillaReader::Next(LogRecord& record)
+{
+	if (m_read == m_count || m_overflow)
+		return false;
+
+	if (m_read++ == 0)
+	{
+		m_timestamp = static_cast<std::int64_t>(ReadBits(64));
+
+		for (int c = 0; c < 3; c++)
+		{
+			m_columns[c].previous = static_cast<std::uint32_t>(ReadBits(32));
+		}
+	}
+	else
+	{
+		std::int64_t deltaofdelta = 0;
+
+		if (ReadBits(1) != 0)
+		{
+			if (ReadBits(1) == 0)
+				deltaofdelta = SignExtend(ReadBits(12), 12);
+			else if (ReadBits(1) == 0)
+				deltaofdelta = SignExtend(ReadBits(20), 20);
+			else if (ReadBits(1) == 0)
+				deltaofdelta = SignExtend(ReadBits(32), 32);
+			else
+				deltaofdelta = static_cast<std::int64_t>(ReadBits(64));
+		}
+
+		m_delta = Sum(m_delta, deltaofdelta);
+		m_timestamp = Sum(m_timestamp, m_delta);
+
+		for (int c = 0; c < 3; c++)
+		{
+			ReadValue(m_columns[c]);
+		}
+	}
+
+	float values[3];
+
+	for (int c = 0; c < 3; c++)
+	{
+		std::memcpy(&values[c], &m_columns[c].previous, sizeof(float));
+	}
+
+	record = { m_timestamp, values[0], values[1], values[2] };
+	return !m_overflow;
+}
+
+void CGorillaReader::ReadValue(GorillaColumn& column)
+{
+	if (ReadBits(1) != 0)
+	{
+		std::uint32_t xored;
+
+		if (ReadBits(1) == 0)
+		{
+			// Previous window, only valid after a value that set one
+			if (column.leading < 0)
+			{
+				m_overflow = true;
+				return;
+			}
+
+			xored = static_cast<std::uint32_t>(ReadBits(32 - column.leading - column.trailing)) << column.trailing;
+		}
+		else
+		{
+			const int leading = static_cast<int>(ReadBits(5));
+			const int length = static_cast<int>(ReadBits(5)) + 1;
+			const int trailing = 32 - leading - length;
+
+			if (trailing < 0)
+			{
+				m_overflow = true;
+				return;
+			}
+
+			xored = static_cast<std::uint32_t>(ReadBits(length)) << trailing;
+			column.leading = leading;
+			column.trailing = trailing;
+		}
+
+		column.previous ^= xored;
+	}
+}
+
+std::uint64_t CGorillaReader::ReadBits(int count)
+{
+	if (count > 32)
+	{
+		const std::uint64_t high = ReadBits(count - 32);
+		return (high << 32) | ReadBits(32);
+	}
+
+	std::uint64_t value = 0;
+
+	while (count > 0)
+	{
+		if (m_byte >= m_size)
+		{
+			m_overflow = true;
+			return 0;
+		}
+
+		const int available = 8 - m_bit;
+		const int take = count < available ? count : available;
+		const std::uint8_t bits = static_cast<std::uint8_t>(m_data[m_byte] >> (available - take)) & static_cast<std::uint8_t>((1 << take) - 1);
+
+		value = (value << take) | bits;
+		m_bit += take;
+		count -= take;
+
+		if (m_bit == 8)
+		{
+			m_bit = 0;
+			m_byte++;
+		}
+	}
+
+	return value;
+}
+
+CLogFileReader::CLogFileReader() :
+m_file(),
+m_buffer(),
+m_offset(0)
+{
+}
+
+LogReadResult CLogFileReader::Open(const std::string& filename)
+{
+	std::uint8_t header[LOGFILE_HEADER_SIZE];
+
+	Close();
+	m_file.open(filename, std::ifstream::in | std::ifstream::binary);
+
+	if (!m_file.is_open())
+		return LOGREAD_OPEN_FAILED;
+
+	m_file.read(reinterpret_cast<char*>(header), sizeof(header));
+	const LogReadResult result = CLogFile::DecodeFileHeader(header, static_cast<std::size_t>(m_file.gcount()));
+	m_offset = LOGFILE_HEADER_SIZE;
+	return result;
+}
+
+void CLogFileReader::Close()
+{
+	if (m_file.is_open())
+		m_file.close();
+
+	m_file.clear();
+	m_offset = 0;
+}
+
+LogReadResult CLogFileReader::ReadChunk(LogChunkHeader& header, LogChunk& chunk)
+{
+	m_buffer.resize(LOGFILE_CHUNK_HEADER_SIZE);
+	m_file.read(reinterpret_cast<char*>(m_buffer.data()), LOGFILE_CHUNK_HEADER_SIZE);
+	const std::streamsize got = m_file.gcount();
+
+	if (got == 0)
+		return LOGREAD_END;
+
+	if (got != LOGFILE_CHUNK_HEADER_SIZE)
+		return LOGREAD_TRUNCATED;
+
+	LogReadResult result = CLogFile::DecodeChunkHeader(m_buffer.data(), header);
+
+	if (result != LOGREAD_OK)
+		return result;
+
+	m_buffer.resize(LOGFILE_CHUNK_HEADER_SIZE + header.size);
+	m_file.read(reinterpret_cast<char*>(m_buffer.data() + LOGFILE_CHUNK_HEADER_SIZE), header.size);
+
+	if (m_file.gcount() != static_cast<std::streamsize>(header.size))
+		return LOGREAD_TRUNCATED;
+
+	m_offset += LOGFILE_CHUNK_HEADER_SIZE + header.size;
+	return CLogFile::DecodeChunk(m_buffer.data(), header, chunk);
+}
@@ -0,0 +1,356 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGFILE_
+#define _H_LOGFILE_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <limits>
+
+#define LOGFILE_CHUNK_SAMPLES 4096 // samples per chunk, in memory and on disk
+#define LOGFILE_EXTENSION ".dat"
+#define LOGFILE_MAGIC "GHSLOG" // first bytes of a log file
+#define LOGFILE_VERSION 1
+#define LOGFILE_HEADER_SIZE 8 // magic + version u16
+#define LOGFILE_CHUNK_MAGIC 0x4B434C47 // "GLCK" read as a little-endian u32
+#define LOGFILE_CHUNK_HEADER_SIZE 64
+#define LOGFILE_RAW_SAMPLE_SIZE 20 // timestamp i64 + three f32 columns
+#define LOGFILE_GORILLA_MAX_SAMPLE_SIZE 26 // worst case of a Gorilla encoded sample, 200 bits
+#define LOGINDEX_EXTENSION ".idx"
+#define LOGINDEX_MAGIC "GHSIDX" // first bytes of an index file
+#define LOGINDEX_VERSION 1
+#define LOGINDEX_HEADER_SIZE 8 // magic + version u16
+#define LOGINDEX_ENTRY_SIZE 80
+#define LOGINDEX_TEMP_SUFFIX ".tmp" // rebuilt index, renamed over the index once it is complete
+#define LOGROLLUP_EXTENSION ".rollup"
+#define LOGROLLUP_MAGIC "GHSRUP" // first bytes of a rollup file
+#define LOGROLLUP_VERSION 1
+#define LOGROLLUP_HEADER_SIZE 8 // magic + version u16
+#define LOGROLLUP_RECORD_SIZE 84
+#define LOGROLLUP_FLAG_PARTIAL 1
+#define LOGJOURNAL_EXTENSION ".wal"
+#define LOGJOURNAL_MAGIC "GHSWAL" // first bytes of a journal file
+#define LOGJOURNAL_VERSION 1
+#define LOGJOURNAL_HEADER_SIZE 8 // magic + version u16
+#define LOGJOURNAL_BLOCK_HEADER_SIZE 8 // record count u32 + CRC32 u32 of the count and the records
+#define LOGJOURNAL_RECORD_SIZE 20 // timestamp i64 + three f32
+#define LOGJOURNAL_TEMP_SUFFIX ".tmp" // new journal, renamed over the journal once it is on the disk
+
+// A logged sample, kept as raw values and only formatted when exported to text
+struct LogRecord
+{
+	std::int64_t timestamp; // arrival wall clock time, nanoseconds since the Unix epoch
+	float setpoint;
+	float sensor;
+	float pwm;
+};
+
+// Fixed size block of logged samples stored as columns, 20 bytes per sample without padding
+struct LogChunk
+{
+	std::size_t count = 0;
+	std::int64_t timestamp[LOGFILE_CHUNK_SAMPLES];
+	float setpoint[LOGFILE_CHUNK_SAMPLES];
+	float sensor[LOGFILE_CHUNK_SAMPLES];
+	float pwm[LOGFILE_CHUNK_SAMPLES];
+
+	bool IsFull() const { return count == LOGFILE_CHUNK_SAMPLES; }
+	LogRecord Get(const std::size_t index) const { return { timestamp[index], setpoint[index], sensor[index], pwm[index] }; }
+};
+
+// Extremes and sum of a value column over a range of samples
+struct LogColumnStats
+{
+	float min = std::numeric_limits<float>::infinity();
+	float max = -std::numeric_limits<float>::infinity();
+	double sum = 0.0;
+
+	void Add(const float value)
+	{
+		min = value < min ? value : min;
+		max = value > max ? value : max;
+		sum += value;
+	}
+
+	void Merge(const LogColumnStats& other)
+	{
+		min = other.min < min ? other.min : min;
+		max = other.max > max ? other.max : max;
+		sum += other.sum;
+	}
+};
+
+// Time buckets of the rollup files
+enum LogRollupLevel
+{
+	LOGROLLUP_MINUTE = 0,
+	LOGROLLUP_HOUR,
+	LOGROLLUP_DAY, // local days, from midnight to midnight
+
+	LOGROLLUP_LEVEL_COUNT
+};
+
+// Count, extremes, sum and latest value of every column over a time bucket
+struct LogRollup
+{
+	std::int64_t start = 0; // start <= timestamp < end, nanoseconds since the Unix epoch
+	std::int64_t end = 0;
+	std::uint32_t count = 0;
+	bool partial = false; // the bucket was still open when it was written
+	LogColumnStats setpoint;
+	LogColumnStats sensor;
+	LogColumnStats pwm;
+	float lastsetpoint = 0.0f;
+	float lastsensor = 0.0f;
+	float lastpwm = 0.0f;
+
+	void Add(const LogRecord& record)
+	{
+		count++;
+		setpoint.Add(record.setpoint);
+		sensor.Add(record.sensor);
+		pwm.Add(record.pwm);
+		lastsetpoint = record.setpoint;
+		lastsensor = record.sensor;
+		lastpwm = record.pwm;
+	}
+
+	// other is a later bucket that fits in this one
+	void Merge(const LogRollup& other)
+	{
+		count += other.count;
+		setpoint.Merge(other.setpoint);
+		sensor.Merge(other.sensor);
+		pwm.Merge(other.pwm);
+		lastsetpoint = other.lastsetpoint;
+		lastsensor = other.lastsensor;
+		lastpwm = other.lastpwm;
+	}
+};
+
+// Index file entry, one per chunk of the log file.
+// The statistics let aggregates over whole chunks be answered from the index alone.
+struct LogIndexEntry
+{
+	std::uint64_t offset = 0; // of the chunk header in the log file
+	std::uint32_t count = 0;
+	std::uint32_t size = 0; // bytes of column data after the chunk header
+	std::int64_t mintime = 0;
+	std::int64_t maxtime = 0;
+	LogColumnStats setpoint;
+	LogColumnStats sensor;
+	LogColumnStats pwm;
+
+	std::uint64_t GetEnd() const { return offset + LOGFILE_CHUNK_HEADER_SIZE + size; }
+};
+
+// How the columns of a chunk are stored after its header
+enum LogChunkEncoding : std::uint16_t
+{
+	LOGCHUNK_ENCODING_RAW = 0, // timestamp column then setpoint, sensor and pwm columns, little-endian
+	LOGCHUNK_ENCODING_GORILLA, // bit stream of samples, delta-of-delta timestamps and XOR compressed values, see CGorillaWriter
+
+	LOGCHUNK_ENCODING_COUNT
+};
+
+// Header written before the columns of every chunk, lets readers skip or filter a chunk without decoding it
+struct LogChunkHeader
+{
+	LogChunkEncoding encoding = LOGCHUNK_ENCODING_RAW;
+	std::uint32_t count = 0; // number of samples
+	std::uint32_t size = 0; // bytes of column data following the header
+	std::int64_t mintime = 0;
+	std::int64_t maxtime = 0;
+	float minsetpoint = 0.0f;
+	float maxsetpoint = 0.0f;
+	float minsensor = 0.0f;
+	float maxsensor = 0.0f;
+	float minpwm = 0.0f;
+	float maxpwm = 0.0f;
+	std::uint32_t checksum = 0; // CRC32 of the header bytes before it and of the column data
+};
+
+enum LogReadResult
+{
+	LOGREAD_OK = 0,
+	LOGREAD_END, // no more chunks
+	LOGREAD_TRUNCATED, // the file ends in the middle of a chunk, ie: the program was killed while writing
+	LOGREAD_BAD_HEADER,
+	LOGREAD_BAD_CHECKSUM,
+	LOGREAD_UNSUPPORTED, // unknown file version or chunk encoding
+	LOGREAD_OPEN_FAILED,
+
+	LOGREAD_RESULT_COUNT
+};
+
+// Binary log file format.
+// A file is a LOGFILE_HEADER_SIZE header followed by chunks, chunks are only ever appended.
+// Each chunk is a LOGFILE_CHUNK_HEADER_SIZE header followed by its column data.
+// All multi-byte fields are little-endian.
+class CLogFile
+{
+public:
+	/// @brief CRC-32 (poly 0xEDB88320, init and final xor 0xFFFFFFFF)
+	static std::uint32_t Crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0);
+	static void EncodeFileHeader(std::vector<std::uint8_t>& out);
+	/// @brief Appends the header and the columns of a chunk to out
+	/// @param entry Optionally receives the index entry of the chunk, its offset is relative to the start of out
+	static void EncodeChunk(const LogChunk& chunk, std::vector<std::uint8_t>& out, LogIndexEntry* entry = nullptr, const LogChunkEncoding encoding = LOGCHUNK_ENCODING_RAW);
+	/// @brief Fills the count, time range and statistics of an index entry, the size is the one of a raw chunk
+	static void Summarize(const LogChunk& chunk, LogIndexEntry& entry);
+	static LogReadResult DecodeFileHeader(const std::uint8_t* data, std::size_t size);
+	/// @param data Must hold LOGFILE_CHUNK_HEADER_SIZE bytes
+	static LogReadResult DecodeChunkHeader(const std::uint8_t* data, LogChunkHeader& header);
+	/// @brief Verifies the checksum and decodes the columns of a chunk
+	/// @param data Chunk header followed by header.size bytes of column data
+	static LogReadResult DecodeChunk(const std::uint8_t* data, const LogChunkHeader& header, LogChunk& chunk);
+	static const char* GetReadResultName(const LogReadResult result);
+	static const char* GetEncodingName(const LogChunkEncoding encoding);
+
+	// Index file: a LOGINDEX_HEADER_SIZE header followed by LOGINDEX_ENTRY_SIZE entries in chunk order
+	static void EncodeIndexHeader(std::vector<std::uint8_t>& out);
+	static LogReadResult DecodeIndexHeader(const std::uint8_t* data, std::size_t size);
+	static void EncodeIndexEntry(const LogIndexEntry& entry, std::vector<std::uint8_t>& out);
+	/// @param data Must hold LOGINDEX_ENTRY_SIZE bytes
+	static void DecodeIndexEntry(const std::uint8_t* data, LogIndexEntry& entry);
+	// Rollup file: a LOGROLLUP_HEADER_SIZE header followed by LOGROLLUP_RECORD_SIZE records in time order
+	static void EncodeRollupHeader(std::vector<std::uint8_t>& out);
+	static LogReadResult DecodeRollupHeader(const std::uint8_t* data, std::size_t size);
+	static void EncodeRollup(const LogRollup& rollup, std::vector<std::uint8_t>& out);
+	/// @param data Must hold LOGROLLUP_RECORD_SIZE bytes
+	static void DecodeRollup(const std::uint8_t* data, LogRollup& rollup);
+	// Journal file: a LOGJOURNAL_HEADER_SIZE header followed by blocks, each a LOGJOURNAL_BLOCK_HEADER_SIZE header
+	// and LOGJOURNAL_RECORD_SIZE records. A block is written at once, a torn block fails its checksum.
+	static void EncodeJournalHeader(std::vector<std::uint8_t>& out);
+	static LogReadResult DecodeJournalHeader(const std::uint8_t* data, std::size_t size);
+	/// @brief Starts a block, the records appended to out after it belong to the block
+	/// @return Offset of the block in out, for FinishJournalBlock
+	static std::size_t BeginJournalBlock(std::vector<std::uint8_t>& out);
+	static void EncodeJournalRecord(const LogRecord& record, std::vector<std::uint8_t>& out);
+	/// @brief Fills in the record count and the checksum of the block started at offset
+	static void FinishJournalBlock(std::vector<std::uint8_t>& out, const std::size_t offset);
+	/// @brief Verifies a block
+	/// @param size Bytes available from data
+	/// @param count Receives the number of records that follow the block header
+	static LogReadResult DecodeJournalBlock(const std::uint8_t* data, std::size_t size, std::uint32_t& count);
+	/// @param data Must hold LOGJOURNAL_RECORD_SIZE bytes
+	static void DecodeJournalRecord(const std::uint8_t* data, LogRecord& record);
+	/// @brief Journal file that goes with a log file, ie: log_humidity.wal for log_humidity.dat
+	static std::string GetJournalFileName(const std::string& datafile);
+	/// @brief Rollup file of a log file, ie: log_humidity.1h.rollup for log_humidity.dat
+	static std::string GetRollupFileName(const std::string& datafile, const LogRollupLevel level);
+	/// @brief Short name of a rollup level, ie: 1h
+	static const char* GetRollupLevelName(const LogRollupLevel level);
+	/// @brief Log file of a channel, ie: humidity gives log_humidity.dat. Names that already are a log file are kept.
+	static std::string GetDataFileName(const std::string& channel);
+	/// @brief Channel of a log file, ie: logs/log_humidity.dat gives humidity
+	static std::string GetChannelName(const std::string& datafile);
+	/// @brief Parses a local time as YYYY-MM-DD, YYYY-MM-DDTHH:MM or YYYY-MM-DDTHH:MM:SS, a space can replace the T
+	/// @param timestamp Receives nanoseconds since the Unix epoch
+	static bool ParseTime(const char* text, std::int64_t& timestamp);
+	/// @brief Index file that goes with a log file, ie: log_humidity.idx for log_humidity.dat
+	static std::string GetIndexFileName(const std::string& datafile);
+	/// @brief Builds a line of the text log, ie: 2023-10-17T12:00:00.123456Z Setpoint: 24.00 Sensor: 19.83 PWM: 255.00
+	static std::string FormatLine(const LogRecord& record);
+};
+
+// Previous value of a Gorilla compressed column
+struct GorillaColumn
+{
+	std::uint32_t previous = 0;
+	int leading = -1; // zero bits above the last stored XOR, -1 before the first one
+	int trailing = 0;
+};
+
+// Gorilla time series compression, from "Gorilla: A Fast, Scalable, In-Memory Time Series Database".
+// Timestamps are stored as the difference between consecutive deltas, with buckets sized for nanosecond clocks:
+// '0' same delta, '10' 12 bits, '110' 20 bits, '1110' 32 bits, '1111' 64 bits.
+// Values are XORed with the previous value of their column: '0' same value,
+// '10' meaningful bits inside the previous window, '11' + 5 bits leading zeros + 5 bits length - 1 + meaningful bits.
+// The first sample is stored uncompressed. Bits are written most significant first.
+class CGorillaWriter
+{
+public:
+	CGorillaWriter(std::vector<std::uint8_t>& out);
+
+	void Add(const LogRecord& record);
+	/// @brief Writes the last partial byte
+	void Finish();
+private:
+	void WriteBits(std::uint64_t value, int count);
+	void WriteValue(GorillaColumn& column, const float value);
+
+	std::vector<std::uint8_t>& m_out;
+	std::uint64_t m_bits; // bits not yet written to out
+	int m_pending; // number of bits in m_bits
+	std::uint32_t m_count;
+	std::int64_t m_timestamp;
+	std::int64_t m_delta;
+	GorillaColumn m_columns[3];
+};
+
+// Streaming decoder of a Gorilla encoded chunk, reads one sample at a time
+class CGorillaReader
+{
+public:
+	CGorillaReader(const std::uint8_t* data, std::size_t size, const std::uint32_t count);
+
+	/// @return false once every sample was read or if the data is damaged
+	bool Next(LogRecord& record);
+	/// @brief The data ended before the last sample
+	bool IsDamaged() const { return m_overflow; }
+private:
+	std::uint64_t ReadBits(int count);
+	void ReadValue(GorillaColumn& column);
+
+	const std::uint8_t* m_data;
+	std::size_t m_size;
+	std::size_t m_byte;
+	int m_bit; // next bit of the current byte, 0 is the most significant
+	bool m_overflow;
+	std::uint32_t m_count; // samples left
+	std::uint32_t m_read;
+	std::int64_t m_timestamp;
+	std::int64_t m_delta;
+	GorillaColumn m_columns[3];
+};
+
+// Reads the chunks of a log file in order
+class CLogFileReader
+{
+public:
+	CLogFileReader();
+
+	LogReadResult Open(const std::string& filename);
+	void Close();
+	/// @brief Reads the next chunk
+	/// @return LOGREAD_BAD_CHECKSUM leaves the reader on the next chunk, any other error ends the file
+	LogReadResult ReadChunk(LogChunkHeader& header, LogChunk& chunk);
+	/// @brief Offset of the next chunk in the file
+	std::uint64_t GetOffset() const { return m_offset; }
+private:
+	std::ifstream m_file;
+	std::vector<std::uint8_t> m_buffer;
+	std::uint64_t m_offset;
+};
+
+#endif
@@ -17,13 +17,22 @@
 */
 
 #include "logger.h"
-#include <fstream>
+#include "latencyprobe.h"
 #include <iostream>
 
-CDataWriter::CDataWriter(std::string filename) :
-m_mutex(),
+CDataWriter::CDataWriter(std::string filename, const LogChunkEncoding encoding, const LogRetentionPolicy& retention) :
 m_filename(filename),
-m_done(false)
+m_encoding(encoding),
+m_file(),
+m_buffer(),
+m_entries(),
+m_index("log_" + filename + LOGFILE_EXTENSION),
+m_rollups("log_" + filename + LOGFILE_EXTENSION),
+m_heldrollups(),
+m_journal("log_" + filename + LOGFILE_EXTENSION),
+m_retention(retention),
+m_compactor("log_" + filename + LOGFILE_EXTENSION, retention, encoding),
+m_compactorstarted(false)
 {
 }
 
@@ -31,105 +40,604 @@ CDataWriter::~CDataWriter()
 {
 }
 
-void CDataWriter::Write(CDataLogger* logger, std::vector<std::string>* timestamp, std::vector<std::string> *setpoint, std::vector<std::string> *sensor, std::vector<std::string> *pwm)
+void CDataWriter::Write(CDataLogger* logger, const LogChunkList* chunks, const LogRollupBatch* rollups, const LogJournalAction journal)
 {
-	std::lock_guard<std::mutex> lock(m_mutex);
-	std::string filename = "log_" + m_filename + ".log";
-	std::string line;
-	std::fstream filestream;
+	std::string filename = "log_" + m_filename + LOGFILE_EXTENSION;
+
+	const bool rotate = !chunks->empty() && chunks->front()->count > 0 && CLogSegments::IsRotationDue(filename, m_retention, chunks->front()->timestamp[0]);
+
+	if (rotate)
+	{
+		// The journal is only cleared by a later write, which syncs the new file and not this one
+		if (m_file.IsOpen() && !m_file.Sync())
+			std::cout << "[THREADED] Failed to sync log file " << filename << std::endl;
+
+		const std::string segment = CLogSegments::Rotate(filename);
+
+		if (segment.empty())
+			std::cout << "[THREADED] Failed to rotate log file " << filename << std::endl;
+		else
+			std::cout << "[THREADED] Rotated log file " << filename << " to " << segment << std::endl;
+	}
+
+	// The first write also lets the compactor check the segments left by earlier runs
+	if (rotate || !m_compactorstarted)
+	{
+		m_compactorstarted = true;
+		m_compactor.Wake();
+	}
 
 	std::cout << "[THREADED] Logging data to file " << filename << std::endl;
-	filestream.open(filename, std::fstream::out | std::fstream::app);
-	for (std::size_t i = 0; i < setpoint->size(); i++)
+
+	// Rollups only go out once their samples are in the log file, the journal still has the samples of a failed write
+	// and logs them again at the next start
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
 	{
-		line = timestamp->at(i) + " Setpoint: " + setpoint->at(i) + " Sensor: " + sensor->at(i) + " PWM: " + pwm->at(i) + " \n";
-		filestream.write(line.c_str(), line.size());
+		m_heldrollups.closed[level].insert(m_heldrollups.closed[level].end(), rollups->closed[level].begin(), rollups->closed[level].end());
+		m_heldrollups.open[level] = rollups->open[level];
 	}
-	
-	filestream.close();
-	m_done = true;
+
+	// A rotated file is no longer the one at filename, the handle is opened again
+	if (!m_file.Open(filename))
+	{
+		std::cout << "[THREADED] Failed to open log file " << filename << std::endl;
+		logger->Notify();
+		return;
+	}
+
+	const std::uint64_t offset = m_file.GetSize();
+	m_buffer.clear();
+	m_entries.clear();
+
+	// New file
+	if (offset == 0)
+		CLogFile::EncodeFileHeader(m_buffer);
+
+	for (const std::unique_ptr<LogChunk>& chunk : *chunks)
+	{
+		if (chunk->count == 0)
+			continue;
+
+		LogIndexEntry entry;
+		CLogFile::EncodeChunk(*chunk, m_buffer, &entry, m_encoding);
+		entry.offset += offset;
+		m_entries.push_back(entry);
+	}
+
+	// Every chunk of the write goes out in one call
+	if (m_file.Write(m_buffer.data(), m_buffer.size(), offset))
+	{
+		m_index.Append(m_entries);
+
+		// The journal only lets go of the samples once they are on the disk, a failed write leaves them for the next start
+		if (journal != LOGJOURNAL_KEEP && !m_file.Sync())
+			std::cout << "[THREADED] Failed to sync log file " << filename << std::endl;
+		else if (journal == LOGJOURNAL_RESET && !m_journal.Clear())
+			std::cout << "[THREADED] Failed to write the journal of " << filename << std::endl;
+		else if (journal == LOGJOURNAL_REMOVE)
+			m_journal.Remove();
+
+		m_rollups.Append(m_heldrollups);
+
+		for (std::vector<LogRollup>& closed : m_heldrollups.closed)
+		{
+			closed.clear();
+		}
+	}
+	else
+		std::cout << "[THREADED] Failed to write log file " << filename << std::endl;
+
 	logger->Notify();
 }
 
-bool CDataWriter::Done()
+void CDataWriter::Commit(const std::vector<std::uint8_t>& block)
+{
+	if (!m_journal.Append(block))
+		std::cout << "[THREADED] Failed to write the journal of log_" << m_filename << LOGFILE_EXTENSION << std::endl;
+}
+
+CLogWriterService::CLogWriterService() :
+m_mutex(),
+m_wake(),
+m_idle(),
+m_jobs(),
+m_running(),
+m_maxdepth(0),
+m_stop(false),
+m_thread()
+{
+}
+
+CLogWriterService::~CLogWriterService()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_wake.notify_one();
+
+	// Queued jobs are written before the thread stops
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+std::shared_ptr<CLogWriterService> CLogWriterService::Acquire()
+{
+	static std::mutex mutex;
+	static std::weak_ptr<CLogWriterService> instance;
+	std::lock_guard<std::mutex> lock(mutex);
+	std::shared_ptr<CLogWriterService> service = instance.lock();
+
+	if (!service)
+	{
+		service = std::make_shared<CLogWriterService>();
+		instance = service;
+	}
+
+	return service;
+}
+
+void CLogWriterService::Submit(LogWriteJob&& job)
+{
+	std::size_t depth = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(std::move(job));
+		depth = m_jobs.size() + m_running.size();
+
+		if (!m_thread.joinable())
+			m_thread = std::thread(&CLogWriterService::Run, this);
+
+		if (depth <= m_maxdepth)
+			depth = 0;
+		else
+			m_maxdepth = depth;
+	}
+
+	m_wake.notify_one();
+
+	if (depth >= LOGWRITER_QUEUE_WARNING_DEPTH)
+		std::cout << "Warning: " << depth << " log writes are waiting for the disk." << std::endl;
+}
+
+bool CLogWriterService::IsPending(const CDataWriter* writer) const
+{
+	for (const LogWriteJob& job : m_jobs)
+	{
+		if (job.writer == writer)
+			return true;
+	}
+
+	for (const LogWriteJob& job : m_running)
+	{
+		if (job.writer == writer)
+			return true;
+	}
+
+	return false;
+}
+
+void CLogWriterService::Wait(const CDataWriter* writer)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_idle.wait(lock, [this, writer] { return !IsPending(writer); });
+}
+
+std::size_t CLogWriterService::GetQueueDepth() const
 {
 	std::lock_guard<std::mutex> lock(m_mutex);
-    return m_done;
+	return m_jobs.size() + m_running.size();
+}
+
+std::size_t CLogWriterService::GetMaxQueueDepth() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_maxdepth;
+}
+
+void CLogWriterService::Run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (true)
+	{
+		m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+
+		if (m_jobs.empty())
+			return;
+
+		// Every channel that asked for a write while the last batch was running is served in one pass
+		m_running.assign(std::make_move_iterator(m_jobs.begin()), std::make_move_iterator(m_jobs.end()));
+		m_jobs.clear();
+		lock.unlock();
+
+		for (const LogWriteJob& job : m_running)
+		{
+			if (job.chunks != nullptr)
+				job.writer->Write(job.logger, job.chunks, job.rollups, job.journalaction);
+			else
+				job.writer->Commit(job.journal);
+		}
+
+		lock.lock();
+		m_running.clear();
+		m_idle.notify_all();
+	}
 }
 
-CDataLogger::CDataLogger(std::string filename) :
+CDataLogger::CDataLogger(std::string filename, const LogFlushPolicy& policy, const LogChunkEncoding encoding, const LogRetentionPolicy& retention) :
 m_filename(filename),
-m_timestamp_vector(new std::vector<std::string>),
-m_setpoint_vector(new std::vector<std::string>()),
-m_sensor_vector(new std::vector<std::string>()),
-m_pwm_vector(new std::vector<std::string>()),
+m_mutex(),
+m_writing(false),
+m_written(false),
+m_chunks(),
+m_flushing(),
+m_freechunks(),
+m_rollups(),
+m_marks(),
+m_flushingrollups(),
+m_dropped(0),
+m_reporteddrops(0),
+m_policy(policy),
+m_flushrequested(false),
+m_forceflush(false),
+m_lastwrite(std::chrono::steady_clock::now()),
+m_flushtimer(),
+m_journaltimer(),
+m_journaled(0),
+m_journalfound(false),
 m_dispatcher(),
-m_writer(filename),
-m_thread(nullptr)
+m_flushdispatcher(),
+m_writer(filename, encoding, retention),
+m_service(CLogWriterService::Acquire())
 {
 	m_dispatcher.connect(sigc::mem_fun(*this, &CDataLogger::OnSignal_WriterDone));
+	m_flushdispatcher.connect(sigc::mem_fun(*this, &CDataLogger::OnSignal_FlushRequest));
+
+	if (m_policy.interval > 0)
+		m_flushtimer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &CDataLogger::OnTimeout_Flush), LOGGER_FLUSH_TIMER_MS);
+
+	AddChunk();
+	m_marks.reserve(LOGGER_MAX_CHUNKS);
+
+	// Buckets that were still open when the program stopped receive the new samples
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		LogRollup rollup;
+
+		if (CLogRollupWriter::ReadLast("log_" + filename + LOGFILE_EXTENSION, static_cast<LogRollupLevel>(level), rollup) && rollup.partial)
+			m_rollups.Restore(rollup, static_cast<LogRollupLevel>(level));
+	}
+
+	// Samples that only made it to the journal, ie: the power was cut before a write
+	std::vector<LogRecord> records;
+	m_journalfound = CLogJournal::Read("log_" + filename + LOGFILE_EXTENSION, records);
+
+	for (const LogRecord& record : records)
+	{
+		if (m_chunks.back()->IsFull())
+		{
+			if (m_chunks.size() >= LOGGER_MAX_CHUNKS)
+			{
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+
+			m_marks.emplace_back();
+			m_rollups.GetMark(m_marks.back());
+			AddChunk();
+		}
+
+		LogChunk* chunk = m_chunks.back().get();
+		const std::size_t index = chunk->count++;
+		chunk->timestamp[index] = record.timestamp;
+		chunk->setpoint[index] = record.setpoint;
+		chunk->sensor[index] = record.sensor;
+		chunk->pwm[index] = record.pwm;
+		m_rollups.Add(record);
+	}
+
+	if (m_policy.journal > 0)
+		m_journaltimer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &CDataLogger::OnTimeout_Journal), m_policy.journal);
+
+	if (!records.empty())
+	{
+		std::cout << "Recovered " << records.size() << " samples of logger " << m_filename << " from its journal." << std::endl;
+
+		// Still in the journal until this write is done
+		m_journaled = GetStoredCount();
+		WriteToFile();
+	}
 }
 
 CDataLogger::~CDataLogger()
 {
-	if (m_thread != nullptr)
+	m_flushtimer.disconnect();
+	m_journaltimer.disconnect();
+
+	// Samples are in the journal should a write fail, the next start logs them again
+	if (m_policy.journal > 0)
+		OnTimeout_Journal();
+
+	// Every stored sample is written before the buffers go away, the main loop won't run the remaining writes
+	Flush();
+
+	// The writer thread must be done with the journal commits of this logger
+	m_service->Wait(&m_writer);
+}
+
+void CDataLogger::Log(const SampleTime& time, const float setpoint, const float sensor, const float pwm)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_chunks.back()->IsFull())
 	{
-		if (m_thread->joinable())
-			m_thread->join();
+		// Both buffers are full, the writer thread is still draining the previous one
+		if (m_chunks.size() >= LOGGER_MAX_CHUNKS)
+		{
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		// A write that stops after the full chunk takes the rollups up to here
+		m_marks.emplace_back();
+		m_rollups.GetMark(m_marks.back());
+		AddChunk();
+	}
 
-		delete m_thread;
-		m_thread = nullptr;
+	// Formatting is left to the writer thread
+	LogChunk* chunk = m_chunks.back().get();
+	const std::size_t index = chunk->count++;
+	chunk->timestamp[index] = time.wallclock;
+	chunk->setpoint[index] = setpoint;
+	chunk->sensor[index] = sensor;
+	chunk->pwm[index] = pwm;
+	m_rollups.Add(chunk->Get(index));
+
+	// The write is started by the main thread, only one request is sent until it happens
+	if (!m_flushrequested && !m_writing && IsFlushDue(false))
+	{
+		m_flushrequested = true;
+		m_flushdispatcher.emit();
 	}
+
+	CLatencyProbe::Mark(LATENCY_STAGE_LOGGED, setpoint);
 }
 
-void CDataLogger::Log(std::string setpoint, std::string sensor, std::string pwm)
+void CDataLogger::AddChunk()
 {
-	if (m_thread != nullptr) // Don't log new data while the writer thread is working
+	if (m_freechunks.empty())
+	{
+		m_chunks.push_back(std::make_unique<LogChunk>());
 		return;
+	}
 
-	std::time_t time = std::time(nullptr);
-	std::unique_ptr<char[]> timebuffer(new char[128]);
-	std::strftime(timebuffer.get(), 128, "%Y-%m-%dT%H:%M:%SZ", std::localtime(&time));
-	
-	m_timestamp_vector.get()->emplace_back(timebuffer.get());
-	m_setpoint_vector.get()->emplace_back(setpoint);
-	m_sensor_vector.get()->emplace_back(sensor);
-	m_pwm_vector.get()->emplace_back(pwm);
+	m_chunks.push_back(std::move(m_freechunks.back()));
+	m_freechunks.pop_back();
+	m_chunks.back()->count = 0;
+}
+
+// Every chunk but the last one is full
+std::size_t CDataLogger::GetStoredCount() const
+{
+	return (m_chunks.size() - 1) * LOGFILE_CHUNK_SAMPLES + m_chunks.back()->count;
+}
+
+bool CDataLogger::IsFlushDue(const bool checkinterval) const
+{
+	const std::size_t samples = GetStoredCount();
+
+	if (samples == 0)
+		return false;
+
+	if (m_policy.samples > 0 && samples >= m_policy.samples)
+		return true;
+
+	if (m_policy.bytes > 0 && samples * LOGFILE_RAW_SAMPLE_SIZE + m_chunks.size() * LOGFILE_CHUNK_HEADER_SIZE >= m_policy.bytes)
+		return true;
+
+	return checkinterval && m_policy.interval > 0 && std::chrono::steady_clock::now() - m_lastwrite >= std::chrono::seconds(m_policy.interval);
 }
 
 void CDataLogger::Notify()
 {
+	m_written.store(true, std::memory_order_release);
 	m_dispatcher.emit();
 }
 
 void CDataLogger::WriteToFile()
 {
-	if (m_setpoint_vector.get()->size() == 0)
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_chunks.front()->count == 0)
 		return;
 
-	if (m_thread == nullptr)
+	// A running write continues with these samples once it is done
+	m_forceflush = true;
+
+	if (!m_writing)
+		StartWrite();
+}
+
+void CDataLogger::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// The writer done signal needs the main loop, the writes are waited for here instead
+	while (m_writing || m_chunks.front()->count > 0)
 	{
-		m_thread = new std::thread(
-			[this]
-			{
-				m_writer.Write(this, m_timestamp_vector.get(), m_setpoint_vector.get(), m_sensor_vector.get(), m_pwm_vector.get());
-			});
+		if (!m_writing)
+			StartWrite();
+
+		lock.unlock();
+		m_service->Wait(&m_writer);
+		lock.lock();
+		FinishWrite();
 	}
 }
 
-void CDataLogger::OnSignal_WriterDone()
+void CDataLogger::StartWrite()
+{
+	// Move the oldest chunks, a long backlog is written in several steps instead of one long write
+	const std::size_t count = std::min<std::size_t>(m_chunks.size(), LOGGER_MAX_WRITE_CHUNKS);
+
+	for (std::size_t i = 0; i < count; i++)
+	{
+		m_flushing.push_back(std::move(m_chunks[i]));
+	}
+
+	m_chunks.erase(m_chunks.begin(), m_chunks.begin() + count);
+
+	// The receiver thread continues logging into a fresh chunk
+	if (m_chunks.empty())
+	{
+		AddChunk();
+		m_forceflush = false;
+		m_rollups.Take(m_flushingrollups);
+		m_marks.clear();
+	}
+	else
+	{
+		// The samples left in memory aren't in the rollups of this write, they would count twice when replayed from the journal
+		m_rollups.Take(m_flushingrollups, m_marks[count - 1]);
+		m_marks.erase(m_marks.begin(), m_marks.begin() + count);
+	}
+	m_writing = true;
+	m_lastwrite = std::chrono::steady_clock::now();
+
+	LogWriteJob job;
+	job.writer = &m_writer;
+	job.logger = this;
+	job.chunks = &m_flushing;
+	job.rollups = &m_flushingrollups;
+
+	std::size_t moved = 0;
+
+	for (const std::unique_ptr<LogChunk>& chunk : m_flushing)
+	{
+		moved += chunk->count;
+	}
+
+	m_journaled = m_journaled > moved ? m_journaled - moved : 0;
+
+	// Journaled samples that stay in memory are left in the journal as they are, a backlog isn't encoded again on every write.
+	// Once none are left the journal starts over.
+	if (m_policy.journal > 0)
+	{
+		if (m_journaled == 0)
+			job.journalaction = LOGJOURNAL_RESET;
+	}
+	else if (m_journalfound)
+	{
+		job.journalaction = LOGJOURNAL_REMOVE;
+		m_journalfound = false;
+	}
+
+	m_service->Submit(std::move(job));
+}
+
+void CDataLogger::Discard()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (std::unique_ptr<LogChunk>& chunk : m_chunks)
+	{
+		if (m_freechunks.size() < LOGGER_MAX_FREE_CHUNKS)
+			m_freechunks.push_back(std::move(chunk));
+	}
+
+	m_chunks.clear();
+	m_marks.clear();
+	m_journaled = 0;
+	m_forceflush = false;
+	AddChunk();
+}
+
+void CDataLogger::OnSignal_FlushRequest()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_flushrequested = false;
+
+	if (!m_writing && IsFlushDue(false))
+		StartWrite();
+}
+
+bool CDataLogger::OnTimeout_Flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_writing && IsFlushDue(true))
+		StartWrite();
+
+	return true;
+}
+
+bool CDataLogger::OnTimeout_Journal()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const std::size_t stored = GetStoredCount();
+
+	if (stored <= m_journaled)
+		return true;
+
+	// Every sample since the last commit goes out in one block and one sync
+	LogWriteJob job;
+	job.writer = &m_writer;
+	const std::size_t block = CLogFile::BeginJournalBlock(job.journal);
+	EncodeJournal(m_journaled, stored, job.journal);
+	CLogFile::FinishJournalBlock(job.journal, block);
+	m_journaled = stored;
+	m_service->Submit(std::move(job));
+	return true;
+}
+
+void CDataLogger::EncodeJournal(const std::size_t first, const std::size_t last, std::vector<std::uint8_t>& out) const
+{
+	out.reserve(out.size() + (last - first) * LOGJOURNAL_RECORD_SIZE);
+
+	// Every chunk but the last one is full
+	for (std::size_t i = first; i < last; i++)
+	{
+		CLogFile::EncodeJournalRecord(m_chunks[i / LOGFILE_CHUNK_SAMPLES]->Get(i % LOGFILE_CHUNK_SAMPLES), out);
+	}
+}
+
+void CDataLogger::FinishWrite()
 {
-	m_timestamp_vector.get()->clear();
-	m_setpoint_vector.get()->clear();
-	m_sensor_vector.get()->clear();
-	m_pwm_vector.get()->clear();
+	m_writing = false;
+	m_written.store(false, std::memory_order_relaxed);
 
-	if (m_thread != nullptr && m_writer.Done())
+	// Keep a few spare chunks, the memory of a long recording is given back
+	for (std::size_t i = 0; i < m_flushing.size() && m_freechunks.size() < LOGGER_MAX_FREE_CHUNKS; i++)
 	{
-		if (m_thread->joinable())
-			m_thread->join();
+		m_freechunks.push_back(std::move(m_flushing[i]));
+	}
+
+	m_flushing.clear();
+}
+
+void CDataLogger::OnSignal_WriterDone()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
 
-		delete m_thread;
-		m_thread = nullptr;
+	// The write was already taken back by Flush
+	if (!m_written.load(std::memory_order_acquire))
+		return;
+
+	FinishWrite();
+
+	const std::uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+
+	if (dropped != m_reporteddrops)
+	{
+		std::cout << "Warning: Logger " << m_filename << " dropped " << dropped - m_reporteddrops << " samples because the log buffer was full." << std::endl;
+		m_reporteddrops = dropped;
 	}
+
+	// Continue with the rest of a forced write or with samples that piled up during this one
+	if ((m_forceflush && m_chunks.front()->count > 0) || IsFlushDue(false))
+		StartWrite();
 }
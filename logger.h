@@ -25,47 +25,198 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+
+#include "protocol.h"
+#include "logfile.h"
+#include "logindex.h"
+#include "logsegment.h"
+#include "logrollup.h"
+#include "logjournal.h"
+
+#define LOGGER_MAX_FREE_CHUNKS 16 // empty chunks kept for reuse after a write
+#define LOGGER_MAX_CHUNKS 256 // limit of each buffer, about a million samples
+#define LOGGER_MAX_WRITE_CHUNKS 16 // chunks handed to the writer thread at once, a larger backlog is written in several steps
+#define LOGGER_DEFAULT_FLUSH_SAMPLES LOGFILE_CHUNK_SAMPLES
+#define LOGGER_DEFAULT_FLUSH_BYTES 262144
+#define LOGGER_DEFAULT_FLUSH_INTERVAL_S 60
+#define LOGGER_FLUSH_TIMER_MS 1000 // how often the flush interval is checked
+#define LOGGER_DEFAULT_JOURNAL_INTERVAL_MS 1000
+#define LOGWRITER_QUEUE_WARNING_DEPTH 8 // a queue this deep means the disk can't keep up with the loggers
+
+// When a data logger writes its samples without waiting for the Logger button, 0 disables a trigger
+struct LogFlushPolicy
+{
+	std::size_t samples = LOGGER_DEFAULT_FLUSH_SAMPLES; // samples waiting to be written
+	std::size_t bytes = LOGGER_DEFAULT_FLUSH_BYTES; // size of the waiting samples in the log file
+	unsigned int interval = LOGGER_DEFAULT_FLUSH_INTERVAL_S; // seconds since the last write
+	unsigned int journal = LOGGER_DEFAULT_JOURNAL_INTERVAL_MS; // milliseconds between two commits of new samples to the journal, 0 disables the journal
+};
+
+// What a write does with the journal once the samples are in the log file
+enum LogJournalAction
+{
+	LOGJOURNAL_KEEP = 0,
+	LOGJOURNAL_RESET, // every journaled sample is in the log file, start over with an empty journal
+	LOGJOURNAL_REMOVE, // the journal is disabled, the one left by an earlier run is no longer needed
+};
 
 class CDataLogger;
 
-// Data writer writes the stored data from a data logger class into a file
+using LogChunkList = std::vector<std::unique_ptr<LogChunk>>;
+
+// Data writer writes the stored data from a data logger class into a file.
+// The log, index and rollup files are kept open between writes.
 class CDataWriter
 {
 public:
-	CDataWriter(std::string filename);
+	CDataWriter(std::string filename, const LogChunkEncoding encoding = LOGCHUNK_ENCODING_RAW, const LogRetentionPolicy& retention = LogRetentionPolicy());
 	virtual ~CDataWriter();
 
-	// Writes data to file
-	void Write(CDataLogger* logger, std::vector<std::string>* timestamp, std::vector<std::string>* setpoint, std::vector<std::string>* sensor, std::vector<std::string>* pwm);
-	bool Done();
+	// Appends the chunks to the binary log file and to its index, rotating the file first when it is due,
+	// then the rollups to the rollup files. Only called by the log writer thread.
+	void Write(CDataLogger* logger, const LogChunkList* chunks, const LogRollupBatch* rollups, const LogJournalAction journal);
+	/// @brief Appends a block of new samples to the journal, only called by the log writer thread
+	void Commit(const std::vector<std::uint8_t>& block);
 private:
-	mutable std::mutex m_mutex;
 	std::string m_filename;
-	bool m_done;
+	LogChunkEncoding m_encoding;
+	CLogOutputFile m_file;
+	std::vector<std::uint8_t> m_buffer; // encoded chunks, reused between writes
+	std::vector<LogIndexEntry> m_entries;
+	CLogIndexWriter m_index;
+	CLogRollupWriter m_rollups;
+	LogRollupBatch m_heldrollups; // rollups of samples that didn't reach the log file yet
+	CLogJournal m_journal;
+	LogRetentionPolicy m_retention;
+	CLogCompactor m_compactor;
+	bool m_compactorstarted; // the compactor thread is started by the first write
+};
+
+// A write handed to the log writer thread, the buffers belong to the writer until the logger is notified.
+// A job without chunks commits its journal block.
+struct LogWriteJob
+{
+	CDataWriter* writer = nullptr;
+	CDataLogger* logger = nullptr;
+	const LogChunkList* chunks = nullptr;
+	const LogRollupBatch* rollups = nullptr;
+	LogJournalAction journalaction = LOGJOURNAL_KEEP;
+	std::vector<std::uint8_t> journal;
+};
+
+// Log writer thread shared by every data logger.
+// Writes are queued and run in order, every job queued while the thread was busy is taken at once.
+// The thread is started by the first job and stops when the last data logger is gone.
+class CLogWriterService
+{
+public:
+	CLogWriterService();
+	~CLogWriterService();
+	CLogWriterService(const CLogWriterService&) = delete;
+	CLogWriterService& operator=(const CLogWriterService&) = delete;
+
+	/// @brief The running service, a new one if no data logger holds it
+	static std::shared_ptr<CLogWriterService> Acquire();
+
+	void Submit(LogWriteJob&& job);
+	/// @brief Blocks until every job of writer is done
+	void Wait(const CDataWriter* writer);
+	/// @brief Jobs waiting or being written
+	std::size_t GetQueueDepth() const;
+	/// @brief Deepest the queue has been
+	std::size_t GetMaxQueueDepth() const;
+private:
+	void Run();
+	// m_mutex must be locked
+	bool IsPending(const CDataWriter* writer) const;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_wake; // jobs were queued or the service is stopping
+	std::condition_variable m_idle; // a batch of jobs is done
+	std::deque<LogWriteJob> m_jobs;
+	std::vector<LogWriteJob> m_running; // jobs taken by the thread
+	std::size_t m_maxdepth;
+	bool m_stop;
+	std::thread m_thread;
 };
 
 // Data logger stores data received from the serial.
+// Log is called from the serial receiver thread, everything else from the main thread.
+// Samples go into the active buffer, a write moves its oldest chunks to the empty flushing buffer
+// so logging continues while the shared log writer thread drains the old samples.
+// Writes start on their own when the flush policy is met, WriteToFile forces one.
+// Every sample also updates the per-minute, per-hour and per-day rollups, a write persists them next to the log file.
+// New samples are committed to the journal at the journal interval, samples found in the journal
+// at startup were lost by the last run and are logged again. The journal is only appended to
+// until a write takes every journaled sample, reading it skips the samples already in the log file.
 class CDataLogger
 {
 public:
-	CDataLogger(std::string filename);
+	CDataLogger(std::string filename, const LogFlushPolicy& policy = LogFlushPolicy(), const LogChunkEncoding encoding = LOGCHUNK_ENCODING_RAW,
+		const LogRetentionPolicy& retention = LogRetentionPolicy());
 	virtual ~CDataLogger();
 
 	// Store values
-	void Log(std::string setpoint, std::string sensor, std::string pwm);
+	/// @param time Arrival time of the sample
+	void Log(const SampleTime& time, const float setpoint, const float sensor, const float pwm);
 	void Notify();
+	/// @brief Writes every stored sample, in several steps if there are many
 	void WriteToFile();
+	/// @brief Writes every stored sample and blocks until the log writer thread is done with them
+	void Flush();
+	/// @brief Drops the stored samples without writing them, the destructor then has nothing to write
+	void Discard();
+	/// @brief Samples lost because the active buffer was full
+	std::uint64_t GetDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+	/// @brief Writes queued on the log writer thread by every data logger
+	std::size_t GetWriteQueueDepth() const { return m_service->GetQueueDepth(); }
 private:
 	void OnSignal_WriterDone();
+	void OnSignal_FlushRequest();
+	bool OnTimeout_Flush();
+	bool OnTimeout_Journal();
+	// Appends an empty chunk, reusing a free one when possible
+	void AddChunk();
+	// Takes the flushing buffer back from the writer thread, m_mutex must be locked
+	void FinishWrite();
+	// Hands the oldest chunks to the writer thread, m_mutex must be locked
+	void StartWrite();
+	// m_mutex must be locked
+	bool IsFlushDue(const bool checkinterval) const;
+	std::size_t GetStoredCount() const;
+	// Appends stored samples first <= i < last as journal records, m_mutex must be locked
+	void EncodeJournal(const std::size_t first, const std::size_t last, std::vector<std::uint8_t>& out) const;
 
 	std::string m_filename;
-	std::shared_ptr<std::vector<std::string>> m_timestamp_vector;
-	std::shared_ptr<std::vector<std::string>> m_setpoint_vector;
-	std::shared_ptr<std::vector<std::string>> m_sensor_vector;
-	std::shared_ptr<std::vector<std::string>> m_pwm_vector;
+	std::mutex m_mutex; // synchronizes the receiver thread with the main thread
+	bool m_writing; // the writer thread owns the flushing buffer
+	std::atomic<bool> m_written; // the writer thread is done with the flushing buffer, the writer done signal was sent
+	LogChunkList m_chunks; // active buffer, the last chunk is the one being filled
+	LogChunkList m_flushing; // buffer being written by the writer thread
+	LogChunkList m_freechunks;
+	CLogRollups m_rollups;
+	std::vector<LogRollupMark> m_marks; // rollups after each full chunk of the active buffer, reserved so Log doesn't allocate
+	LogRollupBatch m_flushingrollups; // rollups being written by the writer thread
+	std::atomic<std::uint64_t> m_dropped;
+	std::uint64_t m_reporteddrops; // dropped count already printed
+	LogFlushPolicy m_policy;
+	bool m_flushrequested; // the receiver thread asked the main thread for a write
+	bool m_forceflush; // WriteToFile was called, keep writing until the active buffer is empty
+	std::chrono::steady_clock::time_point m_lastwrite;
+	sigc::connection m_flushtimer;
+	sigc::connection m_journaltimer;
+	std::size_t m_journaled; // stored samples, from the oldest, that were handed to the journal
+	bool m_journalfound; // a journal was left by an earlier run
 	Glib::Dispatcher m_dispatcher;
+	Glib::Dispatcher m_flushdispatcher;
 	CDataWriter m_writer;
-	std::thread* m_thread;
+	std::shared_ptr<CLogWriterService> m_service;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,497 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logindex.h"
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CMappedFile::CMappedFile() :
+m_fd(-1),
+m_data(nullptr),
+m_size(0)
+{
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Open(const std::string& filename)
+{
+	struct stat info;
+
+	Close();
+	m_fd = open(filename.c_str(), O_RDONLY);
+
+	if (m_fd < 0)
+		return false;
+
+	if (fstat(m_fd, &info) != 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_size = static_cast<std::size_t>(info.st_size);
+
+	// An empty file can't be mapped, it is simply a file without data
+	if (m_size == 0)
+		return true;
+
+	void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	m_data = static_cast<const std::uint8_t*>(data);
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if (m_data != nullptr)
+		munmap(const_cast<std::uint8_t*>(m_data), m_size);
+
+	if (m_fd >= 0)
+		close(m_fd);
+
+	m_fd = -1;
+	m_data = nullptr;
+	m_size = 0;
+}
+
+CLogOutputFile::CLogOutputFile() :
+m_fd(-1)
+{
+}
+
+CLogOutputFile::~CLogOutputFile()
+{
+	Close();
+}
+
+bool CLogOutputFile::Open(const std::string& filename)
+{
+	struct stat path;
+	struct stat handle;
+
+	// Same file as the last write, nothing to do
+	if (m_fd >= 0 && stat(filename.c_str(), &path) == 0 && fstat(m_fd, &handle) == 0 && path.st_dev == handle.st_dev && path.st_ino == handle.st_ino)
+		return true;
+
+	Close();
+	m_fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	return m_fd >= 0;
+}
+
+void CLogOutputFile::Close()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+
+	m_fd = -1;
+}
+
+std::uint64_t CLogOutputFile::GetSize() const
+{
+	struct stat info;
+
+	if (m_fd < 0 || fstat(m_fd, &info) != 0)
+		return 0;
+
+	return static_cast<std::uint64_t>(info.st_size);
+}
+
+bool CLogOutputFile::Read(void* data, const std::size_t size, const std::uint64_t offset) const
+{
+	std::size_t done = 0;
+
+	while (done < size)
+	{
+		const ssize_t result = pread(m_fd, static_cast<std::uint8_t*>(data) + done, size - done, static_cast<off_t>(offset + done));
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			return false;
+
+		done += static_cast<std::size_t>(result);
+	}
+
+	return true;
+}
+
+bool CLogOutputFile::Write(const void* data, const std::size_t size, const std::uint64_t offset)
+{
+	std::size_t done = 0;
+
+	while (done < size)
+	{
+		const ssize_t result = pwrite(m_fd, static_cast<const std::uint8_t*>(data) + done, size - done, static_cast<off_t>(offset + done));
+
+		if (result < 0 && errno == EINTR)
+			continue;
+
+		if (result <= 0)
+			return false;
+
+		done += static_cast<std::size_t>(result);
+	}
+
+	return true;
+}
+
+bool CLogOutputFile::Truncate(const std::uint64_t size)
+{
+	return m_fd >= 0 && ftruncate(m_fd, static_cast<off_t>(size)) == 0;
+}
+
+bool CLogOutputFile::Sync()
+{
+	return m_fd >= 0 && fdatasync(m_fd) == 0;
+}
+
+bool CLogOutputFile::SyncDirectory(const std::string& filename)
+{
+	const std::size_t separator = filename.find_last_of('/');
+	const std::string directory = separator == std::string::npos ? std::string(".") : filename.substr(0, separator + 1);
+	const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+		return false;
+
+	const bool synced = fsync(fd) == 0;
+	close(fd);
+	return synced;
+}
+
+CLogIndexWriter::CLogIndexWriter(const std::string& datafile) :
+m_datafile(datafile),
+m_indexfile(CLogFile::GetIndexFileName(datafile)),
+m_file(),
+m_buffer()
+{
+}
+
+void CLogIndexWriter::Append(const std::vector<LogIndexEntry>& entries)
+{
+	if (entries.empty())
+		return;
+
+	std::uint64_t end = 0;
+
+	// Find where the index ends, it is checked on every write as it can be rebuilt or removed by hand
+	if (m_file.Open(m_indexfile))
+	{
+		const std::uint64_t size = m_file.GetSize();
+		std::uint8_t header[LOGINDEX_HEADER_SIZE];
+
+		if (size >= LOGINDEX_HEADER_SIZE && (size - LOGINDEX_HEADER_SIZE) % LOGINDEX_ENTRY_SIZE == 0 &&
+			m_file.Read(header, sizeof(header), 0) && CLogFile::DecodeIndexHeader(header, sizeof(header)) == LOGREAD_OK)
+		{
+			end = LOGFILE_HEADER_SIZE;
+
+			if (size > LOGINDEX_HEADER_SIZE)
+			{
+				std::uint8_t data[LOGINDEX_ENTRY_SIZE];
+				LogIndexEntry last;
+
+				if (m_file.Read(data, sizeof(data), size - LOGINDEX_ENTRY_SIZE))
+				{
+					CLogFile::DecodeIndexEntry(data, last);
+					end = last.GetEnd();
+				}
+				else
+					end = 0;
+			}
+		}
+	}
+
+	// The index is missing, damaged or behind the log file, ie: the program stopped between the two writes
+	if (end != entries.front().offset)
+	{
+		if (entries.front().offset > LOGFILE_HEADER_SIZE)
+			std::cout << "[THREADED] Rebuilding log index " << m_indexfile << std::endl;
+
+		Rebuild(m_datafile, entries.front().offset);
+
+		if (!m_file.Open(m_indexfile))
+			return;
+	}
+
+	m_buffer.clear();
+
+	for (const LogIndexEntry& entry : entries)
+	{
+		CLogFile::EncodeIndexEntry(entry, m_buffer);
+	}
+
+	m_file.Write(m_buffer.data(), m_buffer.size(), m_file.GetSize());
+}
+
+std::uint64_t CLogIndexWriter::Rebuild(const std::string& datafile, const std::uint64_t limit)
+{
+	const std::string indexfile = CLogFile::GetIndexFileName(datafile);
+	std::unique_ptr<LogChunk> chunk = std::make_unique<LogChunk>();
+	std::vector<std::uint8_t> buffer;
+	CLogFileReader reader;
+	LogChunkHeader header;
+
+	CLogFile::EncodeIndexHeader(buffer);
+
+	if (reader.Open(datafile) == LOGREAD_OK)
+	{
+		while (reader.GetOffset() < limit)
+		{
+			LogIndexEntry entry;
+			entry.offset = reader.GetOffset();
+			const LogReadResult result = reader.ReadChunk(header, *chunk);
+
+			// A damaged chunk is left out of the index, the scan continues with the next one
+			if (result == LOGREAD_BAD_CHECKSUM)
+				continue;
+
+			if (result != LOGREAD_OK)
+				break;
+
+			CLogFile::Summarize(*chunk, entry);
+			entry.size = header.size;
+			CLogFile::EncodeIndexEntry(entry, buffer);
+		}
+	}
+
+	// Readers can have the index mapped, it is replaced as a whole instead of being truncated under them
+	const std::string tempfile = indexfile + LOGINDEX_TEMP_SUFFIX;
+	CLogOutputFile file;
+
+	if (!file.Open(tempfile) || !file.Truncate(0) || !file.Write(buffer.data(), buffer.size(), 0) || !file.Sync())
+	{
+		std::cout << "Failed to write log index " << tempfile << std::endl;
+		file.Close();
+		std::remove(tempfile.c_str());
+		return reader.GetOffset();
+	}
+
+	file.Close();
+
+	if (std::rename(tempfile.c_str(), indexfile.c_str()) != 0)
+	{
+		std::cout << "Failed to replace log index " << indexfile << std::endl;
+		std::remove(tempfile.c_str());
+	}
+
+	return reader.GetOffset();
+}
+
+CLogQuery::CLogQuery() :
+m_data(),
+m_index(),
+m_indexed(0),
+m_tail(),
+m_chunk(std::make_unique<LogChunk>()),
+m_decoded(0),
+m_damaged(0)
+{
+}
+
+LogReadResult CLogQuery::Open(const std::string& datafile)
+{
+	Close();
+
+	if (!m_data.Open(datafile))
+		return LOGREAD_OPEN_FAILED;
+
+	const LogReadResult result = CLogFile::DecodeFileHeader(m_data.GetData(), m_data.GetSize());
+
+	if (result != LOGREAD_OK)
+		return result;
+
+	std::uint64_t end = LOGFILE_HEADER_SIZE;
+
+	// A missing or unusable index only makes the queries slower
+	if (m_index.Open(CLogFile::GetIndexFileName(datafile)) && CLogFile::DecodeIndexHeader(m_index.GetData(), m_index.GetSize()) == LOGREAD_OK)
+	{
+		m_indexed = (m_index.GetSize() - LOGINDEX_HEADER_SIZE) / LOGINDEX_ENTRY_SIZE;
+
+		if (m_indexed > 0)
+		{
+			end = GetEntry(m_indexed - 1).GetEnd();
+
+			// The index doesn't belong to this log file
+			if (end > m_data.GetSize())
+			{
+				m_indexed = 0;
+				end = LOGFILE_HEADER_SIZE;
+			}
+		}
+	}
+
+	// Chunks written after the index
+	while (end + LOGFILE_CHUNK_HEADER_SIZE <= m_data.GetSize())
+	{
+		LogChunkHeader header;
+		LogIndexEntry entry;
+
+		if (CLogFile::DecodeChunkHeader(m_data.GetData() + end, header) != LOGREAD_OK || end + LOGFILE_CHUNK_HEADER_SIZE + header.size > m_data.GetSize())
+			break;
+
+		entry.offset = end;
+		end += LOGFILE_CHUNK_HEADER_SIZE + header.size;
+
+		if (CLogFile::DecodeChunk(m_data.GetData() + entry.offset, header, *m_chunk) != LOGREAD_OK)
+		{
+			m_damaged++;
+			continue;
+		}
+
+		CLogFile::Summarize(*m_chunk, entry);
+		entry.size = header.size;
+		m_tail.push_back(entry);
+	}
+
+	return LOGREAD_OK;
+}
+
+void CLogQuery::Close()
+{
+	m_data.Close();
+	m_index.Close();
+	m_indexed = 0;
+	m_tail.clear();
+	m_decoded = 0;
+	m_damaged = 0;
+}
+
+LogAggregate CLogQuery::Aggregate(const std::int64_t from, const std::int64_t to)
+{
+	const std::size_t count = GetChunkCount();
+	LogAggregate aggregate;
+
+	for (std::size_t i = FindFirst(from); i < count; i++)
+	{
+		const LogIndexEntry entry = GetEntry(i);
+
+		if (entry.mintime > to)
+			break;
+
+		if (entry.maxtime < from || entry.count == 0)
+			continue;
+
+		// Whole chunk in range, the index has everything
+		if (entry.mintime >= from && entry.maxtime <= to)
+		{
+			aggregate.count += entry.count;
+			aggregate.mintime = entry.mintime < aggregate.mintime ? entry.mintime : aggregate.mintime;
+			aggregate.maxtime = entry.maxtime > aggregate.maxtime ? entry.maxtime : aggregate.maxtime;
+			aggregate.setpoint.Merge(entry.setpoint);
+			aggregate.sensor.Merge(entry.sensor);
+			aggregate.pwm.Merge(entry.pwm);
+			continue;
+		}
+
+		if (!LoadChunk(entry))
+			continue;
+
+		for (std::size_t j = 0; j < m_chunk->count; j++)
+		{
+			const std::int64_t timestamp = m_chunk->timestamp[j];
+
+			if (timestamp < from || timestamp > to)
+				continue;
+
+			aggregate.count++;
+			aggregate.mintime = timestamp < aggregate.mintime ? timestamp : aggregate.mintime;
+			aggregate.maxtime = timestamp > aggregate.maxtime ? timestamp : aggregate.maxtime;
+			aggregate.setpoint.Add(m_chunk->setpoint[j]);
+			aggregate.sensor.Add(m_chunk->sensor[j]);
+			aggregate.pwm.Add(m_chunk->pwm[j]);
+		}
+	}
+
+	return aggregate;
+}
+
+LogIndexEntry CLogQuery::GetEntry(const std::size_t index) const
+{
+	if (index >= m_indexed)
+		return m_tail[index - m_indexed];
+
+	LogIndexEntry entry;
+	CLogFile::DecodeIndexEntry(m_index.GetData() + LOGINDEX_HEADER_SIZE + index * LOGINDEX_ENTRY_SIZE, entry);
+	return entry;
+}
+
+std::size_t CLogQuery::FindFirst(const std::int64_t from) const
+{
+	std::size_t low = 0;
+	std::size_t high = GetChunkCount();
+
+	while (low < high)
+	{
+		const std::size_t middle = low + (high - low) / 2;
+
+		if (GetEntry(middle).maxtime < from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
+
+LogReadResult CLogQuery::ReadChunkHeader(const LogIndexEntry& entry, LogChunkHeader& header) const
+{
+	if (entry.GetEnd() > m_data.GetSize())
+		return LOGREAD_TRUNCATED;
+
+	return CLogFile::DecodeChunkHeader(m_data.GetData() + entry.offset, header);
+}
+
+LogReadResult CLogQuery::ReadChunk(const LogIndexEntry& entry, LogChunk& chunk) const
+{
+	LogChunkHeader header;
+	const LogReadResult result = ReadChunkHeader(entry, header);
+
+	if (result != LOGREAD_OK)
+		return result;
+
+	return CLogFile::DecodeChunk(m_data.GetData() + entry.offset, header, chunk);
+}
+
+bool CLogQuery::LoadChunk(const LogIndexEntry& entry)
+{
+	m_decoded++;
+
+	if (ReadChunk(entry, *m_chunk) != LOGREAD_OK)
+	{
+		m_damaged++;
+		return false;
+	}
+
+	return true;
+}
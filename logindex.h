@@ -0,0 +1,190 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGINDEX_
+#define _H_LOGINDEX_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logfile.h"
+
+// Read only memory map of a whole file, pages are only loaded when they are touched
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+	CMappedFile(const CMappedFile&) = delete;
+	CMappedFile& operator=(const CMappedFile&) = delete;
+
+	bool Open(const std::string& filename);
+	void Close();
+	const std::uint8_t* GetData() const { return m_data; }
+	std::size_t GetSize() const { return m_size; }
+private:
+	int m_fd;
+	const std::uint8_t* m_data;
+	std::size_t m_size;
+};
+
+// Read and write handle of a file appended to by the log writer thread.
+// The handle stays open between writes, it is opened again when the file was renamed or removed, ie: rotated.
+class CLogOutputFile
+{
+public:
+	CLogOutputFile();
+	~CLogOutputFile();
+	CLogOutputFile(const CLogOutputFile&) = delete;
+	CLogOutputFile& operator=(const CLogOutputFile&) = delete;
+
+	/// @brief Opens the file, creating it if it doesn't exist. The open handle is kept while it still belongs to filename.
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen() const { return m_fd >= 0; }
+	/// @return Size of the open file, 0 if it can't be read
+	std::uint64_t GetSize() const;
+	/// @brief Reads exactly size bytes at offset
+	bool Read(void* data, const std::size_t size, const std::uint64_t offset) const;
+	/// @brief Writes exactly size bytes at offset, a short write is continued
+	bool Write(const void* data, const std::size_t size, const std::uint64_t offset);
+	bool Truncate(const std::uint64_t size);
+	/// @brief Waits until the data written so far is on the disk
+	bool Sync();
+	/// @brief Waits until the entries of the directory holding filename, ie: renames, are on the disk
+	static bool SyncDirectory(const std::string& filename);
+private:
+	int m_fd;
+};
+
+// Keeps the index file of a log file in step with it, used by the log writer thread
+class CLogIndexWriter
+{
+public:
+	CLogIndexWriter(const std::string& datafile);
+
+	/// @brief Appends the entries of chunks that were just written to the log file
+	/// @param entries Entries with their offsets in the log file, in file order
+	void Append(const std::vector<LogIndexEntry>& entries);
+	/// @brief Builds the index file of a log file from its chunks
+	/// @param limit Log file offset where the scan stops
+	/// @return Log file offset where the scan ended
+	static std::uint64_t Rebuild(const std::string& datafile, const std::uint64_t limit = std::numeric_limits<std::uint64_t>::max());
+	/// @brief Waits until the appended entries are on the disk
+	bool Sync() { return m_file.Sync(); }
+private:
+	std::string m_datafile;
+	std::string m_indexfile;
+	CLogOutputFile m_file;
+	std::vector<std::uint8_t> m_buffer;
+};
+
+// Result of an aggregate query
+struct LogAggregate
+{
+	std::uint64_t count = 0;
+	std::int64_t mintime = std::numeric_limits<std::int64_t>::max();
+	std::int64_t maxtime = std::numeric_limits<std::int64_t>::min();
+	LogColumnStats setpoint;
+	LogColumnStats sensor;
+	LogColumnStats pwm;
+};
+
+// Time range queries over a log file.
+// Both files are memory mapped, the index is binary searched and only the chunks that
+// overlap the range are decoded. Chunks written after the index are found by scanning the log file.
+// Chunks are expected in time order, a wall clock that jumps backwards can hide samples from a query.
+class CLogQuery
+{
+public:
+	CLogQuery();
+
+	LogReadResult Open(const std::string& datafile);
+	void Close();
+
+	/// @brief Calls onsample with every sample in from <= timestamp <= to, in file order
+	/// @return Number of samples found
+	template <typename Callback>
+	std::uint64_t Select(const std::int64_t from, const std::int64_t to, Callback&& onsample);
+	/// @brief Count, time range and column statistics of the samples in from <= timestamp <= to.
+	/// Chunks entirely inside the range are answered from the index without reading the log file.
+	LogAggregate Aggregate(const std::int64_t from, const std::int64_t to);
+
+	std::size_t GetChunkCount() const { return m_indexed + m_tail.size(); }
+	/// @brief Chunks missing from the index file
+	std::size_t GetUnindexedCount() const { return m_tail.size(); }
+	/// @brief Chunks decoded since the file was opened
+	std::uint64_t GetDecodedCount() const { return m_decoded; }
+	/// @brief Chunks that failed their checksum since the file was opened
+	std::uint64_t GetDamagedCount() const { return m_damaged; }
+
+	/// @brief Index entry of a chunk, chunks are numbered in file order
+	LogIndexEntry GetEntry(const std::size_t index) const;
+	/// @brief First chunk that can hold samples at or after from
+	std::size_t FindFirst(const std::int64_t from) const;
+	/// @brief Decodes the header of a chunk without its columns
+	LogReadResult ReadChunkHeader(const LogIndexEntry& entry, LogChunkHeader& header) const;
+	/// @brief Decodes a chunk, safe to call from several threads at once
+	LogReadResult ReadChunk(const LogIndexEntry& entry, LogChunk& chunk) const;
+private:
+	// Decodes a chunk into m_chunk
+	bool LoadChunk(const LogIndexEntry& entry);
+
+	CMappedFile m_data;
+	CMappedFile m_index;
+	std::size_t m_indexed; // entries in the index file
+	std::vector<LogIndexEntry> m_tail;
+	std::unique_ptr<LogChunk> m_chunk;
+	std::uint64_t m_decoded;
+	std::uint64_t m_damaged;
+};
+
+template <typename Callback>
+inline std::uint64_t CLogQuery::Select(const std::int64_t from, const std::int64_t to, Callback&& onsample)
+{
+	const std::size_t count = GetChunkCount();
+	std::uint64_t found = 0;
+
+	for (std::size_t i = FindFirst(from); i < count; i++)
+	{
+		const LogIndexEntry entry = GetEntry(i);
+
+		if (entry.mintime > to)
+			break;
+
+		if (entry.maxtime < from || !LoadChunk(entry))
+			continue;
+
+		for (std::size_t j = 0; j < m_chunk->count; j++)
+		{
+			if (m_chunk->timestamp[j] >= from && m_chunk->timestamp[j] <= to)
+			{
+				onsample(m_chunk->Get(j));
+				found++;
+			}
+		}
+	}
+
+	return found;
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logjournal.h"
+#include "logsegment.h"
+#include <cstdio>
+#include <limits>
+
+CLogJournal::CLogJournal(const std::string& datafile) :
+m_filename(CLogFile::GetJournalFileName(datafile)),
+m_file(),
+m_end(0)
+{
+}
+
+std::uint64_t CLogJournal::FindEnd(const std::string& filename)
+{
+	CMappedFile file;
+
+	if (!file.Open(filename) || CLogFile::DecodeJournalHeader(file.GetData(), file.GetSize()) != LOGREAD_OK)
+		return 0;
+
+	std::uint64_t end = LOGJOURNAL_HEADER_SIZE;
+	std::uint32_t count = 0;
+
+	while (CLogFile::DecodeJournalBlock(file.GetData() + end, file.GetSize() - end, count) == LOGREAD_OK)
+	{
+		end += LOGJOURNAL_BLOCK_HEADER_SIZE + static_cast<std::uint64_t>(count) * LOGJOURNAL_RECORD_SIZE;
+	}
+
+	return end;
+}
+
+bool CLogJournal::Append(const std::vector<std::uint8_t>& block)
+{
+	if (!m_file.Open(m_filename))
+		return false;
+
+	// The file was removed or replaced since the last commit
+	if (m_end == 0 || m_file.GetSize() < m_end)
+		m_end = FindEnd(m_filename);
+
+	// A damaged tail is overwritten, blocks written after it couldn't be read
+	if (m_end == 0)
+		return Reset(block);
+
+	if (!m_file.Write(block.data(), block.size(), m_end) || !m_file.Sync())
+		return false;
+
+	m_end += block.size();
+	return true;
+}
+
+bool CLogJournal::Reset(const std::vector<std::uint8_t>& block)
+{
+	const std::string tempfile = m_filename + LOGJOURNAL_TEMP_SUFFIX;
+	std::vector<std::uint8_t> buffer;
+	CLogOutputFile file;
+
+	CLogFile::EncodeJournalHeader(buffer);
+	buffer.insert(buffer.end(), block.begin(), block.end());
+
+	// The old journal stays whole until the new one is on the disk, a torn write only damages the temp file
+	if (!file.Open(tempfile) || !file.Truncate(0) || !file.Write(buffer.data(), buffer.size(), 0) || !file.Sync())
+	{
+		file.Close();
+		std::remove(tempfile.c_str());
+		m_end = 0;
+		return false;
+	}
+
+	file.Close();
+
+	if (std::rename(tempfile.c_str(), m_filename.c_str()) != 0)
+	{
+		std::remove(tempfile.c_str());
+		m_end = 0;
+		return false;
+	}
+
+	// The next commit opens the new journal
+	m_file.Close();
+	m_end = buffer.size();
+	return CLogOutputFile::SyncDirectory(m_filename);
+}
+
+bool CLogJournal::Clear()
+{
+	std::vector<std::uint8_t> block;
+	CLogFile::FinishJournalBlock(block, CLogFile::BeginJournalBlock(block));
+	return Reset(block);
+}
+
+void CLogJournal::Remove()
+{
+	m_file.Close();
+	m_end = 0;
+	std::remove(m_filename.c_str());
+}
+
+bool CLogJournal::Read(const std::string& datafile, std::vector<LogRecord>& records)
+{
+	CMappedFile file;
+
+	if (!file.Open(CLogFile::GetJournalFileName(datafile)))
+		return false;
+
+	if (CLogFile::DecodeJournalHeader(file.GetData(), file.GetSize()) != LOGREAD_OK)
+		return true;
+
+	std::int64_t last = std::numeric_limits<std::int64_t>::min();
+	const std::vector<std::string> segments = CLogSegments::GetSegmentFiles(datafile);
+
+	// Newest sample already in the log files, the live file can be empty right after a rotation
+	for (auto segment = segments.rbegin(); segment != segments.rend(); ++segment)
+	{
+		CLogQuery query;
+
+		if (query.Open(*segment) == LOGREAD_OK && query.GetChunkCount() > 0)
+		{
+			last = query.GetEntry(query.GetChunkCount() - 1).maxtime;
+			break;
+		}
+	}
+
+	std::uint64_t offset = LOGJOURNAL_HEADER_SIZE;
+	std::uint32_t count = 0;
+
+	while (CLogFile::DecodeJournalBlock(file.GetData() + offset, file.GetSize() - offset, count) == LOGREAD_OK)
+	{
+		const std::uint8_t* data = file.GetData() + offset + LOGJOURNAL_BLOCK_HEADER_SIZE;
+		offset += LOGJOURNAL_BLOCK_HEADER_SIZE + static_cast<std::uint64_t>(count) * LOGJOURNAL_RECORD_SIZE;
+
+		// Samples are journaled in time order, anything older was already written or journaled twice
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			LogRecord record;
+			CLogFile::DecodeJournalRecord(data + i * LOGJOURNAL_RECORD_SIZE, record);
+
+			if (record.timestamp <= last)
+				continue;
+
+			records.push_back(record);
+			last = record.timestamp;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,60 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGJOURNAL_
+#define _H_LOGJOURNAL_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "logfile.h"
+#include "logindex.h"
+
+// Write-ahead journal of the samples a data logger holds in memory, ie: log_humidity.wal.
+// The logger commits its new samples as one block at a fixed interval, each commit is synced to the disk.
+// Once a write has put every journaled sample in the log file, the journal starts over empty.
+// Until then it keeps the written samples too, reading it skips them.
+// Only used by the log writer thread, except for Read.
+class CLogJournal
+{
+public:
+	CLogJournal(const std::string& datafile);
+
+	/// @brief Appends a block and waits until it is on the disk
+	/// @param block Built with CLogFile::BeginJournalBlock and FinishJournalBlock
+	bool Append(const std::vector<std::uint8_t>& block);
+	/// @brief Replaces the journal with a block, the log file must be synced first
+	bool Reset(const std::vector<std::uint8_t>& block);
+	/// @brief Replaces the journal with an empty one, the log file must be synced first
+	bool Clear();
+	void Remove();
+	/// @brief Reads the samples of the journal that are missing from the log file and its segments.
+	/// Reading stops at the first damaged block, ie: a commit cut short by a power cut.
+	/// @return The journal exists
+	static bool Read(const std::string& datafile, std::vector<LogRecord>& records);
+private:
+	// End of the last intact block of a journal file, 0 if it must be started over
+	static std::uint64_t FindEnd(const std::string& filename);
+
+	std::string m_filename;
+	CLogOutputFile m_file;
+	std::uint64_t m_end; // where the next block goes, 0 when not known
+};
+
+#endif
@@ -0,0 +1,240 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Time range queries over binary log files.
+// Rotated segments of the log file are included.
+// Usage: logquery [options] <channel or file>, ie: logquery --from 2023-10-17T02:00 --to 2023-10-17T04:00 --aggregate humidity
+
+#include "logindex.h"
+#include "logsegment.h"
+#include "logrollup.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+static void PrintUsage(const char* program)
+{
+	std::cout << "Usage: " << program << " [options] <channel or file>\n"
+		<< "  --from <time>      start of the range in local time, ie: 2023-10-17T02:00 (default: start of the log)\n"
+		<< "  --to <time>        end of the range in local time (default: end of the log)\n"
+		<< "  --aggregate        print the sample count and the min, max and mean of each column\n"
+		<< "  --rollup <level>   print the 1m, 1h or 1d rollups instead of the samples\n"
+		<< "  --reindex          rebuild the index and rollup files, not while the program is logging to them\n"
+		<< "A channel name like humidity reads log_humidity" << LOGFILE_EXTENSION << " in the current directory." << std::endl;
+}
+
+// Time part of a formatted log line
+static std::string FormatTime(const std::int64_t timestamp)
+{
+	const LogRecord record = { timestamp, 0.0f, 0.0f, 0.0f };
+	std::string line = CLogFile::FormatLine(record);
+	line.resize(line.find(' '));
+	return line;
+}
+
+// Rollup line, ie: 2023-10-17T12:00:00.000000Z 60 samples setpoint 24.00/24.00/24.00/24.00 ... as min/max/mean/last
+static void PrintRollup(const LogRollup& rollup)
+{
+	const LogColumnStats* const stats[3] = { &rollup.setpoint, &rollup.sensor, &rollup.pwm };
+	const float last[3] = { rollup.lastsetpoint, rollup.lastsensor, rollup.lastpwm };
+	const char* const names[3] = { "setpoint", "sensor", "pwm" };
+
+	printf("%s %u samples", FormatTime(rollup.start).c_str(), rollup.count);
+
+	for (int c = 0; c < 3; c++)
+	{
+		printf(" %s %.2f/%.2f/%.2f/%.2f", names[c], stats[c]->min, stats[c]->max, stats[c]->sum / static_cast<double>(rollup.count), last[c]);
+	}
+
+	printf(rollup.partial ? " partial\n" : "\n");
+}
+
+static void PrintColumn(const char* name, const LogColumnStats& stats, const std::uint64_t count)
+{
+	printf("  %-9s min %.2f max %.2f mean %.2f\n", name, stats.min, stats.max, stats.sum / static_cast<double>(count));
+}
+
+int main(int argc, char* argv[])
+{
+	std::int64_t from = std::numeric_limits<std::int64_t>::min();
+	std::int64_t to = std::numeric_limits<std::int64_t>::max();
+	bool aggregate = false;
+	bool reindex = false;
+	int rollup = -1;
+	std::string datafile;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+		if (strcmp(arg, "--aggregate") == 0)
+			aggregate = true;
+		else if (strcmp(arg, "--reindex") == 0)
+			reindex = true;
+		else if (value != nullptr && strcmp(arg, "--rollup") == 0 && rollup < 0)
+		{
+			i++;
+
+			for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+			{
+				if (strcmp(value, CLogFile::GetRollupLevelName(static_cast<LogRollupLevel>(level))) == 0)
+					rollup = level;
+			}
+
+			if (rollup < 0)
+			{
+				PrintUsage(argv[0]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (value != nullptr && strcmp(arg, "--from") == 0 && CLogFile::ParseTime(argv[++i], from))
+			continue;
+		else if (value != nullptr && strcmp(arg, "--to") == 0 && CLogFile::ParseTime(argv[++i], to))
+			continue;
+		else if (arg[0] != '-' && datafile.empty())
+			datafile = CLogFile::GetDataFileName(arg);
+		else
+		{
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (datafile.empty())
+	{
+		PrintUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	// Rotated segments are read in time order, followed by the log file itself
+	const std::vector<std::string> segments = CLogSegments::GetSegmentFiles(datafile);
+
+	if (segments.empty())
+	{
+		std::cerr << datafile << ": " << CLogFile::GetReadResultName(LOGREAD_OPEN_FAILED) << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (reindex)
+	{
+		for (const std::string& segment : segments)
+		{
+			const std::uint64_t end = CLogIndexWriter::Rebuild(segment);
+			std::cout << "Indexed " << segment << " up to offset " << end << std::endl;
+		}
+
+		const std::uint64_t samples = CLogRollupWriter::Rebuild(datafile);
+		std::cout << "Rebuilt the rollups of " << datafile << " from " << samples << " samples" << std::endl;
+	}
+
+	// Rollups cover every segment, a long range is answered from a few kilobytes
+	if (rollup >= 0)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		CLogRollupQuery query;
+		const LogReadResult result = query.Open(datafile, static_cast<LogRollupLevel>(rollup));
+
+		if (result != LOGREAD_OK)
+		{
+			std::cerr << CLogFile::GetRollupFileName(datafile, static_cast<LogRollupLevel>(rollup)) << ": " << CLogFile::GetReadResultName(result) << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		const std::size_t found = query.Select(from, to, PrintRollup);
+		fflush(stdout);
+
+		const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << "Query took " << elapsed << " ms, " << found << " of " << query.GetCount() << " rollups" << std::endl;
+		return EXIT_SUCCESS;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	LogAggregate values;
+	std::uint64_t decoded = 0;
+	std::uint64_t chunks = 0;
+	std::uint64_t damaged = 0;
+
+	for (const std::string& segment : segments)
+	{
+		CLogQuery query;
+		const LogReadResult result = query.Open(segment);
+
+		if (result != LOGREAD_OK)
+		{
+			std::cerr << segment << ": " << CLogFile::GetReadResultName(result) << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		if (query.GetUnindexedCount() > 0)
+			std::cerr << segment << ": " << query.GetUnindexedCount() << " chunks are missing from the index, run with --reindex if this persists" << std::endl;
+
+		if (aggregate)
+		{
+			const LogAggregate part = query.Aggregate(from, to);
+			values.count += part.count;
+			values.mintime = part.mintime < values.mintime ? part.mintime : values.mintime;
+			values.maxtime = part.maxtime > values.maxtime ? part.maxtime : values.maxtime;
+			values.setpoint.Merge(part.setpoint);
+			values.sensor.Merge(part.sensor);
+			values.pwm.Merge(part.pwm);
+		}
+		else
+		{
+			query.Select(from, to,
+				[](const LogRecord& record)
+				{
+					const std::string line = CLogFile::FormatLine(record);
+					fwrite(line.c_str(), 1, line.size(), stdout);
+				});
+		}
+
+		decoded += query.GetDecodedCount();
+		chunks += query.GetChunkCount();
+		damaged += query.GetDamagedCount();
+	}
+
+	if (aggregate)
+	{
+		if (values.count == 0)
+			std::cout << datafile << ": no samples in range" << std::endl;
+		else
+		{
+			std::cout << datafile << ": " << values.count << " samples from " << FormatTime(values.mintime) << " to " << FormatTime(values.maxtime) << std::endl;
+			PrintColumn("setpoint", values.setpoint, values.count);
+			PrintColumn("sensor", values.sensor, values.count);
+			PrintColumn("pwm", values.pwm, values.count);
+		}
+	}
+
+	fflush(stdout);
+
+	const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Query took " << elapsed << " ms, decoded " << decoded << " of " << chunks << " chunks in " << segments.size() << " files" << std::endl;
+
+	if (damaged > 0)
+	{
+		std::cerr << datafile << ": " << damaged << " damaged chunks were skipped" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
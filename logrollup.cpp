@@ -0,0 +1,327 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logrollup.h"
+#include "logsegment.h"
+#include <cstdio>
+#include <ctime>
+#include <limits>
+
+#define LOGROLLUP_NANOSECONDS_PER_SECOND 1000000000LL
+#define LOGROLLUP_REBUILD_SAMPLES 65536 // samples read between two writes of a rebuild
+
+// Rounds towards negative infinity
+static std::int64_t FloorTo(const std::int64_t value, const std::int64_t step)
+{
+	const std::int64_t remainder = value % step;
+	return remainder < 0 ? value - remainder - step : value - remainder;
+}
+
+CLogRollups::CLogRollups() :
+m_open(),
+m_closed(),
+m_taken()
+{
+}
+
+void CLogRollups::CloseMinute()
+{
+	LogRollup& minute = m_open[LOGROLLUP_MINUTE];
+
+	if (minute.count == 0)
+		return;
+
+	for (int level = LOGROLLUP_MINUTE + 1; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		LogRollup& open = m_open[level];
+
+		if (minute.start >= open.end)
+		{
+			if (open.count > 0)
+				m_closed[level].push_back(open);
+
+			open = LogRollup();
+			GetBucket(static_cast<LogRollupLevel>(level), minute.start, open.start, open.end);
+		}
+
+		open.Merge(minute);
+	}
+
+	minute.partial = false;
+	m_closed[LOGROLLUP_MINUTE].push_back(minute);
+	minute = LogRollup();
+}
+
+void CLogRollups::Take(LogRollupBatch& batch)
+{
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		m_taken[level] += m_closed[level].size();
+		batch.closed[level].clear();
+		batch.closed[level].swap(m_closed[level]);
+		batch.open[level] = m_open[level];
+		batch.open[level].partial = true;
+	}
+}
+
+void CLogRollups::Take(LogRollupBatch& batch, const LogRollupMark& mark)
+{
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		const std::size_t count = static_cast<std::size_t>(mark.closed[level] - m_taken[level]);
+		m_taken[level] = mark.closed[level];
+		batch.closed[level].assign(m_closed[level].begin(), m_closed[level].begin() + count);
+		m_closed[level].erase(m_closed[level].begin(), m_closed[level].begin() + count);
+		batch.open[level] = mark.open[level];
+		batch.open[level].partial = true;
+	}
+}
+
+void CLogRollups::GetMark(LogRollupMark& mark) const
+{
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		mark.closed[level] = m_taken[level] + m_closed[level].size();
+		mark.open[level] = m_open[level];
+	}
+}
+
+void CLogRollups::Restore(const LogRollup& rollup, const LogRollupLevel level)
+{
+	if (m_open[level].count == 0)
+	{
+		m_open[level] = rollup;
+		m_open[level].partial = false;
+	}
+}
+
+void CLogRollups::GetBucket(const LogRollupLevel level, const std::int64_t timestamp, std::int64_t& start, std::int64_t& end)
+{
+	if (level == LOGROLLUP_MINUTE || level == LOGROLLUP_HOUR)
+	{
+		const std::int64_t length = (level == LOGROLLUP_MINUTE ? 60 : 3600) * LOGROLLUP_NANOSECONDS_PER_SECOND;
+		start = FloorTo(timestamp, length);
+		end = start + length;
+		return;
+	}
+
+	// Days start at the local midnight and last 23 or 25 hours when daylight saving time changes
+	const std::time_t seconds = static_cast<std::time_t>(FloorTo(timestamp, LOGROLLUP_NANOSECONDS_PER_SECOND) / LOGROLLUP_NANOSECONDS_PER_SECOND);
+	std::tm local;
+
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+
+	local.tm_hour = 0;
+	local.tm_min = 0;
+	local.tm_sec = 0;
+	local.tm_isdst = -1;
+	start = static_cast<std::int64_t>(std::mktime(&local)) * LOGROLLUP_NANOSECONDS_PER_SECOND;
+
+	local.tm_mday += 1;
+	local.tm_hour = 0;
+	local.tm_min = 0;
+	local.tm_sec = 0;
+	local.tm_isdst = -1;
+	end = static_cast<std::int64_t>(std::mktime(&local)) * LOGROLLUP_NANOSECONDS_PER_SECOND;
+
+	// mktime failed or the time zone is odd, fall back to a UTC day
+	if (start > timestamp || end <= timestamp)
+	{
+		const std::int64_t length = 86400 * LOGROLLUP_NANOSECONDS_PER_SECOND;
+		start = FloorTo(timestamp, length);
+		end = start + length;
+	}
+}
+
+CLogRollupWriter::CLogRollupWriter(const std::string& datafile) :
+m_files(),
+m_handles(),
+m_buffer()
+{
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		m_files[level] = CLogFile::GetRollupFileName(datafile, static_cast<LogRollupLevel>(level));
+	}
+}
+
+std::uint64_t CLogRollupWriter::FindEnd(const CLogOutputFile& file)
+{
+	const std::uint64_t size = file.GetSize();
+	std::uint8_t header[LOGROLLUP_HEADER_SIZE];
+	std::uint8_t record[LOGROLLUP_RECORD_SIZE];
+
+	if (size < LOGROLLUP_HEADER_SIZE || !file.Read(header, sizeof(header), 0) || CLogFile::DecodeRollupHeader(header, sizeof(header)) != LOGREAD_OK)
+		return 0;
+
+	// A record cut short by a crash is overwritten
+	const std::uint64_t records = (size - LOGROLLUP_HEADER_SIZE) / LOGROLLUP_RECORD_SIZE;
+	const std::uint64_t end = LOGROLLUP_HEADER_SIZE + records * LOGROLLUP_RECORD_SIZE;
+
+	if (records == 0)
+		return end;
+
+	LogRollup last;
+
+	if (!file.Read(record, sizeof(record), end - LOGROLLUP_RECORD_SIZE))
+		return end;
+
+	CLogFile::DecodeRollup(record, last);
+	return last.partial ? end - LOGROLLUP_RECORD_SIZE : end;
+}
+
+void CLogRollupWriter::Append(const LogRollupBatch& batch)
+{
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		if (batch.closed[level].empty() && batch.open[level].count == 0)
+			continue;
+
+		CLogOutputFile& file = m_handles[level];
+
+		if (!file.Open(m_files[level]))
+			continue;
+
+		const std::uint64_t position = FindEnd(file);
+		m_buffer.clear();
+
+		// Missing or damaged, the rollups start over
+		if (position == 0)
+			CLogFile::EncodeRollupHeader(m_buffer);
+
+		for (const LogRollup& rollup : batch.closed[level])
+		{
+			CLogFile::EncodeRollup(rollup, m_buffer);
+		}
+
+		if (batch.open[level].count > 0)
+			CLogFile::EncodeRollup(batch.open[level], m_buffer);
+
+		// Whatever followed the records, ie: a damaged tail, is dropped
+		if (file.Write(m_buffer.data(), m_buffer.size(), position) && file.GetSize() > position + m_buffer.size())
+			file.Truncate(position + m_buffer.size());
+	}
+}
+
+bool CLogRollupWriter::ReadLast(const std::string& datafile, const LogRollupLevel level, LogRollup& rollup)
+{
+	CLogRollupQuery query;
+
+	if (query.Open(datafile, level) != LOGREAD_OK || query.GetCount() == 0)
+		return false;
+
+	rollup = query.Get(query.GetCount() - 1);
+	return true;
+}
+
+std::uint64_t CLogRollupWriter::Rebuild(const std::string& datafile)
+{
+	CLogRollups rollups;
+	CLogRollupWriter writer(datafile);
+	LogRollupBatch batch;
+	std::uint64_t samples = 0;
+
+	for (int level = 0; level < LOGROLLUP_LEVEL_COUNT; level++)
+	{
+		std::remove(writer.m_files[level].c_str());
+	}
+
+	for (const std::string& segment : CLogSegments::GetSegmentFiles(datafile))
+	{
+		CLogQuery query;
+
+		if (query.Open(segment) != LOGREAD_OK)
+			continue;
+
+		query.Select(std::numeric_limits<std::int64_t>::min(), std::numeric_limits<std::int64_t>::max(),
+			[&](const LogRecord& record)
+			{
+				rollups.Add(record);
+
+				// Written in steps, a year of minutes doesn't have to fit in memory
+				if (++samples % LOGROLLUP_REBUILD_SAMPLES == 0)
+				{
+					rollups.Take(batch);
+					writer.Append(batch);
+				}
+			});
+	}
+
+	rollups.Take(batch);
+	writer.Append(batch);
+	return samples;
+}
+
+CLogRollupQuery::CLogRollupQuery() :
+m_file(),
+m_count(0)
+{
+}
+
+LogReadResult CLogRollupQuery::Open(const std::string& datafile, const LogRollupLevel level)
+{
+	Close();
+
+	if (!m_file.Open(CLogFile::GetRollupFileName(datafile, level)))
+		return LOGREAD_OPEN_FAILED;
+
+	const LogReadResult result = CLogFile::DecodeRollupHeader(m_file.GetData(), m_file.GetSize());
+
+	if (result != LOGREAD_OK)
+	{
+		Close();
+		return result;
+	}
+
+	m_count = (m_file.GetSize() - LOGROLLUP_HEADER_SIZE) / LOGROLLUP_RECORD_SIZE;
+	return LOGREAD_OK;
+}
+
+void CLogRollupQuery::Close()
+{
+	m_file.Close();
+	m_count = 0;
+}
+
+LogRollup CLogRollupQuery::Get(const std::size_t index) const
+{
+	LogRollup rollup;
+	CLogFile::DecodeRollup(m_file.GetData() + LOGROLLUP_HEADER_SIZE + index * LOGROLLUP_RECORD_SIZE, rollup);
+	return rollup;
+}
+
+std::size_t CLogRollupQuery::FindFirst(const std::int64_t from) const
+{
+	std::size_t low = 0;
+	std::size_t high = m_count;
+
+	while (low < high)
+	{
+		const std::size_t middle = low + (high - low) / 2;
+
+		if (Get(middle).end <= from)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return low;
+}
@@ -0,0 +1,152 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGROLLUP_
+#define _H_LOGROLLUP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "logfile.h"
+#include "logindex.h"
+
+// Rollups waiting to be written, handed from a data logger to its writer thread
+struct LogRollupBatch
+{
+	std::vector<LogRollup> closed[LOGROLLUP_LEVEL_COUNT]; // buckets that won't receive more samples, in time order
+	LogRollup open[LOGROLLUP_LEVEL_COUNT]; // buckets still receiving samples, written as partial
+};
+
+// State of the rollups after a given sample, lets a write take the rollups of its own samples only
+struct LogRollupMark
+{
+	std::uint64_t closed[LOGROLLUP_LEVEL_COUNT] = {}; // buckets closed since the start, taken or not
+	LogRollup open[LOGROLLUP_LEVEL_COUNT];
+};
+
+// Keeps the per-minute, per-hour and per-day rollups of a channel up to date one sample at a time.
+// A sample only updates the open minute, a closed minute is merged into the open hour and day.
+// The open hour and day are written without the open minute so a restart doesn't count it twice.
+// Minutes and hours are aligned to UTC, days to the local midnight.
+// A sample older than the open bucket, ie: the clock was set back, is counted in the open bucket.
+class CLogRollups
+{
+public:
+	CLogRollups();
+
+	// Called for every logged sample, inline so the sample stays in registers
+	void Add(const LogRecord& record);
+	/// @brief Moves the closed buckets into batch and copies the open ones
+	void Take(LogRollupBatch& batch);
+	/// @brief Same as Take but stops at the state saved by GetMark, later samples stay for the next batch
+	void Take(LogRollupBatch& batch, const LogRollupMark& mark);
+	/// @brief Saves the state after the last added sample
+	void GetMark(LogRollupMark& mark) const;
+	/// @brief Continues a bucket that was partial when the program stopped
+	void Restore(const LogRollup& rollup, const LogRollupLevel level);
+	/// @brief Bucket of a level that holds timestamp
+	static void GetBucket(const LogRollupLevel level, const std::int64_t timestamp, std::int64_t& start, std::int64_t& end);
+private:
+	// Merges the open minute into the larger buckets
+	void CloseMinute();
+
+	LogRollup m_open[LOGROLLUP_LEVEL_COUNT];
+	std::vector<LogRollup> m_closed[LOGROLLUP_LEVEL_COUNT];
+	std::uint64_t m_taken[LOGROLLUP_LEVEL_COUNT]; // closed buckets already moved into a batch
+};
+
+inline void CLogRollups::Add(const LogRecord& record)
+{
+	LogRollup& minute = m_open[LOGROLLUP_MINUTE];
+
+	if (record.timestamp >= minute.end)
+	{
+		CloseMinute();
+		GetBucket(LOGROLLUP_MINUTE, record.timestamp, minute.start, minute.end);
+	}
+
+	minute.Add(record);
+}
+
+// Appends rollups to the rollup files of a log file, the partial record at the end of a file is replaced.
+// The files are kept open between writes.
+class CLogRollupWriter
+{
+public:
+	CLogRollupWriter(const std::string& datafile);
+
+	void Append(const LogRollupBatch& batch);
+	/// @brief Last record of a rollup file
+	static bool ReadLast(const std::string& datafile, const LogRollupLevel level, LogRollup& rollup);
+	/// @brief Builds the rollup files of a log file from its samples and the ones of its rotated segments
+	/// @return Samples read
+	static std::uint64_t Rebuild(const std::string& datafile);
+private:
+	// Where the next record goes, 0 if the file must be started over
+	static std::uint64_t FindEnd(const CLogOutputFile& file);
+
+	std::string m_files[LOGROLLUP_LEVEL_COUNT];
+	CLogOutputFile m_handles[LOGROLLUP_LEVEL_COUNT];
+	std::vector<std::uint8_t> m_buffer;
+};
+
+// Time range queries over a memory mapped rollup file
+class CLogRollupQuery
+{
+public:
+	CLogRollupQuery();
+
+	LogReadResult Open(const std::string& datafile, const LogRollupLevel level);
+	void Close();
+
+	/// @brief Calls onrollup with every bucket that overlaps from <= timestamp <= to, in time order
+	/// @return Number of buckets found
+	template <typename Callback>
+	std::size_t Select(const std::int64_t from, const std::int64_t to, Callback&& onrollup) const;
+
+	std::size_t GetCount() const { return m_count; }
+	LogRollup Get(const std::size_t index) const;
+	/// @brief First bucket that ends after from
+	std::size_t FindFirst(const std::int64_t from) const;
+private:
+	CMappedFile m_file;
+	std::size_t m_count;
+};
+
+template <typename Callback>
+inline std::size_t CLogRollupQuery::Select(const std::int64_t from, const std::int64_t to, Callback&& onrollup) const
+{
+	std::size_t found = 0;
+
+	for (std::size_t i = FindFirst(from); i < m_count; i++)
+	{
+		const LogRollup rollup = Get(i);
+
+		if (rollup.start > to)
+			break;
+
+		onrollup(rollup);
+		found++;
+	}
+
+	return found;
+}
+
+#endif
@@ -0,0 +1,519 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logsegment.h"
+#include "logindex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <sys/stat.h>
+
+#define LOGSEGMENT_NANOSECONDS_PER_DAY (86400LL * 1000000000LL)
+
+// Splits log_humidity.dat into the directory prefix, including its separator, and log_humidity
+static void SplitName(const std::string& datafile, std::string& directory, std::string& base)
+{
+	const std::size_t separator = datafile.find_last_of("/\\");
+	directory = separator == std::string::npos ? std::string() : datafile.substr(0, separator + 1);
+	base = datafile.substr(directory.size());
+
+	const std::size_t size = sizeof(LOGFILE_EXTENSION) - 1;
+
+	if (base.size() >= size && base.compare(base.size() - size, size, LOGFILE_EXTENSION) == 0)
+		base.resize(base.size() - size);
+}
+
+// Splits log_humidity.20231017T000000_02.dat into its rotation time and its number within that second
+static bool ParseSegmentName(const std::string& name, const std::string& prefix, std::string& stamp, unsigned int& sequence)
+{
+	const std::size_t size = sizeof(LOGFILE_EXTENSION) - 1;
+
+	if (name.size() <= prefix.size() + size || name.compare(0, prefix.size(), prefix) != 0 || name.compare(name.size() - size, size, LOGFILE_EXTENSION) != 0)
+		return false;
+
+	stamp = name.substr(prefix.size(), name.size() - prefix.size() - size);
+	sequence = 0;
+
+	const std::size_t separator = stamp.find('_');
+
+	if (separator != std::string::npos)
+	{
+		if (separator + 1 == stamp.size() || stamp.size() - separator > 10 || stamp.find_first_not_of("0123456789", separator + 1) != std::string::npos)
+			return false;
+
+		sequence = static_cast<unsigned int>(std::stoul(stamp.substr(separator + 1)));
+		stamp.resize(separator);
+	}
+
+	// Local time as YYYYMMDDTHHMMSS
+	return stamp.size() == 15 && stamp[8] == 'T' && stamp.find_first_not_of("0123456789", 0) == 8 && stamp.find_first_not_of("0123456789", 9) == std::string::npos;
+}
+
+// Days since an arbitrary point in local time, only compared for equality
+static int GetLocalDay(const std::time_t seconds)
+{
+	std::tm local;
+
+#ifdef _WIN32
+	localtime_s(&local, &seconds);
+#else
+	localtime_r(&seconds, &local);
+#endif
+
+	return local.tm_year * 366 + local.tm_yday;
+}
+
+std::vector<std::string> CLogSegments::GetRotatedFiles(const std::string& datafile)
+{
+	struct Segment
+	{
+		std::string name;
+		std::string stamp;
+		unsigned int sequence;
+	};
+
+	std::string directory;
+	std::string base;
+	std::vector<Segment> segments;
+	std::vector<std::string> names;
+	std::error_code error;
+
+	SplitName(datafile, directory, base);
+
+	for (std::filesystem::directory_iterator it(directory.empty() ? "." : directory, error), end; !error && it != end; it.increment(error))
+	{
+		Segment segment;
+		segment.name = it->path().filename().string();
+
+		if (ParseSegmentName(segment.name, base + ".", segment.stamp, segment.sequence))
+			segments.push_back(segment);
+	}
+
+	std::sort(segments.begin(), segments.end(),
+		[](const Segment& a, const Segment& b)
+		{
+			return a.stamp != b.stamp ? a.stamp < b.stamp : a.sequence < b.sequence;
+		});
+
+	for (const Segment& segment : segments)
+	{
+		names.push_back(directory + segment.name);
+	}
+
+	return names;
+}
+
+std::vector<std::string> CLogSegments::GetSegmentFiles(const std::string& datafile)
+{
+	std::vector<std::string> segments = GetRotatedFiles(datafile);
+	struct stat info;
+
+	if (stat(datafile.c_str(), &info) == 0)
+		segments.push_back(datafile);
+
+	return segments;
+}
+
+std::string CLogSegments::Rotate(const std::string& datafile)
+{
+	std::string directory;
+	std::string base;
+	struct stat info;
+
+	SplitName(datafile, directory, base);
+
+	const std::time_t now = std::time(nullptr);
+	std::tm local;
+
+#ifdef _WIN32
+	localtime_s(&local, &now);
+#else
+	localtime_r(&now, &local);
+#endif
+
+	char buffer[32];
+	std::strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%S", &local);
+
+	// A new segment is always named after the newest one, even when the clock went back
+	// or a segment with the same name was merged or removed in the meantime
+	const std::vector<std::string> segments = GetRotatedFiles(datafile);
+	std::string stamp = buffer;
+	unsigned int sequence = 0;
+
+	if (!segments.empty())
+	{
+		std::string laststamp;
+		unsigned int lastsequence = 0;
+		ParseSegmentName(segments.back().substr(directory.size()), base + ".", laststamp, lastsequence);
+
+		if (stamp <= laststamp)
+		{
+			stamp = laststamp;
+			sequence = lastsequence + 1;
+		}
+	}
+
+	if (sequence > 0)
+	{
+		std::snprintf(buffer, sizeof(buffer), "_%02u", sequence);
+		stamp += buffer;
+	}
+
+	const std::string segment = directory + base + "." + stamp + LOGFILE_EXTENSION;
+
+	if (stat(segment.c_str(), &info) == 0)
+		return std::string();
+
+	// The index goes first, the segment only shows up in a listing once it is complete
+	std::rename(CLogFile::GetIndexFileName(datafile).c_str(), CLogFile::GetIndexFileName(segment).c_str());
+
+	if (std::rename(datafile.c_str(), segment.c_str()) != 0)
+	{
+		std::rename(CLogFile::GetIndexFileName(segment).c_str(), CLogFile::GetIndexFileName(datafile).c_str());
+		return std::string();
+	}
+
+	return segment;
+}
+
+bool CLogSegments::IsRotationDue(const std::string& datafile, const LogRetentionPolicy& policy, const std::int64_t timestamp)
+{
+	struct stat info;
+
+	// Missing or without samples
+	if (stat(datafile.c_str(), &info) != 0 || static_cast<std::uint64_t>(info.st_size) <= LOGFILE_HEADER_SIZE)
+		return false;
+
+	if (policy.rotatebytes > 0 && static_cast<std::uint64_t>(info.st_size) >= policy.rotatebytes)
+		return true;
+
+	// The last write was on another day
+	return policy.rotatedaily && GetLocalDay(info.st_mtime) != GetLocalDay(static_cast<std::time_t>(timestamp / 1000000000));
+}
+
+void CLogSegments::Remove(const std::string& datafile)
+{
+	std::remove(CLogFile::GetIndexFileName(datafile).c_str());
+	std::remove(datafile.c_str());
+}
+
+CLogCompactor::CLogCompactor(const std::string& datafile, const LogRetentionPolicy& policy, const LogChunkEncoding encoding) :
+m_datafile(datafile),
+m_policy(policy),
+m_encoding(encoding),
+m_mutex(),
+m_condition(),
+m_wake(false),
+m_stop(false),
+m_thread(nullptr)
+{
+}
+
+CLogCompactor::~CLogCompactor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_condition.notify_all();
+
+	if (m_thread != nullptr)
+	{
+		if (m_thread->joinable())
+			m_thread->join();
+
+		delete m_thread;
+		m_thread = nullptr;
+	}
+}
+
+void CLogCompactor::Wake()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_wake = true;
+
+	if (m_thread == nullptr)
+		m_thread = new std::thread(&CLogCompactor::Run, this);
+	else
+		m_condition.notify_all();
+}
+
+void CLogCompactor::Run()
+{
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait_for(lock, std::chrono::seconds(LOGSEGMENT_COMPACT_INTERVAL_S), [this] { return m_stop || m_wake; });
+
+			if (m_stop)
+				return;
+
+			m_wake = false;
+		}
+
+		const auto now = std::chrono::system_clock::now().time_since_epoch();
+		Compact(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+	}
+}
+
+void CLogCompactor::Compact(const std::int64_t now)
+{
+	struct Segment
+	{
+		std::string name;
+		std::uint64_t size = 0;
+		std::int64_t newest = 0;
+		bool raw = false; // has chunks that are not compressed
+	};
+
+	std::string directory;
+	std::string base;
+	std::vector<Segment> segments;
+
+	SplitName(m_datafile, directory, base);
+
+	// Left behind by a compaction that was stopped
+	CLogSegments::Remove(directory + base + "." + LOGSEGMENT_TEMP_NAME + LOGFILE_EXTENSION);
+
+	for (const std::string& name : CLogSegments::GetRotatedFiles(m_datafile))
+	{
+		CLogQuery query;
+		Segment segment;
+
+		if (query.Open(name) != LOGREAD_OK)
+			continue;
+
+		segment.name = name;
+		segment.newest = std::numeric_limits<std::int64_t>::min();
+
+		for (std::size_t i = 0; i < query.GetChunkCount(); i++)
+		{
+			const LogIndexEntry entry = query.GetEntry(i);
+			LogChunkHeader header;
+
+			segment.size = entry.GetEnd();
+			segment.newest = std::max(segment.newest, entry.maxtime);
+
+			if (query.ReadChunkHeader(entry, header) == LOGREAD_OK && header.encoding == LOGCHUNK_ENCODING_RAW)
+				segment.raw = true;
+		}
+
+		// Without samples, it can only have been left behind by a rotation
+		if (query.GetChunkCount() == 0)
+		{
+			query.Close();
+			CLogSegments::Remove(name);
+			continue;
+		}
+
+		if (m_policy.keepdays > 0 && segment.newest < now - static_cast<std::int64_t>(m_policy.keepdays) * LOGSEGMENT_NANOSECONDS_PER_DAY)
+		{
+			std::cout << "[THREADED] Removing expired log segment " << name << std::endl;
+			query.Close();
+			CLogSegments::Remove(name);
+			continue;
+		}
+
+		segments.push_back(segment);
+	}
+
+	const std::int64_t rawlimit = now - static_cast<std::int64_t>(m_policy.keeprawdays) * LOGSEGMENT_NANOSECONDS_PER_DAY;
+	const std::uint64_t small = m_policy.compactbytes / LOGSEGMENT_SMALL_FRACTION;
+	std::size_t first = 0;
+
+	while (first < segments.size() && !m_stop)
+	{
+		// Runs of small segments are merged up to the compaction size, larger segments stand alone
+		std::size_t last = first + 1;
+		std::uint64_t total = segments[first].size;
+
+		if (segments[first].size < small)
+		{
+			while (last < segments.size() && segments[last].size < small && total + segments[last].size <= m_policy.compactbytes)
+			{
+				total += segments[last].size;
+				last++;
+			}
+		}
+
+		bool old = m_policy.keeprawdays > 0;
+		bool raw = false;
+		std::vector<std::string> names;
+
+		for (std::size_t i = first; i < last; i++)
+		{
+			old = old && segments[i].newest < rawlimit;
+			raw = raw || segments[i].raw;
+			names.push_back(segments[i].name);
+		}
+
+		if (names.size() > 1 || (old && raw))
+			Merge(names, old ? LOGCHUNK_ENCODING_GORILLA : m_encoding);
+
+		first = last;
+	}
+}
+
+bool CLogCompactor::Merge(const std::vector<std::string>& segments, const LogChunkEncoding encoding)
+{
+	std::string directory;
+	std::string base;
+
+	SplitName(m_datafile, directory, base);
+
+	const std::string tempfile = directory + base + "." + LOGSEGMENT_TEMP_NAME + LOGFILE_EXTENSION;
+	const std::string& target = segments.back();
+	std::unique_ptr<LogChunk> input = std::make_unique<LogChunk>();
+	std::unique_ptr<LogChunk> output = std::make_unique<LogChunk>();
+	std::vector<std::uint8_t> buffer;
+	std::vector<LogIndexEntry> entries;
+	std::uint64_t offset = 0;
+	std::uint64_t before = 0;
+	bool written = true;
+	CLogOutputFile file;
+
+	if (!file.Open(tempfile) || !file.Truncate(0))
+	{
+		std::cout << "[THREADED] Failed to write log file " << tempfile << std::endl;
+		file.Close();
+		CLogSegments::Remove(tempfile);
+		return false;
+	}
+
+	CLogFile::EncodeFileHeader(buffer);
+
+	// Samples are packed into full chunks, the partial chunks of forced writes disappear
+	const auto writechunk = [&]()
+	{
+		LogIndexEntry entry;
+		CLogFile::EncodeChunk(*output, buffer, &entry, encoding);
+		entry.offset += offset;
+		entries.push_back(entry);
+		output->count = 0;
+	};
+
+	for (const std::string& segment : segments)
+	{
+		CLogQuery query;
+
+		if (query.Open(segment) != LOGREAD_OK)
+		{
+			file.Close();
+			CLogSegments::Remove(tempfile);
+			return false;
+		}
+
+		before += query.GetChunkCount() > 0 ? query.GetEntry(query.GetChunkCount() - 1).GetEnd() : 0;
+
+		for (std::size_t i = 0; i < query.GetChunkCount(); i++)
+		{
+			// A damaged chunk can't be carried over, the segments are left as they are
+			if (m_stop || query.ReadChunk(query.GetEntry(i), *input) != LOGREAD_OK)
+			{
+				if (!m_stop)
+					std::cout << "[THREADED] Not compacting log segment " << segment << ", it has damaged chunks" << std::endl;
+
+				file.Close();
+				CLogSegments::Remove(tempfile);
+				return false;
+			}
+
+			for (std::size_t j = 0; j < input->count; j++)
+			{
+				const std::size_t index = output->count++;
+				output->timestamp[index] = input->timestamp[j];
+				output->setpoint[index] = input->setpoint[j];
+				output->sensor[index] = input->sensor[j];
+				output->pwm[index] = input->pwm[j];
+
+				if (output->IsFull())
+					writechunk();
+			}
+
+			// Keep the buffer small, a segment can be larger than the memory
+			if (!buffer.empty())
+			{
+				written = file.Write(buffer.data(), buffer.size(), offset) && written;
+				offset += buffer.size();
+				buffer.clear();
+			}
+		}
+	}
+
+	if (output->count > 0)
+		writechunk();
+
+	written = file.Write(buffer.data(), buffer.size(), offset) && written;
+	offset += buffer.size();
+
+	// The merged segment and its index must be on the disk before they take the place of the old segments,
+	// a power loss after the rename would otherwise leave an empty segment where the samples were
+	written = written && file.Sync();
+	file.Close();
+
+	CLogIndexWriter index(tempfile);
+
+	if (written)
+	{
+		index.Append(entries);
+		written = index.Sync();
+	}
+
+	if (!written)
+	{
+		std::cout << "[THREADED] Failed to write log file " << tempfile << std::endl;
+		CLogSegments::Remove(tempfile);
+		return false;
+	}
+
+	// The merged segment replaces the newest one before the others are removed,
+	// stopping in between leaves samples twice instead of losing them.
+	// Without its index for a moment, a reader scans the segment instead.
+	std::remove(CLogFile::GetIndexFileName(target).c_str());
+
+	if (std::rename(tempfile.c_str(), target.c_str()) != 0)
+	{
+		std::cout << "[THREADED] Failed to replace log segment " << target << std::endl;
+		CLogSegments::Remove(tempfile);
+		return false;
+	}
+
+	std::rename(CLogFile::GetIndexFileName(tempfile).c_str(), CLogFile::GetIndexFileName(target).c_str());
+
+	// The renames must be on the disk too before the old segments go away
+	if (!CLogOutputFile::SyncDirectory(target))
+	{
+		std::cout << "[THREADED] Failed to sync the directory of log segment " << target << ", keeping the merged segments" << std::endl;
+		return false;
+	}
+
+	for (std::size_t i = 0; i + 1 < segments.size(); i++)
+	{
+		CLogSegments::Remove(segments[i]);
+	}
+
+	std::cout << "[THREADED] Compacted " << segments.size() << (segments.size() == 1 ? " log segment" : " log segments") << " into " << target << ", " << before << " -> " << offset << " bytes" << std::endl;
+	return true;
+}
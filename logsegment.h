@@ -0,0 +1,102 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_LOGSEGMENT_
+#define _H_LOGSEGMENT_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logfile.h"
+
+#define LOGSEGMENT_DEFAULT_ROTATE_BYTES 67108864 // 64 MiB
+#define LOGSEGMENT_DEFAULT_COMPACT_BYTES 67108864
+#define LOGSEGMENT_DEFAULT_KEEP_RAW_DAYS 30
+#define LOGSEGMENT_SMALL_FRACTION 4 // segments below a quarter of the compaction size are merged with their neighbours
+#define LOGSEGMENT_COMPACT_INTERVAL_S 3600 // how often the retention rules are checked when nothing rotates
+#define LOGSEGMENT_TEMP_NAME "compacting" // segment being written by the compactor, ie: log_humidity.compacting.dat
+
+// When the log file of a channel is rotated and how long the rotated segments are kept, 0 disables a rule
+struct LogRetentionPolicy
+{
+	std::uint64_t rotatebytes = LOGSEGMENT_DEFAULT_ROTATE_BYTES; // the log file is rotated once it is this large
+	bool rotatedaily = true; // the log file is rotated when the local date changes
+	std::uint64_t compactbytes = LOGSEGMENT_DEFAULT_COMPACT_BYTES; // small segments are merged up to this size
+	unsigned int keeprawdays = LOGSEGMENT_DEFAULT_KEEP_RAW_DAYS; // older segments are compressed with LOGCHUNK_ENCODING_GORILLA
+	unsigned int keepdays = 0; // older segments are deleted
+};
+
+// Rotated log files.
+// The log file of a channel is renamed to a segment named after the local time of the rotation,
+// ie: log_humidity.dat becomes log_humidity.20231017T000000.dat, together with its index file.
+// Later rotations in the same second add a number, ie: log_humidity.20231017T000000_01.dat.
+// Segments are listed in time order, the log file itself holds the newest samples.
+class CLogSegments
+{
+public:
+	/// @brief Rotated segments of a log file in time order, followed by the log file itself if it exists
+	static std::vector<std::string> GetSegmentFiles(const std::string& datafile);
+	/// @brief Rotated segments of a log file in time order
+	static std::vector<std::string> GetRotatedFiles(const std::string& datafile);
+	/// @brief Renames the log file and its index to a new segment
+	/// @return Segment name, empty if the rename failed
+	static std::string Rotate(const std::string& datafile);
+	/// @brief Rotation is due before samples starting at timestamp are appended to the log file
+	static bool IsRotationDue(const std::string& datafile, const LogRetentionPolicy& policy, const std::int64_t timestamp);
+	/// @brief Removes a segment and its index
+	static void Remove(const std::string& datafile);
+};
+
+// Background thread that applies the retention rules to the rotated segments of a log file.
+// Small segments are merged into larger ones with full chunks, segments older than keeprawdays are
+// compressed and segments older than keepdays are deleted. The log file itself is never touched,
+// so the writer thread keeps appending to it during a compaction.
+class CLogCompactor
+{
+public:
+	CLogCompactor(const std::string& datafile, const LogRetentionPolicy& policy, const LogChunkEncoding encoding);
+	~CLogCompactor();
+	CLogCompactor(const CLogCompactor&) = delete;
+	CLogCompactor& operator=(const CLogCompactor&) = delete;
+
+	/// @brief Starts the thread if needed and asks for a pass, ie: after a rotation
+	void Wake();
+	/// @brief Applies the retention rules once on the calling thread
+	/// @param now Wall clock in nanoseconds since the Unix epoch
+	void Compact(const std::int64_t now);
+private:
+	void Run();
+	// Writes the samples of several segments into the last one
+	bool Merge(const std::vector<std::string>& segments, const LogChunkEncoding encoding);
+
+	std::string m_datafile;
+	LogRetentionPolicy m_policy;
+	LogChunkEncoding m_encoding; // encoding of merged segments that are still kept raw
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_wake;
+	std::atomic<bool> m_stop; // checked between chunks, a merge in progress is abandoned
+	std::thread* m_thread;
+};
+
+#endif
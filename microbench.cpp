@@ -0,0 +1,372 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Microbenchmarks of the protocol codec and log formatting hot paths.
+// Reports frames per second and heap allocations per frame on realistic and malformed input.
+// Usage: microbench [seconds per benchmark]
+
+#include "framedecoder.h"
+#include "protocol.h"
+#include "logger.h"
+#include "logfile.h"
+#include "serialmanager.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MICROBENCH_CORPUS_FRAMES 4096
+#define MICROBENCH_CHUNK_SIZE 64 // bytes handed to the decoders at once, like a serial read
+#define MICROBENCH_DEFAULT_SECONDS 0.5
+#define MICROBENCH_SERIES_CHUNKS 16 // logged samples for the log file benchmarks, about 2 hours at 10 Hz
+
+// Every heap allocation made by the process is counted
+static std::atomic<std::uint64_t> s_allocations(0);
+
+void* operator new(std::size_t size)
+{
+	s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size == 0 ? 1 : size))
+		return memory;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+static volatile std::uint64_t s_sink = 0; // keeps the compiler from removing the work
+
+// Runs a benchmark pass repeatedly until the time is up, each pass processes frames frames
+template <typename Pass>
+static void RunBenchmark(const char* name, const std::size_t frames, const double seconds, Pass&& pass)
+{
+	using clock = std::chrono::steady_clock;
+
+	pass(); // warm up caches and reserve any buffers
+
+	std::uint64_t passes = 0;
+	const std::uint64_t allocations = s_allocations.load(std::memory_order_relaxed);
+	const clock::time_point start = clock::now();
+	double elapsed = 0.0;
+
+	do
+	{
+		pass();
+		passes++;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	}
+	while (elapsed < seconds);
+
+	const double total = static_cast<double>(passes * frames);
+	const double allocated = static_cast<double>(s_allocations.load(std::memory_order_relaxed) - allocations);
+	printf("%-40s %14.0f %10.1f %12.2f\n", name, total / elapsed, elapsed * 1e9 / total, allocated / total);
+}
+
+static std::string FormatFrame(const SerialSample& sample)
+{
+	static const char* const prefixes[SETPOINT_TYPE_COUNT] = { "", "sdt", "sdl", "sdh" };
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%s_%.2f_%.2f_%.2f?\r\n", prefixes[sample.type], sample.setpoint, sample.sensor, sample.pwm);
+	return std::string(buffer);
+}
+
+static std::vector<SerialSample> MakeSamples(std::mt19937& random)
+{
+	std::uniform_real_distribution<float> value(0.0f, 100.0f);
+	std::uniform_real_distribution<float> pwm(0.0f, 255.0f);
+	std::vector<SerialSample> samples;
+
+	for (int i = 0; i < MICROBENCH_CORPUS_FRAMES; i++)
+	{
+		SerialSample sample;
+		sample.type = static_cast<SetpointType>(SETPOINT_TEMPERATURE + i % (SETPOINT_TYPE_COUNT - 1));
+		sample.setpoint = value(random);
+		sample.sensor = value(random);
+		sample.pwm = pwm(random);
+		sample.time = SampleTime::Now();
+		samples.push_back(sample);
+	}
+
+	return samples;
+}
+
+// One channel sampled every 100 ms as the logger stores it: arrival jitter, a setpoint that
+// rarely changes, a slowly drifting sensor with two decimals and a pwm output that steps now and then
+static std::vector<std::unique_ptr<LogChunk>> MakeSeries(std::mt19937& random)
+{
+	std::uniform_int_distribution<std::int64_t> jitter(-300000, 300000);
+	std::uniform_int_distribution<int> drift(-1, 1);
+	std::uniform_int_distribution<int> change(0, 999);
+	std::uniform_int_distribution<int> pwm(0, 255);
+	std::vector<std::unique_ptr<LogChunk>> series;
+	std::int64_t timestamp = SampleTime::Now().wallclock;
+	float setpoint = 24.0f;
+	int sensor = 2000; // hundredths
+	float output = 128.0f;
+
+	for (int c = 0; c < MICROBENCH_SERIES_CHUNKS; c++)
+	{
+		series.push_back(std::make_unique<LogChunk>());
+		LogChunk& chunk = *series.back();
+
+		for (std::size_t i = 0; i < LOGFILE_CHUNK_SAMPLES; i++)
+		{
+			timestamp += 100000000;
+			sensor += drift(random);
+
+			if (change(random) == 0)
+				setpoint = static_cast<float>(18 + change(random) % 12);
+
+			if (change(random) < 50)
+				output = static_cast<float>(pwm(random));
+
+			chunk.timestamp[i] = timestamp + jitter(random);
+			chunk.setpoint[i] = setpoint;
+			chunk.sensor[i] = static_cast<float>(sensor) / 100.0f;
+			chunk.pwm[i] = output;
+		}
+
+		chunk.count = LOGFILE_CHUNK_SAMPLES;
+	}
+
+	return series;
+}
+
+// Half of the frames are damaged in ways seen on real serial lines
+static std::string Damage(const std::string& frame, std::mt19937& random)
+{
+	std::uniform_int_distribution<int> kind(0, 7);
+	std::uniform_int_distribution<std::size_t> position(1, frame.size() - 4);
+	std::string damaged = frame;
+
+	switch (kind(random))
+	{
+	case 0: // truncated, the next frame starts in the middle
+		return frame.substr(0, position(random));
+	case 1: // line noise
+		damaged.insert(position(random), "\xFF\x13");
+		return damaged;
+	case 2: // bad number
+		damaged[position(random)] = 'x';
+		return damaged;
+	case 3: // unknown type
+		damaged[2] = 'q';
+		return damaged;
+	default:
+		return damaged;
+	}
+}
+
+static void FeedChunks(const std::string& stream, CFrameDecoder& decoder, std::uint64_t& frames)
+{
+	for (std::size_t offset = 0; offset < stream.size(); offset += MICROBENCH_CHUNK_SIZE)
+	{
+		const std::size_t size = std::min<std::size_t>(MICROBENCH_CHUNK_SIZE, stream.size() - offset);
+		decoder.Feed(stream.data() + offset, size, [&frames](std::string_view frame) { frames += frame.size(); });
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const double seconds = argc > 1 ? atof(argv[1]) : MICROBENCH_DEFAULT_SECONDS;
+
+	if (seconds <= 0.0)
+	{
+		printf("Usage: %s [seconds per benchmark]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 random(1234);
+	const std::vector<SerialSample> samples = MakeSamples(random);
+
+	// Corpora: the ASCII stream, the frames without markers as Parse gets them, and the binary stream
+	std::string stream;
+	std::string malformedstream;
+	std::vector<std::string> commands;
+	std::vector<std::string> malformedcommands;
+	std::string binarystream;
+	std::string corruptbinarystream;
+
+	for (const SerialSample& sample : samples)
+	{
+		const std::string frame = FormatFrame(sample);
+		const std::string damaged = Damage(frame, random);
+		stream += frame;
+		malformedstream += damaged;
+		commands.push_back(frame.substr(0, frame.find('?')));
+		malformedcommands.push_back(damaged.substr(0, damaged.find('?')));
+
+		std::string binary = CBinaryProtocol::EncodeTelemetry(sample);
+		binarystream += binary;
+
+		if (random() % 4 == 0)
+			binary[1 + random() % (binary.size() - 2)] ^= 0x10;
+
+		corruptbinarystream += binary;
+	}
+
+	const std::size_t frames = samples.size();
+	printf("%-40s %14s %10s %12s\n", "benchmark", "frames/s", "ns/frame", "allocs/frame");
+
+	CFrameDecoder decoder;
+	RunBenchmark("CFrameDecoder::Feed", frames, seconds, [&]() {
+		std::uint64_t bytes = 0;
+		FeedChunks(stream, decoder, bytes);
+		s_sink = s_sink + bytes;
+	});
+
+	RunBenchmark("CFrameDecoder::Feed (malformed)", frames, seconds, [&]() {
+		std::uint64_t bytes = 0;
+		FeedChunks(malformedstream, decoder, bytes);
+		s_sink = s_sink + bytes;
+	});
+
+	RunBenchmark("CSerialCommand::Parse", frames, seconds, [&]() {
+		SerialSample sample;
+
+		for (const std::string& command : commands)
+			s_sink = s_sink + CSerialCommand::Parse(command, sample);
+	});
+
+	RunBenchmark("CSerialCommand::Parse (malformed)", frames, seconds, [&]() {
+		SerialSample sample;
+
+		for (const std::string& command : malformedcommands)
+			s_sink = s_sink + CSerialCommand::Parse(command, sample);
+	});
+
+	CBinaryFrameDecoder binarydecoder;
+	auto feedbinary = [&binarydecoder](const std::string& data) {
+		SerialSample sample;
+
+		for (std::size_t offset = 0; offset < data.size(); offset += MICROBENCH_CHUNK_SIZE)
+		{
+			const std::size_t size = std::min<std::size_t>(MICROBENCH_CHUNK_SIZE, data.size() - offset);
+			binarydecoder.Feed(data.data() + offset, size, [&sample](const std::uint8_t* payload, std::size_t length) {
+				s_sink = s_sink + CBinaryProtocol::ParseTelemetry(payload, length, sample);
+			});
+		}
+	};
+
+	RunBenchmark("CBinaryFrameDecoder + ParseTelemetry", frames, seconds, [&]() { feedbinary(binarystream); });
+	RunBenchmark("CBinaryFrameDecoder (corrupted)", frames, seconds, [&]() { feedbinary(corruptbinarystream); });
+
+	RunBenchmark("CSerialManager::FormatSetpointCommand", frames, seconds, [&]() {
+		for (const SerialSample& sample : samples)
+			s_sink = s_sink + CSerialManager::FormatSetpointCommand(sample.type, sample.setpoint).size();
+	});
+
+	RunBenchmark("CBinaryProtocol::EncodeSetpoint", frames, seconds, [&]() {
+		for (const SerialSample& sample : samples)
+			s_sink = s_sink + CBinaryProtocol::EncodeSetpoint(sample.type, sample.setpoint).size();
+	});
+
+	std::vector<LogRecord> records;
+
+	for (const SerialSample& sample : samples)
+	{
+		records.push_back({ sample.time.wallclock, sample.setpoint, sample.sensor, sample.pwm });
+	}
+
+	RunBenchmark("CLogFile::FormatLine", frames, seconds, [&]() {
+		for (const LogRecord& record : records)
+			s_sink = s_sink + CLogFile::FormatLine(record).size();
+	});
+
+	const std::vector<std::unique_ptr<LogChunk>> series = MakeSeries(random);
+	const std::size_t seriessamples = series.size() * LOGFILE_CHUNK_SAMPLES;
+	const LogChunkEncoding encodings[2] = { LOGCHUNK_ENCODING_RAW, LOGCHUNK_ENCODING_GORILLA };
+	std::unique_ptr<LogChunk> decoded = std::make_unique<LogChunk>();
+	std::vector<std::uint8_t> encoded;
+
+	for (const LogChunkEncoding encoding : encodings)
+	{
+		const std::string suffix = std::string(" (") + CLogFile::GetEncodingName(encoding) + ")";
+
+		RunBenchmark(("CLogFile::EncodeChunk" + suffix).c_str(), seriessamples, seconds, [&]() {
+			encoded.clear();
+
+			for (const std::unique_ptr<LogChunk>& chunk : series)
+				CLogFile::EncodeChunk(*chunk, encoded, nullptr, encoding);
+
+			s_sink = s_sink + encoded.size();
+		});
+
+		RunBenchmark(("CLogFile::DecodeChunk" + suffix).c_str(), seriessamples, seconds, [&]() {
+			std::size_t offset = 0;
+			LogChunkHeader header;
+
+			while (offset < encoded.size() && CLogFile::DecodeChunkHeader(&encoded[offset], header) == LOGREAD_OK)
+			{
+				CLogFile::DecodeChunk(&encoded[offset], header, *decoded);
+				offset += LOGFILE_CHUNK_HEADER_SIZE + header.size;
+				s_sink = s_sink + decoded->count;
+			}
+		});
+
+		printf("%-40s %14.2f bytes/sample with chunk headers\n", ("  log file size" + suffix).c_str(), static_cast<double>(encoded.size()) / static_cast<double>(seriessamples));
+	}
+
+	// Each pass uses a new logger so the stored data doesn't grow without limit.
+	// The samples are discarded, a logger writes what it holds when it is destroyed and the disk isn't measured here.
+	LogFlushPolicy noflush;
+	noflush.samples = 0;
+	noflush.bytes = 0;
+	noflush.interval = 0;
+	noflush.journal = 0;
+
+	RunBenchmark("CDataLogger::Log", frames, seconds, [&]() {
+		CDataLogger logger("microbench", noflush);
+
+		for (const SerialSample& sample : samples)
+			logger.Log(sample.time, sample.setpoint, sample.sensor, sample.pwm);
+
+		logger.Discard();
+	});
+
+	return EXIT_SUCCESS;
+}
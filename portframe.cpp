@@ -0,0 +1,73 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "portframe.h"
+#include "app.h"
+
+CPortFrame::CPortFrame(MainWindow* window, const std::size_t port) :
+m_grid(),
+m_subbox(),
+m_dataframe_temp("Temperatura"),
+m_dataframe_led("LED"),
+m_dataframe_humid("Humidade"),
+m_controlframe()
+{
+	m_grid.attach(m_controlframe, 0, 0);
+	m_grid.attach(m_subbox, 1, 0);
+	m_grid.set_expand(true);
+
+	m_subbox.set_margin(5);
+	m_subbox.set_spacing(3);
+	m_subbox.set_vexpand(true);
+	m_subbox.set_valign(Gtk::Align::FILL);
+	m_subbox.set_orientation(Gtk::Orientation::VERTICAL);
+
+	m_subbox.append(m_dataframe_temp);
+	m_dataframe_temp.set_expand(true);
+	m_subbox.append(m_dataframe_led);
+	m_dataframe_led.set_expand(true);
+	m_subbox.append(m_dataframe_humid);
+	m_dataframe_humid.set_expand(true);
+
+	m_controlframe.SetParentWindow(window);
+	m_controlframe.SetPort(port);
+
+	append(m_grid);
+}
+
+CPortFrame::~CPortFrame()
+{
+}
+
+void CPortFrame::OnReceiveSample(const SerialSample& sample)
+{
+	switch (sample.type)
+	{
+	case SETPOINT_TEMPERATURE:
+		m_dataframe_temp.SetValues(sample.setpoint, sample.sensor, sample.pwm, sample.time);
+		break;
+	case SETPOINT_LED:
+		m_dataframe_led.SetValues(sample.setpoint, sample.sensor, sample.pwm, sample.time);
+		break;
+	case SETPOINT_HUMIDITY:
+		m_dataframe_humid.SetValues(sample.setpoint, sample.sensor, sample.pwm, sample.time);
+		break;
+	default:
+		break;
+	}
+}
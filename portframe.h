@@ -0,0 +1,47 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_PORT_FRAME_
+#define _H_PORT_FRAME_
+
+#include <gtkmm.h>
+#include <cstddef>
+#include "dataframe.h"
+#include "controlframe.h"
+
+class MainWindow;
+
+// Controls and data of a single serial port
+class CPortFrame : public Gtk::Box
+{
+public:
+	CPortFrame(MainWindow* window, const std::size_t port);
+	virtual ~CPortFrame();
+
+	void OnReceiveSample(const SerialSample& sample);
+
+private:
+	Gtk::Grid m_grid;
+	Gtk::Box m_subbox;
+	CDataFrame m_dataframe_temp;
+	CDataFrame m_dataframe_led;
+	CDataFrame m_dataframe_humid;
+	CControlFrame m_controlframe;
+};
+
+#endif
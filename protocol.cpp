@@ -0,0 +1,486 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "protocol.h"
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+SampleTime SampleTime::Now()
+{
+	SampleTime time;
+	time.monotonic = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	time.wallclock = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	return time;
+}
+
+SerialParseResult CSerialCommand::Parse(std::string_view command, SerialSample& sample)
+{
+	// example of a command: sdt_24.00_19.83_255.00
+	// the string is pre-filtered by the frame decoder
+	if (command.empty())
+	{
+		return SERIAL_PARSE_EMPTY;
+	}
+
+	std::string_view type, setpoint, sensor, pwm;
+
+	if (!NextField(command, type) || !NextField(command, setpoint) || !NextField(command, sensor) || !NextField(command, pwm))
+	{
+		return SERIAL_PARSE_MISSING_FIELD;
+	}
+
+	if (type == "sdt")
+	{
+		sample.type = SETPOINT_TEMPERATURE;
+	}
+	else if (type == "sdl")
+	{
+		sample.type = SETPOINT_LED;
+	}
+	else if (type == "sdh")
+	{
+		sample.type = SETPOINT_HUMIDITY;
+	}
+	else
+	{
+		return SERIAL_PARSE_UNKNOWN_TYPE;
+	}
+
+	if (!ParseNumber(setpoint, sample.setpoint) || !ParseNumber(sensor, sample.sensor) || !ParseNumber(pwm, sample.pwm))
+	{
+		return SERIAL_PARSE_BAD_NUMBER;
+	}
+
+	return SERIAL_PARSE_OK;
+}
+
+const char* CSerialCommand::GetParseResultName(const SerialParseResult result)
+{
+	switch (result)
+	{
+	case SERIAL_PARSE_OK:
+		return "OK";
+	case SERIAL_PARSE_EMPTY:
+		return "empty command";
+	case SERIAL_PARSE_MISSING_FIELD:
+		return "missing field";
+	case SERIAL_PARSE_UNKNOWN_TYPE:
+		return "unknown command type";
+	case SERIAL_PARSE_BAD_NUMBER:
+		return "invalid number";
+	default:
+		return "unknown error";
+	}
+}
+
+std::string CSerialCommand::AddSequence(std::string_view command, const std::uint16_t sequence)
+{
+	if (!command.empty() && command.back() == '?')
+	{
+		command.remove_suffix(1);
+	}
+
+	char buffer[8];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), sequence);
+
+	std::string sequenced;
+	sequenced.reserve(command.size() + 8);
+	sequenced.append(command);
+	sequenced.push_back('_');
+	sequenced.append(buffer, result.ptr);
+	sequenced.push_back('?');
+	return sequenced;
+}
+
+bool CSerialCommand::ParseAck(std::string_view command, std::uint16_t& sequence)
+{
+	std::string_view type, number;
+
+	if (!NextField(command, type) || type != SERIAL_ACK_COMMAND || !NextField(command, number))
+	{
+		return false;
+	}
+
+	const char* end = number.data() + number.size();
+	auto result = std::from_chars(number.data(), end, sequence);
+	return result.ec == std::errc() && result.ptr == end;
+}
+
+// Splits the next '_' delimited field from the command, any fields after the fourth one are ignored
+bool CSerialCommand::NextField(std::string_view& command, std::string_view& field)
+{
+	if (command.empty())
+	{
+		return false;
+	}
+
+	auto delimiterat = command.find('_');
+	field = command.substr(0, delimiterat);
+	command.remove_prefix(delimiterat == std::string_view::npos ? command.size() : delimiterat + 1);
+	return !field.empty();
+}
+
+// The whole field must be a number, from_chars always expects a dot as the decimal separator
+bool CSerialCommand::ParseNumber(std::string_view field, float& value)
+{
+	const char* end = field.data() + field.size();
+	auto result = std::from_chars(field.data(), end, value);
+	return result.ec == std::errc() && result.ptr == end;
+}
+
+// CRC lookup table generated at compile time
+struct Crc16Table
+{
+	std::uint16_t values[256];
+
+	constexpr Crc16Table() : values()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			std::uint16_t crc = static_cast<std::uint16_t>(i << 8);
+
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = static_cast<std::uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+			}
+
+			values[i] = crc;
+		}
+	}
+};
+
+static constexpr Crc16Table s_crc16table;
+
+std::uint16_t CBinaryProtocol::Crc16(const std::uint8_t* data, std::size_t size)
+{
+	std::uint16_t crc = 0xFFFF;
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		crc = static_cast<std::uint16_t>((crc << 8) ^ s_crc16table.values[((crc >> 8) ^ data[i]) & 0xFF]);
+	}
+
+	return crc;
+}
+
+std::size_t CBinaryProtocol::CobsEncode(const std::uint8_t* data, std::size_t size, std::uint8_t* out)
+{
+	std::size_t write = 1;
+	std::size_t codeat = 0;
+	std::uint8_t code = 1;
+
+	for (std::size_t read = 0; read < size; read++)
+	{
+		if (data[read] == 0)
+		{
+			out[codeat] = code;
+			codeat = write++;
+			code = 1;
+			continue;
+		}
+
+		out[write++] = data[read];
+		code++;
+
+		if (code == 0xFF)
+		{
+			out[codeat] = code;
+			codeat = write++;
+			code = 1;
+		}
+	}
+
+	out[codeat] = code;
+	return write;
+}
+
+std::size_t CBinaryProtocol::CobsDecode(const std::uint8_t* data, std::size_t size, std::uint8_t* out)
+{
+	std::size_t read = 0;
+	std::size_t write = 0;
+
+	while (read < size)
+	{
+		const std::uint8_t code = data[read];
+
+		if (code == 0 || read + code > size)
+		{
+			return 0;
+		}
+
+		read++;
+
+		for (std::uint8_t i = 1; i < code; i++)
+		{
+			out[write++] = data[read++];
+		}
+
+		if (code != 0xFF && read != size)
+		{
+			out[write++] = 0;
+		}
+	}
+
+	return write;
+}
+
+std::string CBinaryProtocol::EncodeFrame(const std::uint8_t* payload, std::size_t size)
+{
+	std::uint8_t raw[BINARY_MAX_PAYLOAD + 2];
+	std::uint8_t encoded[BINARY_MAX_ENCODED + 1];
+
+	if (size > BINARY_MAX_PAYLOAD)
+	{
+		return std::string("");
+	}
+
+	const std::uint16_t crc = Crc16(payload, size);
+
+	for (std::size_t i = 0; i < size; i++)
+	{
+		raw[i] = payload[i];
+	}
+
+	raw[size] = static_cast<std::uint8_t>(crc & 0xFF);
+	raw[size + 1] = static_cast<std::uint8_t>(crc >> 8);
+
+	std::size_t length = CobsEncode(raw, size + 2, encoded);
+	encoded[length++] = BINARY_FRAME_DELIMITER;
+	return std::string(reinterpret_cast<const char*>(encoded), length);
+}
+
+std::string CBinaryProtocol::EncodePower(const bool on, const int sequence)
+{
+	std::uint8_t payload[4] = { BINARY_MSG_POWER, static_cast<std::uint8_t>(on ? 1 : 0) };
+	return EncodeFrame(payload, AppendSequence(payload, 2, sequence));
+}
+
+std::string CBinaryProtocol::EncodeSetpoint(const SetpointType type, const float value, const int sequence)
+{
+	if (type <= SETPOINT_INVALID || type >= SETPOINT_TYPE_COUNT)
+	{
+		return std::string("");
+	}
+
+	const std::uint16_t fixed = static_cast<std::uint16_t>(ToFixed(value));
+	std::uint8_t payload[6] = { BINARY_MSG_SETPOINT, static_cast<std::uint8_t>(type), static_cast<std::uint8_t>(fixed & 0xFF), static_cast<std::uint8_t>(fixed >> 8) };
+	return EncodeFrame(payload, AppendSequence(payload, 4, sequence));
+}
+
+SerialParseResult CBinaryProtocol::ParseTelemetry(const std::uint8_t* payload, std::size_t size, SerialSample& sample)
+{
+	if (size == 0)
+	{
+		return SERIAL_PARSE_EMPTY;
+	}
+
+	if (payload[0] != BINARY_MSG_TELEMETRY || (size > 1 && (payload[1] <= SETPOINT_INVALID || payload[1] >= SETPOINT_TYPE_COUNT)))
+	{
+		return SERIAL_PARSE_UNKNOWN_TYPE;
+	}
+
+	if (size != 8)
+	{
+		return SERIAL_PARSE_MISSING_FIELD;
+	}
+
+	sample.type = static_cast<SetpointType>(payload[1]);
+	sample.setpoint = FromFixed(payload + 2);
+	sample.sensor = FromFixed(payload + 4);
+	sample.pwm = FromFixed(payload + 6);
+	return SERIAL_PARSE_OK;
+}
+
+bool CBinaryProtocol::ParseAck(const std::uint8_t* payload, std::size_t size, std::uint16_t& sequence)
+{
+	if (size != 3 || payload[0] != BINARY_MSG_ACK)
+	{
+		return false;
+	}
+
+	sequence = static_cast<std::uint16_t>(payload[1] | (payload[2] << 8));
+	return true;
+}
+
+std::string CBinaryProtocol::EncodeHello()
+{
+	const std::uint8_t payload[] = { BINARY_MSG_HELLO, BINARY_PROTOCOL_VERSION };
+	return EncodeFrame(payload, sizeof(payload));
+}
+
+std::string CBinaryProtocol::EncodeTelemetry(const SerialSample& sample)
+{
+	const std::uint16_t setpoint = static_cast<std::uint16_t>(ToFixed(sample.setpoint));
+	const std::uint16_t sensor = static_cast<std::uint16_t>(ToFixed(sample.sensor));
+	const std::uint16_t pwm = static_cast<std::uint16_t>(ToFixed(sample.pwm));
+	const std::uint8_t payload[] = { BINARY_MSG_TELEMETRY, static_cast<std::uint8_t>(sample.type),
+		static_cast<std::uint8_t>(setpoint & 0xFF), static_cast<std::uint8_t>(setpoint >> 8),
+		static_cast<std::uint8_t>(sensor & 0xFF), static_cast<std::uint8_t>(sensor >> 8),
+		static_cast<std::uint8_t>(pwm & 0xFF), static_cast<std::uint8_t>(pwm >> 8) };
+	return EncodeFrame(payload, sizeof(payload));
+}
+
+std::string CBinaryProtocol::EncodeAck(const std::uint16_t sequence)
+{
+	std::uint8_t payload[3] = { BINARY_MSG_ACK };
+	return EncodeFrame(payload, AppendSequence(payload, 1, sequence));
+}
+
+SerialParseResult CBinaryProtocol::ParsePower(const std::uint8_t* payload, std::size_t size, bool& on, int& sequence)
+{
+	if (size == 0)
+	{
+		return SERIAL_PARSE_EMPTY;
+	}
+
+	if (payload[0] != BINARY_MSG_POWER)
+	{
+		return SERIAL_PARSE_UNKNOWN_TYPE;
+	}
+
+	if (size != 2 && size != 4)
+	{
+		return SERIAL_PARSE_MISSING_FIELD;
+	}
+
+	on = payload[1] != 0;
+	sequence = ReadSequence(payload, size, 2);
+	return SERIAL_PARSE_OK;
+}
+
+SerialParseResult CBinaryProtocol::ParseSetpoint(const std::uint8_t* payload, std::size_t size, SetpointType& type, float& value, int& sequence)
+{
+	if (size == 0)
+	{
+		return SERIAL_PARSE_EMPTY;
+	}
+
+	if (payload[0] != BINARY_MSG_SETPOINT || (size > 1 && (payload[1] <= SETPOINT_INVALID || payload[1] >= SETPOINT_TYPE_COUNT)))
+	{
+		return SERIAL_PARSE_UNKNOWN_TYPE;
+	}
+
+	if (size != 4 && size != 6)
+	{
+		return SERIAL_PARSE_MISSING_FIELD;
+	}
+
+	type = static_cast<SetpointType>(payload[1]);
+	value = FromFixed(&payload[2]);
+	sequence = ReadSequence(payload, size, 4);
+	return SERIAL_PARSE_OK;
+}
+
+std::int16_t CBinaryProtocol::ToFixed(const float value)
+{
+	const float scaled = std::round(value * BINARY_VALUE_SCALE);
+
+	if (scaled >= static_cast<float>(std::numeric_limits<std::int16_t>::max()))
+		return std::numeric_limits<std::int16_t>::max();
+
+	if (scaled <= static_cast<float>(std::numeric_limits<std::int16_t>::min()))
+		return std::numeric_limits<std::int16_t>::min();
+
+	return static_cast<std::int16_t>(scaled);
+}
+
+float CBinaryProtocol::FromFixed(const std::uint8_t* data)
+{
+	const std::int16_t fixed = static_cast<std::int16_t>(data[0] | (data[1] << 8));
+	return static_cast<float>(fixed) / BINARY_VALUE_SCALE;
+}
+
+// Sequence numbers are an optional u16 after the fixed part of a message
+std::size_t CBinaryProtocol::AppendSequence(std::uint8_t* payload, std::size_t size, const int sequence)
+{
+	if (sequence == SERIAL_NO_SEQUENCE)
+	{
+		return size;
+	}
+
+	payload[size] = static_cast<std::uint8_t>(sequence & 0xFF);
+	payload[size + 1] = static_cast<std::uint8_t>((sequence >> 8) & 0xFF);
+	return size + 2;
+}
+
+int CBinaryProtocol::ReadSequence(const std::uint8_t* payload, std::size_t size, const std::size_t basesize)
+{
+	if (size < basesize + 2)
+	{
+		return SERIAL_NO_SEQUENCE;
+	}
+
+	return payload[basesize] | (payload[basesize + 1] << 8);
+}
+
+CBinaryFrameDecoder::CBinaryFrameDecoder() :
+m_length(0),
+m_overflow(false),
+m_frames(0),
+m_dropped(0),
+m_crcerrors(0)
+{
+}
+
+void CBinaryFrameDecoder::Reset()
+{
+	m_length = 0;
+	m_overflow = false;
+}
+
+// Called when a delimiter is found, decodes and checks the bytes received since the last one
+bool CBinaryFrameDecoder::Decode(std::size_t& size)
+{
+	const std::size_t length = m_length;
+	const bool overflow = m_overflow;
+	Reset();
+
+	if (length == 0)
+	{
+		return false;
+	}
+
+	if (overflow)
+	{
+		m_dropped += length;
+		return false;
+	}
+
+	std::size_t decoded = CBinaryProtocol::CobsDecode(m_encoded, length, m_decoded);
+
+	if (decoded < 3)
+	{
+		m_dropped += length;
+		return false;
+	}
+
+	size = decoded - 2;
+	const std::uint16_t crc = static_cast<std::uint16_t>(m_decoded[size] | (m_decoded[size + 1] << 8));
+
+	if (crc != CBinaryProtocol::Crc16(m_decoded, size))
+	{
+		m_crcerrors++;
+		m_dropped += length;
+		return false;
+	}
+
+	m_frames++;
+	return true;
+}
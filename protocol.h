@@ -0,0 +1,229 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_PROTOCOL_
+#define _H_PROTOCOL_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum SerialCommand
+{
+	SERIAL_CMD_INVALID = 0,
+	SERIAL_CMD_POWER_OFF,
+	SERIAL_CMD_POWER_ON,
+	SERIAL_CMD_SETPOINT,
+
+	SERIAL_CMD_TYPE_COUNT
+};
+
+enum SetpointType
+{
+	SETPOINT_INVALID = 0,
+	SETPOINT_TEMPERATURE,
+	SETPOINT_LED,
+	SETPOINT_HUMIDITY,
+
+	SETPOINT_TYPE_COUNT
+};
+
+enum SerialParseResult
+{
+	SERIAL_PARSE_OK = 0,
+	SERIAL_PARSE_EMPTY,
+	SERIAL_PARSE_MISSING_FIELD,
+	SERIAL_PARSE_UNKNOWN_TYPE,
+	SERIAL_PARSE_BAD_NUMBER,
+
+	SERIAL_PARSE_RESULT_COUNT
+};
+
+#define SERIAL_NO_SEQUENCE -1 // command sent without a sequence number, the firmware doesn't acknowledge it
+#define SERIAL_ACK_COMMAND "sak" // ASCII acknowledgement sent by the firmware, ie: sak_17
+
+// Arrival time of a sample, taken by the serial receiver right after the bytes were read
+struct SampleTime
+{
+	std::int64_t monotonic = 0; // steady clock in nanoseconds, for intervals and rates
+	std::int64_t wallclock = 0; // nanoseconds since the Unix epoch, for the logs
+
+	static SampleTime Now();
+};
+
+// Telemetry values of a single command received from serial
+struct SerialSample
+{
+	SetpointType type;
+	float setpoint;
+	float sensor;
+	float pwm;
+	SampleTime time; // set by the receiver, the parsers leave it untouched
+};
+
+// Parses commands received from serial
+class CSerialCommand
+{
+public:
+	/// @brief Parses a command without allocating memory
+	/// @param command Command string without the end marker, ie: sdt_24.00_19.83_255.00
+	/// @param sample Receives the parsed values, only valid if SERIAL_PARSE_OK is returned
+	static SerialParseResult Parse(std::string_view command, SerialSample& sample);
+	static const char* GetParseResultName(const SerialParseResult result);
+	/// @brief Adds a sequence number field to a command, ie: cspt_24.00? becomes cspt_24.00_17?
+	static std::string AddSequence(std::string_view command, const std::uint16_t sequence);
+	/// @brief Parses an acknowledgement sent by the firmware
+	/// @param command Command string without the end marker, ie: sak_17
+	/// @return true if the command is an acknowledgement
+	static bool ParseAck(std::string_view command, std::uint16_t& sequence);
+private:
+	static bool NextField(std::string_view& command, std::string_view& field);
+	static bool ParseNumber(std::string_view field, float& value);
+};
+
+enum ProtocolMode
+{
+	PROTOCOL_ASCII = 0, // text commands, supported by every firmware
+	PROTOCOL_BINARY, // COBS framed binary messages
+	PROTOCOL_AUTO, // ask the firmware for binary mode and fall back to text if it doesn't answer
+
+	PROTOCOL_MODE_COUNT
+};
+
+#define BINARY_PROTOCOL_VERSION 1
+#define BINARY_FRAME_DELIMITER 0x00
+#define BINARY_MAX_PAYLOAD 16 // largest message payload, not counting the CRC
+#define BINARY_MAX_ENCODED (BINARY_MAX_PAYLOAD + 2 + (BINARY_MAX_PAYLOAD + 2) / 254 + 1) // payload + CRC after COBS encoding
+#define BINARY_VALUE_SCALE 100.0f // values are sent as signed 16 bits hundredths, ie: 24.50 is sent as 2450
+#define BINARY_HANDSHAKE_COMMAND "cbin?" // ASCII command asking the firmware to switch to the binary protocol
+
+// Binary message identifiers, first byte of every payload
+enum BinaryMessage : std::uint8_t
+{
+	BINARY_MSG_INVALID = 0x00,
+	BINARY_MSG_HELLO = 0x01, // firmware -> host: [version u8], firmware switched to binary. Sent after a lone delimiter so the host drops any text still in its decoder.
+	BINARY_MSG_TELEMETRY = 0x02, // firmware -> host: [SetpointType u8][setpoint i16][sensor i16][pwm i16]
+	BINARY_MSG_ACK = 0x03, // firmware -> host: [sequence u16], a command with this sequence number was applied
+	BINARY_MSG_POWER = 0x10, // host -> firmware: [on u8] or [on u8][sequence u16]
+	BINARY_MSG_SETPOINT = 0x11, // host -> firmware: [SetpointType u8][value i16] or [SetpointType u8][value i16][sequence u16]
+};
+
+// Encodes and decodes the binary protocol.
+// On the wire a frame is COBS(payload + CRC16 little-endian) followed by a zero byte.
+// All multi-byte fields are little-endian.
+class CBinaryProtocol
+{
+public:
+	/// @brief CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF)
+	static std::uint16_t Crc16(const std::uint8_t* data, std::size_t size);
+	/// @brief COBS encodes data, out must hold at least size + size / 254 + 1 bytes
+	/// @return Number of bytes written to out
+	static std::size_t CobsEncode(const std::uint8_t* data, std::size_t size, std::uint8_t* out);
+	/// @brief Decodes a COBS block without the frame delimiter, out must hold at least size bytes
+	/// @return Number of bytes written to out or 0 if the block is malformed
+	static std::size_t CobsDecode(const std::uint8_t* data, std::size_t size, std::uint8_t* out);
+
+	/// @brief Appends the CRC, encodes the payload and adds the frame delimiter
+	static std::string EncodeFrame(const std::uint8_t* payload, std::size_t size);
+	/// @param sequence Sequence number the firmware acknowledges, SERIAL_NO_SEQUENCE to send the command without one
+	static std::string EncodePower(const bool on, const int sequence = SERIAL_NO_SEQUENCE);
+	static std::string EncodeSetpoint(const SetpointType type, const float value, const int sequence = SERIAL_NO_SEQUENCE);
+	/// @brief Reads a telemetry message payload
+	static SerialParseResult ParseTelemetry(const std::uint8_t* payload, std::size_t size, SerialSample& sample);
+	/// @brief Reads an acknowledgement message payload
+	/// @return true if the payload is a valid acknowledgement
+	static bool ParseAck(const std::uint8_t* payload, std::size_t size, std::uint16_t& sequence);
+
+	// Firmware side of the protocol, used by the device simulator
+	static std::string EncodeHello();
+	static std::string EncodeTelemetry(const SerialSample& sample);
+	static std::string EncodeAck(const std::uint16_t sequence);
+	/// @brief Reads a power message payload
+	/// @param sequence Receives the sequence number or SERIAL_NO_SEQUENCE
+	static SerialParseResult ParsePower(const std::uint8_t* payload, std::size_t size, bool& on, int& sequence);
+	/// @brief Reads a setpoint message payload
+	/// @param sequence Receives the sequence number or SERIAL_NO_SEQUENCE
+	static SerialParseResult ParseSetpoint(const std::uint8_t* payload, std::size_t size, SetpointType& type, float& value, int& sequence);
+private:
+	static std::int16_t ToFixed(const float value);
+	static float FromFixed(const std::uint8_t* data);
+	static std::size_t AppendSequence(std::uint8_t* payload, std::size_t size, const int sequence);
+	static int ReadSequence(const std::uint8_t* payload, std::size_t size, const std::size_t basesize);
+};
+
+// Incremental decoder for binary frames, the binary counterpart of CFrameDecoder.
+// Only frames with a valid CRC are reported.
+class CBinaryFrameDecoder
+{
+public:
+	CBinaryFrameDecoder();
+
+	/// @brief Feeds a chunk of raw serial data to the decoder
+	/// @param onframe Called with the payload (CRC removed) of each valid frame. The pointer is only valid during the call.
+	template <typename Callback>
+	void Feed(const char* data, std::size_t size, Callback&& onframe);
+	void Reset();
+
+	std::uint64_t GetFrameCount() const { return m_frames; }
+	std::uint64_t GetDroppedBytes() const { return m_dropped; }
+	std::uint64_t GetChecksumErrors() const { return m_crcerrors; }
+private:
+	bool Decode(std::size_t& size);
+
+	std::uint8_t m_encoded[BINARY_MAX_ENCODED];
+	std::uint8_t m_decoded[BINARY_MAX_ENCODED];
+	std::size_t m_length;
+	bool m_overflow; // current frame is too long, discard everything until the next delimiter
+	std::uint64_t m_frames;
+	std::uint64_t m_dropped;
+	std::uint64_t m_crcerrors;
+};
+
+template <typename Callback>
+inline void CBinaryFrameDecoder::Feed(const char* data, std::size_t size, Callback&& onframe)
+{
+	for (std::size_t i = 0; i < size; i++)
+	{
+		const std::uint8_t byte = static_cast<std::uint8_t>(data[i]);
+
+		if (byte != BINARY_FRAME_DELIMITER)
+		{
+			if (m_length < BINARY_MAX_ENCODED)
+			{
+				m_encoded[m_length++] = byte;
+			}
+			else
+			{
+				m_overflow = true;
+				m_dropped++;
+			}
+
+			continue;
+		}
+
+		std::size_t payloadsize = 0;
+
+		if (Decode(payloadsize))
+		{
+			onframe(static_cast<const std::uint8_t*>(m_decoded), payloadsize);
+		}
+	}
+}
+
+#endif
\ No newline at end of file
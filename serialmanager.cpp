@@ -18,206 +18,898 @@
 
 #include "serialmanager.h"
 #include "app.h"
+#include "latencyprobe.h"
 #include <iostream>
 #include <fstream>
 #include <algorithm>
-#include <sstream>
+#include <cctype>
+#include <string>
 #include <utility>
 
-// Update is called every 500 ms
+#if defined(__linux__) || defined(__APPLE__)
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define SERIAL_READ_TIMEOUT_MS 2000 // timeout for serial read operations in milliseconds
+#define SERIAL_READ_CHUNK_SIZE 256 // maximum number of bytes taken from the device per read
+#define SERIAL_READ_IDLE_MS 10 // sleep between checks on platforms without poll()
+
+// Port names become part of the log file names, ie: log_bench1_temperature.dat.
+// Only letters, digits, '_' and '-' are kept, so a name can't leave the log directory,
+// and every port gets a name of its own so two ports never write the same files.
+static std::string GetPortName(const std::string& name, const std::vector<CSerialConfiguration>& configs)
+{
+	const std::size_t first = name.find_first_not_of(" \t");
+	const std::size_t last = name.find_last_not_of(" \t");
+	std::string result = first == std::string::npos ? std::string() : name.substr(first, last - first + 1);
+
+	for (char& c : result)
+	{
+		if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-')
+			c = '_';
+	}
+
+	if (result.empty())
+		result = "port" + std::to_string(configs.size() + 1);
+
+	const auto taken = [&configs](const std::string& candidate)
+	{
+		return std::any_of(configs.begin(), configs.end(), [&candidate](const CSerialConfiguration& config) { return config.name == candidate; });
+	};
+
+	if (taken(result))
+	{
+		int suffix = 2;
+
+		while (taken(result + "_" + std::to_string(suffix)))
+			suffix++;
+
+		result += "_" + std::to_string(suffix);
+	}
+
+	if (result != name)
+		std::cout << "Port name \"" << name << "\" changed to \"" << result << "\"" << std::endl;
+
+	return result;
+}
+
+// Binary commands are printed as hex so they don't garble the console
+static std::string DescribeCommand(const std::string& command)
+{
+	bool printable = std::all_of(command.begin(), command.end(), [](const char c) { return c >= 0x20 && c < 0x7F; });
+
+	if (printable)
+	{
+		return command;
+	}
+
+	static const char digits[] = "0123456789ABCDEF";
+	std::string hex;
+	hex.reserve(command.size() * 3);
+
+	for (const char c : command)
+	{
+		const unsigned char byte = static_cast<unsigned char>(c);
+		hex.push_back(digits[byte >> 4]);
+		hex.push_back(digits[byte & 0x0F]);
+		hex.push_back(' ');
+	}
+
+	hex.pop_back();
+	return hex;
+}
+
+CSerialPort::CSerialPort(const std::size_t index, const CSerialConfiguration& config) :
+m_index(index),
+m_config(config),
+m_serialib(),
+m_writer(),
+m_sequence(0),
+m_pollfd(-1),
+m_decoder(),
+m_binarydecoder(),
+m_binary(false),
+m_droppedbytes(0),
+m_parseerrors(0),
+m_checksumerrors(0),
+m_decoded(0),
+m_arrival(),
+m_logger_temp(GetChannelName("temperature"), GetFlushPolicy(), config.logencoding, GetRetentionPolicy()),
+m_logger_led(GetChannelName("led"), GetFlushPolicy(), config.logencoding, GetRetentionPolicy()),
+m_logger_humid(GetChannelName("humidity"), GetFlushPolicy(), config.logencoding, GetRetentionPolicy())
+{
+}
+
+CSerialPort::~CSerialPort()
+{
+	Close();
+}
+
+// The receiver thread must be stopped before opening or closing a port
+bool CSerialPort::Open()
+{
+	Close();
+
+	char result = m_serialib.openDevice(m_config.devicename.c_str(), m_config.baudrate, m_config.databits, m_config.parity, m_config.stopbits);
+
+	switch (result)
+	{
+	case 1:
+		std::cout << "Serial connection open!" << std::endl;
+		std::cout << "Device: " << m_config.devicename << " - Baud rate: " << m_config.baudrate << std::endl; 
+		break;
+	case -1:
+		std::cout << "Failed to open serial connection. Error: Device " << m_config.devicename << " was not found!" << std::endl;
+		return false;
+	case -2:
+		std::cout << "Failed to open serial connection. Error while opening the device " << m_config.devicename << std::endl;
+#ifdef __linux__
+		std::cout << "On linux, this may also indicate that the device is not found." << std::endl;
+		std::cout << "This will likely occur if the \"serial.cfg\" file is saved with CRLF instead of LF." << std::endl;
+#endif
+		return false;
+	case -3:
+		std::cout << "Failed to open serial connection. Error while getting port parameters." << std::endl;
+		return false;
+	case -4:
+		std::cout << "Failed to open serial connection. Speed (baud rate) " << m_config.baudrate << " not recognized." << std::endl;
+		return false;
+	case -5:
+		std::cout << "Failed to open serial connection. Error while writing port parameters." << std::endl;
+		return false;
+	case -6:
+		std::cout << "Failed to open serial connection. Error while writing timeout parameters." << std::endl;
+		return false;
+	default:
+		std::cout << "Failed to open serial connection. Unhandled error code " << static_cast<int>(result) << std::endl;
+		return false;
+	}
+
+#if defined(__linux__) || defined(__APPLE__)
+	// serialib doesn't expose its file descriptor, open a second one to the same device so we can poll() it.
+	m_pollfd = open(m_config.devicename.c_str(), O_RDONLY | O_NOCTTY | O_NONBLOCK);
+
+	if (m_pollfd < 0)
+	{
+		std::cout << "Failed to open " << m_config.devicename << " for polling." << std::endl;
+		m_serialib.closeDevice();
+		return false;
+	}
+#endif
+
+	m_decoder.Reset();
+	m_binarydecoder.Reset();
+	m_binary = m_config.protocol == PROTOCOL_BINARY;
+	m_writer.Start(&m_serialib, m_config);
+
+	if (m_config.protocol == PROTOCOL_AUTO)
+	{
+		// Firmware that supports the binary protocol answers with a hello message, older firmware ignores it
+		SendCommand(BINARY_HANDSHAKE_COMMAND);
+	}
+
+	return true;
+}
+
+void CSerialPort::Close()
+{
+	m_writer.Stop();
+
+	if (m_config.ackwindow > 0 && m_serialib.isDeviceOpen())
+	{
+		static const char* const names[SETPOINT_TYPE_COUNT] = { "power", "temperature", "led", "humidity" };
+		std::cout << m_config.devicename << ": Commands acknowledged: " << m_writer.GetAcknowledgedCount() << " Sent again: " << m_writer.GetRetransmitCount() << " Failed: " << m_writer.GetFailedCount() << std::endl;
+
+		for (int type = 0; type < SETPOINT_TYPE_COUNT; type++)
+		{
+			const CLatencyHistogram& latency = m_writer.GetAckLatency(static_cast<SetpointType>(type));
+
+			if (latency.GetCount() > 0)
+			{
+				std::cout << "    " << names[type] << " acknowledgement latency p50: " << static_cast<double>(latency.GetPercentile(50.0)) / 1e6 << " ms p99: " << static_cast<double>(latency.GetPercentile(99.0)) / 1e6 << " ms max: " << static_cast<double>(latency.GetMax()) / 1e6 << " ms" << std::endl;
+			}
+		}
+	}
+
+	ClosePollDescriptor();
+
+	if (m_serialib.isDeviceOpen())
+	{
+		m_serialib.closeDevice();
+	}
+}
+
+bool CSerialPort::IsConnected()
+{
+	return m_serialib.isDeviceOpen();
+}
+
+bool CSerialPort::IsAvailable()
+{
+	return IsConnected() && m_serialib.available() > 0;
+}
+
+void CSerialPort::SendCommand(const std::string& command, const SetpointType type, const int sequence)
+{
+	if (command.length() < 2)
+		return;
+
+	std::cout << "Command received: " << DescribeCommand(command) << std::endl;
+	m_writer.Push(command, type, sequence);
+}
+
+int CSerialPort::NextSequence()
+{
+	if (m_config.ackwindow == 0)
+		return SERIAL_NO_SEQUENCE;
+
+	return ++m_sequence;
+}
+
+void CSerialPort::InvokeLogger()
+{
+	m_logger_temp.WriteToFile();
+	m_logger_led.WriteToFile();
+	m_logger_humid.WriteToFile();
+}
+
+void CSerialPort::FlushLogger()
+{
+	m_logger_temp.Flush();
+	m_logger_led.Flush();
+	m_logger_humid.Flush();
+}
+
+LogFlushPolicy CSerialPort::GetFlushPolicy() const
+{
+	LogFlushPolicy policy;
+	policy.samples = m_config.logflushsamples;
+	policy.bytes = m_config.logflushbytes;
+	policy.interval = m_config.logflushinterval;
+	policy.journal = m_config.logjournalinterval;
+	return policy;
+}
+
+LogRetentionPolicy CSerialPort::GetRetentionPolicy() const
+{
+	LogRetentionPolicy policy;
+	policy.rotatebytes = m_config.logrotatebytes;
+	policy.rotatedaily = m_config.logrotatedaily;
+	policy.compactbytes = m_config.logcompactbytes;
+	policy.keeprawdays = m_config.logkeeprawdays;
+	policy.keepdays = m_config.logkeepdays;
+	return policy;
+}
+
+std::string CSerialPort::GetChannelName(const char* channel) const
+{
+	if (m_config.name.empty())
+	{
+		return std::string(channel);
+	}
+
+	return m_config.name + "_" + channel;
+}
+
+void CSerialPort::ClosePollDescriptor()
+{
+#if defined(__linux__) || defined(__APPLE__)
+	if (m_pollfd >= 0)
+	{
+		close(m_pollfd);
+		m_pollfd = -1;
+	}
+#endif
+}
+
+std::size_t CSerialPort::ProcessData(const char* data, std::size_t size, const SampleTime& arrival, CSerialReceiver* receiver)
+{
+	const bool binary = m_binary;
+	const std::uint64_t dropped = binary ? m_binarydecoder.GetDroppedBytes() : m_decoder.GetDroppedBytes();
+	const std::uint64_t crcerrors = m_binarydecoder.GetChecksumErrors();
+	m_decoded = 0;
+	m_arrival = arrival;
+
+	if (!binary)
+	{
+		m_decoder.Feed(data, size, [this, receiver](std::string_view frame) { ProcessFrame(frame, receiver); });
+	}
+
+	// While negotiating, the firmware may answer in either protocol
+	if (binary || m_config.protocol == PROTOCOL_AUTO)
+	{
+		m_binarydecoder.Feed(data, size, [this, receiver](const std::uint8_t* payload, std::size_t length) { ProcessBinaryFrame(payload, length, receiver); });
+	}
+
+	const std::uint64_t discarded = (binary ? m_binarydecoder.GetDroppedBytes() : m_decoder.GetDroppedBytes()) - dropped;
+
+	if (discarded > 0)
+	{
+		std::cout << "[THREADED] " << m_config.devicename << ": Discarded " << discarded << " bytes of invalid serial data." << std::endl;
+		m_droppedbytes += discarded;
+	}
+
+	if (binary && m_binarydecoder.GetChecksumErrors() != crcerrors)
+	{
+		std::cout << "[THREADED] " << m_config.devicename << ": Discarded " << m_binarydecoder.GetChecksumErrors() - crcerrors << " corrupted binary frames." << std::endl;
+		m_checksumerrors += m_binarydecoder.GetChecksumErrors() - crcerrors;
+	}
+
+	return m_decoded;
+}
+
+void CSerialPort::ProcessFrame(std::string_view frame, CSerialReceiver* receiver)
+{
+	std::uint16_t sequence = 0;
+
+	if (CSerialCommand::ParseAck(frame, sequence))
+	{
+		m_writer.Acknowledge(sequence);
+		return;
+	}
+
+	SerialSample sample;
+	SerialParseResult result = CSerialCommand::Parse(frame, sample);
+
+	if (result != SERIAL_PARSE_OK)
+	{
+		std::cout << "Warning: " << m_config.devicename << ": Failed to parse command \"" << frame << "\": " << CSerialCommand::GetParseResultName(result) << std::endl;
+		m_parseerrors++;
+		return;
+	}
+
+	sample.time = m_arrival;
+	PushSample(sample, receiver);
+}
+
+void CSerialPort::ProcessBinaryFrame(const std::uint8_t* payload, std::size_t size, CSerialReceiver* receiver)
+{
+	if (payload[0] == BINARY_MSG_HELLO)
+	{
+		if (!m_binary)
+		{
+			std::cout << "[THREADED] " << m_config.devicename << ": Firmware switched to the binary protocol (version " << (size > 1 ? static_cast<int>(payload[1]) : 0) << ")." << std::endl;
+			m_binary = true;
+		}
+
+		return;
+	}
+
+	std::uint16_t sequence = 0;
+
+	if (CBinaryProtocol::ParseAck(payload, size, sequence))
+	{
+		m_writer.Acknowledge(sequence);
+		return;
+	}
+
+	SerialSample sample;
+	SerialParseResult result = CBinaryProtocol::ParseTelemetry(payload, size, sample);
+
+	if (result != SERIAL_PARSE_OK)
+	{
+		std::cout << "Warning: " << m_config.devicename << ": Failed to parse binary message " << static_cast<int>(payload[0]) << ": " << CSerialCommand::GetParseResultName(result) << std::endl;
+		m_parseerrors++;
+		return;
+	}
+
+	sample.time = m_arrival;
+	PushSample(sample, receiver);
+}
+
+// Logs the sample and hands it to the UI
+void CSerialPort::PushSample(const SerialSample& sample, CSerialReceiver* receiver)
+{
+	CLatencyProbe::Mark(LATENCY_STAGE_PARSED, sample.setpoint);
+
+	switch (sample.type)
+	{
+	case SETPOINT_TEMPERATURE:
+		m_logger_temp.Log(sample.time, sample.setpoint, sample.sensor, sample.pwm);
+		break;
+	case SETPOINT_LED:
+		m_logger_led.Log(sample.time, sample.setpoint, sample.sensor, sample.pwm);
+		break;
+	case SETPOINT_HUMIDITY:
+		m_logger_humid.Log(sample.time, sample.setpoint, sample.sensor, sample.pwm);
+		break;
+	default:
+		return;
+	}
+
+	receiver->QueueSample(m_index, sample);
+	m_decoded++;
+}
+
+CSerialReceiver::CSerialReceiver() :
+m_caller(nullptr),
+m_ports(),
+m_thread(),
+m_running(false),
+m_wakefd{-1, -1},
+m_overflows(0),
+m_notifypending(false),
+m_samplequeue()
+{
+}
+
+CSerialReceiver::~CSerialReceiver()
+{
+	Stop();
+}
+
+bool CSerialReceiver::Start(CSerialManager* caller, const std::vector<CSerialPort*>& ports)
+{
+	Stop();
+
+	if (ports.empty())
+	{
+		return false;
+	}
+
+#if defined(__linux__) || defined(__APPLE__)
+	if (pipe(m_wakefd) != 0)
+	{
+		std::cout << "Failed to start serial reader. Could not create the wake up pipe." << std::endl;
+		return false;
+	}
+#endif
+
+	m_caller = caller;
+	m_ports = ports;
+	m_running = true;
+	m_thread = std::thread(
+		[this]
+		{
+			Run();
+		});
+
+	return true;
+}
+
+void CSerialReceiver::Stop()
+{
+	m_running = false;
+
+#if defined(__linux__) || defined(__APPLE__)
+	if (m_wakefd[1] >= 0)
+	{
+		const char wake = 0;
+		[[maybe_unused]] auto written = write(m_wakefd[1], &wake, 1);
+	}
+#endif
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+#if defined(__linux__) || defined(__APPLE__)
+	for (int& fd : m_wakefd)
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+#endif
+
+	m_ports.clear();
+}
+
+bool CSerialReceiver::IsRunning() const
+{
+	return m_running;
+}
+
+bool CSerialReceiver::GetSample(PortSample *sample)
+{
+	PortSample discarded;
+	return m_samplequeue.Pop(sample ? *sample : discarded);
+}
+
+void CSerialReceiver::QueueSample(const std::size_t port, const SerialSample& sample)
+{
+	if (!m_samplequeue.Push({ port, sample }))
+	{
+		m_overflows++;
+	}
+}
+
+void CSerialReceiver::Run()
+{
+	char buffer[SERIAL_READ_CHUNK_SIZE];
+	std::vector<CSerialPort*> ready;
+	ready.reserve(m_ports.size());
+
+	while (m_running)
+	{
+		if (!WaitForData(ready))
+			continue;
+
+		bool received = false;
+
+		for (CSerialPort* port : ready)
+		{
+			received |= ReadPort(port, buffer);
+		}
+
+		// Only wake the main loop if it isn't already going to drain the queue
+		if (received && !m_notifypending.exchange(true))
+		{
+			m_caller->Notify_SerialReceiver();
+		}
+	}
+}
+
+// Blocks until any port has data to read or the reader is stopped
+bool CSerialReceiver::WaitForData(std::vector<CSerialPort*>& ready)
+{
+	ready.clear();
+
+#if defined(__linux__) || defined(__APPLE__)
+	pollfd fds[SERIAL_MAX_PORTS + 1];
+	CSerialPort* polled[SERIAL_MAX_PORTS];
+	nfds_t count = 0;
+
+	for (CSerialPort* port : m_ports)
+	{
+		if (port->GetPollDescriptor() >= 0 && count < SERIAL_MAX_PORTS)
+		{
+			fds[count].fd = port->GetPollDescriptor();
+			fds[count].events = POLLIN;
+			fds[count].revents = 0;
+			polled[count] = port;
+			count++;
+		}
+	}
+
+	fds[count].fd = m_wakefd[0];
+	fds[count].events = POLLIN;
+	fds[count].revents = 0;
+
+	if (poll(fds, count + 1, -1) <= 0)
+	{
+		return false;
+	}
+
+	if (fds[count].revents != 0)
+	{
+		m_running = false;
+		return false;
+	}
+
+	for (nfds_t i = 0; i < count; i++)
+	{
+		if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+		{
+			std::cout << "[THREADED] Serial device " << polled[i]->GetConfig().devicename << " was disconnected." << std::endl;
+			polled[i]->ClosePollDescriptor();
+		}
+		else if (fds[i].revents & POLLIN)
+		{
+			ready.push_back(polled[i]);
+		}
+	}
+#else
+	std::this_thread::sleep_for(std::chrono::milliseconds(SERIAL_READ_IDLE_MS));
+
+	for (CSerialPort* port : m_ports)
+	{
+		if (port->IsAvailable())
+		{
+			ready.push_back(port);
+		}
+	}
+#endif
+
+	return !ready.empty();
+}
+
+// Reads what's available from a port, returns true if any sample was decoded
+bool CSerialReceiver::ReadPort(CSerialPort* port, char* buffer)
+{
+	int available = port->GetSerialib()->available();
+
+	if (available <= 0)
+		return false;
+
+	int size = std::min(available, SERIAL_READ_CHUNK_SIZE);
+	int read = port->GetSerialib()->readBytes(buffer, static_cast<unsigned int>(size), SERIAL_READ_TIMEOUT_MS);
+
+	if (read <= 0)
+		return false;
 
-#define SERIAL_WRITE_DELAY 7
-#define SERIAL_READ_DELAY 4
-#define SERIAL_READ_WAIT_FOR_THREAD_DELAY 1 // update cycle to wait when the read thread is busy
-#define SERIAL_READ_TIMEOUT_MS 2000 // timeout for serial read operations in milliseconds
+	// Stamped here, as close to the bytes arriving as we can get
+	const SampleTime arrival = SampleTime::Now();
+	return port->ProcessData(buffer, static_cast<std::size_t>(read), arrival, this) > 0;
+}
+
+CSerialWriter::CSerialWriter() :
+m_mutex(),
+m_condition(),
+m_thread(),
+m_running(false),
+m_interval(SERIAL_DEFAULT_WRITE_INTERVAL_MS),
+m_ackwindow(0),
+m_acktimeout(SERIAL_DEFAULT_ACK_TIMEOUT_MS),
+m_ackretries(SERIAL_DEFAULT_ACK_RETRIES),
+m_queue(),
+m_inflight(),
+m_acknowledged(0),
+m_retransmits(0),
+m_failed(0)
+{
+}
 
-CSerialCommand::CSerialCommand(std::string rawcommand)
+CSerialWriter::~CSerialWriter()
 {
-	m_string = rawcommand;
-	m_setpoint = "";
-	m_sensor = "";
-	m_pwm = "";
-	m_type = SETPOINT_INVALID;
+	Stop();
 }
 
-void CSerialCommand::Parse()
+void CSerialWriter::Start(serialib* serialib, const CSerialConfiguration& config)
 {
-	// example of a command: sdt_24.00_19.83_255.00?
-	// the string is pre-filtered by the serial reader
-	auto strvector = Explode();
+	Stop();
 
-	if (strvector.size() < 4) // valid commands have at least 4 strings
 	{
-		return;
-	}
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// Commands that were never acknowledged before the port was closed are sent again, unless a newer one replaced them
+		for (auto inflight = m_inflight.rbegin(); inflight != m_inflight.rend(); ++inflight)
+		{
+			const SetpointType type = inflight->queued.type;
 
-	auto type = strvector[0];
-	auto data1 = strvector[1];
-	auto data2 = strvector[2];
-	auto data3 = strvector[3];
+			if (std::none_of(m_queue.begin(), m_queue.end(), [type](const QueuedCommand& queued) { return queued.type == type; }))
+			{
+				m_queue.push_front(inflight->queued);
+			}
+		}
 
-	if (type == "sdt")
-	{
-		m_type = SETPOINT_TEMPERATURE;
-	}
-	else if (type == "sdl")
-	{
-		m_type = SETPOINT_LED;
+		m_inflight.clear();
+		m_interval = config.writeinterval;
+		m_ackwindow = config.ackwindow;
+		m_acktimeout = config.acktimeout;
+		m_ackretries = config.ackretries;
+		m_running = true;
 	}
-	else if (type == "sdh")
+
+	m_thread = std::thread(
+		[this, serialib]
+		{
+			Run(serialib);
+		});
+}
+
+void CSerialWriter::Stop()
+{
 	{
-		m_type = SETPOINT_HUMIDITY;
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
 	}
-	else
+
+	m_condition.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void CSerialWriter::Push(const std::string& command, const SetpointType type, const int sequence)
+{
 	{
-		std::cout << "Warning: Unrecognized command \"" << m_string << "\"" << std::endl;
-		return;
-	}
+		std::lock_guard<std::mutex> lock(m_mutex);
 
-	m_setpoint = data1;
-	m_sensor = data2;
-	m_pwm = data3;
+		if (type != SETPOINT_INVALID)
+		{
+			// Latest wins, an older setpoint that wasn't sent yet is stale
+			auto pending = std::find_if(m_queue.begin(), m_queue.end(), [type](const QueuedCommand& queued) { return queued.type == type; });
+
+			if (pending != m_queue.end())
+			{
+				pending->command = command;
+				pending->sequence = sequence;
+				return;
+			}
+		}
 
-	std::string charset = "UTF-8";
-	std::string fromcharset = "ASCII";
+		m_queue.push_back({ command, type, sequence });
+	}
 
-	m_setpoint = Glib::convert(m_setpoint, charset, fromcharset);
-	m_sensor = Glib::convert(m_sensor, charset, fromcharset);
-	m_pwm = Glib::convert(m_pwm, charset, fromcharset);
+	m_condition.notify_all();
 }
 
-// Splits the command string in a vector of strings
-const std::vector<std::string> CSerialCommand::Explode()
+void CSerialWriter::Acknowledge(const std::uint16_t sequence)
 {
-	std::string str = m_string;
-	const char delimiter = '_';
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto inflight = std::find_if(m_inflight.begin(), m_inflight.end(), [sequence](const InFlightCommand& command) { return command.queued.sequence == sequence; });
 
-	std::vector<std::string> result;
-	std::istringstream iss(str);
+		// Late acknowledgement of a command that was sent more than once or replaced by a newer one
+		if (inflight == m_inflight.end())
+			return;
 
-	for (std::string token; std::getline(iss, token, delimiter); )
-	{
-		result.push_back(std::move(token));
+		const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - inflight->firstsent).count();
+		m_acklatency[inflight->queued.type].Record(static_cast<std::uint64_t>(latency));
+		m_acknowledged++;
+
+		std::cout << "[THREADED] Command \"" << DescribeCommand(inflight->queued.command) << "\" acknowledged in " << static_cast<double>(latency) / 1e6 << " ms." << std::endl;
+		m_inflight.erase(inflight);
 	}
 
-	return result;
+	m_condition.notify_all();
 }
 
-CSerialReceiver::CSerialReceiver() :
-m_Mutex(),
-m_done(false),
-m_message()
+std::size_t CSerialWriter::GetPendingCount() const
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_queue.size();
 }
 
-void CSerialReceiver::Update(CSerialManager *caller, serialib *serialib)
+std::size_t CSerialWriter::GetInFlightCount() const
 {
-	std::lock_guard<std::mutex> lock(m_Mutex);
-	constexpr int size = 40;
-	std::unique_ptr<char[]> buffer(new char[size]);
-	serialib->readString(buffer.get(), '?', size, SERIAL_READ_TIMEOUT_MS);
-	std::string serialbuffer = std::string(buffer.get());
-	std::cout << "[THREADED] Received buffer from serial: " << serialbuffer << std::endl;
-	m_message = serialbuffer;
-	FormatCommand();
-	m_done = true;
-	caller->Notify_SerialReceiver();
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_inflight.size();
 }
 
-void CSerialReceiver::FormatCommand()
+void CSerialWriter::Run(serialib* serialib)
 {
-	std::string command = m_message;
-
-	command.erase(std::remove(command.begin(), command.end(), '\r'), command.cend());
-	command.erase(std::remove(command.begin(), command.end(), '\n'), command.cend());
-	// auto npos = command.find('\n');
-
-	// while (npos != std::string::npos) // remove any new lines that get added by println
-	// {
-	// 	command.erase(npos);
-	// 	npos = command.find('\n');
-	// }
-	
-	auto startpos = command.find('s');
-	auto endpos = command.find('?');
+	std::unique_lock<std::mutex> lock(m_mutex);
 
-	if (startpos == std::string::npos || endpos == std::string::npos)
+	if (m_ackwindow > 0)
 	{
-		m_message = std::string("");
+		RunAcknowledged(serialib, lock);
 		return;
 	}
 
-	std::string subcommand = command.substr(startpos, endpos);
-	m_message = subcommand;
+	while (m_running)
+	{
+		m_condition.wait(lock, [this] { return !m_running || !m_queue.empty(); });
+
+		if (!m_running)
+			break;
+
+		std::string command = std::move(m_queue.front().command);
+		m_queue.pop_front();
+
+		lock.unlock();
+		Write(serialib, command, "written");
+		lock.lock();
+
+		// Give the microcontroller time to process the command, Stop() cuts the wait short
+		m_condition.wait_for(lock, std::chrono::milliseconds(m_interval), [this] { return !m_running; });
+	}
 }
 
-void CSerialReceiver::GetCommand(std::string *command)
+// The acknowledgements replace the write interval, commands are sent as fast as the window allows
+void CSerialWriter::RunAcknowledged(serialib* serialib, std::unique_lock<std::mutex>& lock)
 {
-	std::lock_guard<std::mutex> lock(m_Mutex);
-	
-	if (command)
+	const clock::duration timeout = std::chrono::milliseconds(m_acktimeout);
+	std::vector<std::string> resend;
+
+	while (m_running)
 	{
-		*command = m_message;
+		const clock::time_point now = clock::now();
+		resend.clear();
+
+		for (auto inflight = m_inflight.begin(); inflight != m_inflight.end();)
+		{
+			if (now - inflight->lastsent < timeout)
+			{
+				++inflight;
+				continue;
+			}
+
+			if (inflight->attempts > m_ackretries)
+			{
+				std::cout << "[THREADED] Command \"" << DescribeCommand(inflight->queued.command) << "\" was not acknowledged, giving up." << std::endl;
+				m_failed++;
+				inflight = m_inflight.erase(inflight);
+				continue;
+			}
+
+			inflight->attempts++;
+			inflight->lastsent = now;
+			m_retransmits++;
+			resend.push_back(inflight->queued.command);
+			++inflight;
+		}
+
+		if (!resend.empty())
+		{
+			lock.unlock();
+
+			for (const std::string& command : resend)
+			{
+				Write(serialib, command, "sent again");
+			}
+
+			lock.lock();
+			continue;
+		}
+
+		if (!m_queue.empty() && m_inflight.size() < m_ackwindow)
+		{
+			QueuedCommand queued = std::move(m_queue.front());
+			m_queue.pop_front();
+
+			if (queued.sequence != SERIAL_NO_SEQUENCE)
+			{
+				// Sending an older command for the same setpoint again would undo this one
+				const SetpointType type = queued.type;
+				m_inflight.erase(std::remove_if(m_inflight.begin(), m_inflight.end(), [type](const InFlightCommand& inflight) { return inflight.queued.type == type; }), m_inflight.end());
+				m_inflight.push_back({ queued, now, now, 1 });
+			}
+
+			lock.unlock();
+			Write(serialib, queued.command, "written");
+			lock.lock();
+			continue;
+		}
+
+		// Sleep until a command can be sent, an acknowledgement frees the window or the oldest command times out
+		auto ready = [this] { return !m_running || (!m_queue.empty() && m_inflight.size() < m_ackwindow); };
+
+		if (m_inflight.empty())
+		{
+			m_condition.wait(lock, ready);
+		}
+		else
+		{
+			clock::time_point deadline = m_inflight.front().lastsent;
+
+			for (const InFlightCommand& inflight : m_inflight)
+			{
+				deadline = std::min(deadline, inflight.lastsent);
+			}
+
+			m_condition.wait_until(lock, deadline + timeout, ready);
+		}
 	}
 }
 
-bool CSerialReceiver::Done() const
+void CSerialWriter::Write(serialib* serialib, const std::string& command, const char* action)
 {
-	std::lock_guard<std::mutex> lock(m_Mutex);
-	return m_done;
+	serialib->writeBytes(command.data(), static_cast<unsigned int>(command.size()));
+	std::cout << "[THREADED] Command " << action << " to serial: \"" << DescribeCommand(command) << "\"" << std::endl;
 }
 
 CSerialManager::CSerialManager() :
-m_serialcfg(),
-m_writetimer(0),
-m_readtimer(0),
-m_cmd_queue(),
-m_last_cmd(""),
+m_configurated(false),
+m_configfile("serial.cfg"),
+m_ports(),
 m_receiverdispatcher(),
-m_receiverworker(),
-m_receiverthread(nullptr),
-m_logger_temp("temperature"),
-m_logger_led("led"),
-m_logger_humid("humidity")
+m_receiverworker()
 {
-	m_serialib = std::make_shared<serialib>();
 	m_receiverdispatcher.connect(sigc::mem_fun(*this, &CSerialManager::OnSignal_ReceiveCommand));
 	m_mainwindow = nullptr;
 }
 
 CSerialManager::~CSerialManager()
 {
+	CloseAll();
 	m_mainwindow = nullptr;
-
-	if (m_receiverthread != nullptr)
-	{
-		if (m_receiverthread->joinable())
-			m_receiverthread->join();
-
-		delete m_receiverthread;
-		m_receiverthread = nullptr;
-	}
 }
 
 bool CSerialManager::ReadConfigFile()
 {
-	if (m_serialcfg.configurated)
+	if (m_configurated)
 	{
 		return true;
 	}
 
 	std::fstream filestream;
-	const char* configfile = "serial.cfg";
-
-	filestream.open(configfile, std::ios::in);
+	filestream.open(m_configfile, std::ios::in);
 
 	if (!filestream.is_open())
 	{
-		std::cout << "Failed to read serial.cfg!" << std::endl;
+		std::cout << "Failed to read " << m_configfile << "!" << std::endl;
 		return false;
 	}
 	
 	std::string line;
+	CSerialConfiguration defaults; // settings before the first port section apply to every port
+	CSerialConfiguration ignored; // settings of ports above the limit
+	std::vector<CSerialConfiguration> configs;
 
 	while (std::getline(filestream, line))
 	{
@@ -235,11 +927,55 @@ bool CSerialManager::ReadConfigFile()
 		line.erase(std::remove(line.begin(), line.end(), '\r'), line.cend());
 		line.erase(std::remove(line.begin(), line.end(), '\n'), line.cend());
 
-		ReadConfigLine(line);
+		// Port:<name> starts a new port section
+		if (line.compare(0, 5, "Port:") == 0)
+		{
+			const std::string name = GetPortName(line.substr(5), configs);
+			configs.push_back(defaults);
+			configs.back().name = name;
+
+			if (configs.size() > SERIAL_MAX_PORTS)
+			{
+				std::cout << "Too many serial ports, ignoring port " << configs.back().name << std::endl;
+			}
+
+			continue;
+		}
+
+		if (configs.empty())
+		{
+			ReadConfigLine(line, defaults);
+		}
+		else
+		{
+			ReadConfigLine(line, configs.size() > SERIAL_MAX_PORTS ? ignored : configs.back());
+		}
 	}
 	
 	filestream.close();
-	m_serialcfg.configurated = true;
+
+	// Configuration files without port sections describe a single port
+	if (configs.empty())
+	{
+		configs.push_back(defaults);
+	}
+
+	configs.resize(std::min(configs.size(), static_cast<std::size_t>(SERIAL_MAX_PORTS)));
+
+	CloseAll();
+	m_ports.clear();
+
+	for (std::size_t i = 0; i < configs.size(); i++)
+	{
+		m_ports.push_back(std::make_unique<CSerialPort>(i, configs[i]));
+	}
+
+	m_configurated = true;
+
+	if (m_mainwindow)
+	{
+		m_mainwindow->OnPortsChanged();
+	}
 
 	return true;
 }
@@ -251,116 +987,89 @@ bool CSerialManager::OpenConnection()
 		return false;
 	}
 
-	char result = m_serialib->openDevice(m_serialcfg.devicename.c_str(), m_serialcfg.baudrate, m_serialcfg.databits, m_serialcfg.parity, m_serialcfg.stopbits);
-	bool ret = false;
+	m_receiverworker.Stop();
 
-	switch (result)
+	std::vector<CSerialPort*> ports;
+
+	for (auto& port : m_ports)
 	{
-	case 1:
-		ret = true;
-		std::cout << "Serial connection open!" << std::endl;
-		std::cout << "Device: " << m_serialcfg.devicename << " - Baud rate: " << m_serialcfg.baudrate << std::endl; 
-		break;
-	case -1:
-		std::cout << "Failed to open serial connection. Error: Device " << m_serialcfg.devicename << " was not found!" << std::endl;
-		break;
-	case -2:
-		std::cout << "Failed to open serial connection. Error while opening the device " << m_serialcfg.devicename << std::endl;
-#ifdef __linux__
-		std::cout << "On linux, this may also indicate that the device is not found." << std::endl;
-		std::cout << "This will likely occur if the \"serial.cfg\" file is saved with CRLF instead of LF." << std::endl;
-#endif
-		break;
-	case -3:
-		std::cout << "Failed to open serial connection. Error while getting port parameters." << std::endl;
-		break;
-	case -4:
-		std::cout << "Failed to open serial connection. Speed (baud rate) " << m_serialcfg.baudrate << " not recognized." << std::endl;
-		break;
-	case -5:
-		std::cout << "Failed to open serial connection. Error while writing port parameters." << std::endl;
-		break;
-	case -6:
-		std::cout << "Failed to open serial connection. Error while writing timeout parameters." << std::endl;
-		break;
-	default:
-		std::cout << "Failed to open serial connection. Unhandled error code " << static_cast<int>(result) << std::endl;
-		break;
+		if (port->Open())
+		{
+			ports.push_back(port.get());
+		}
 	}
 
-	return ret;
+	return m_receiverworker.Start(this, ports);
 }
 
 bool CSerialManager::IsConnected()
 {
-	return m_serialib->isDeviceOpen();
+	return std::any_of(m_ports.begin(), m_ports.end(), [](const std::unique_ptr<CSerialPort>& port) { return port->IsConnected(); });
 }
 
 bool CSerialManager::IsAvailable()
 {
-	return m_serialib->available() > 0;
+	return std::any_of(m_ports.begin(), m_ports.end(), [](const std::unique_ptr<CSerialPort>& port) { return port->IsAvailable(); });
 }
 
 bool CSerialManager::ReloadConfig()
 {
-	if (IsConnected())
+	CloseAll();
+
+	// The ports are recreated, save what they collected before their loggers are gone
+	for (auto& port : m_ports)
 	{
-		m_serialib->closeDevice();
+		port->FlushLogger();
 	}
 
-	m_serialcfg.configurated = false;
+	m_configurated = false;
 	return ReadConfigFile();
 }
 
 void CSerialManager::SendCommand(const SerialCommand cmd, const SetpointType spt, const float data)
 {
+	for (std::size_t i = 0; i < m_ports.size(); i++)
+	{
+		SendCommand(i, cmd, spt, data);
+	}
+}
+
+void CSerialManager::SendCommand(const std::size_t port, const SerialCommand cmd, const SetpointType spt, const float data)
+{
+	if (port >= m_ports.size())
+	{
+		return;
+	}
+
 	std::string command;
+	CSerialPort* serialport = m_ports[port].get();
+	const bool binary = serialport->IsBinary();
+	const int sequence = serialport->NextSequence();
+	SetpointType type = SETPOINT_INVALID;
 
 	switch (cmd)
 	{
 	case SERIAL_CMD_POWER_OFF:
-		command = "coff?";
-		SendCommandInternal(command);
+		command = binary ? CBinaryProtocol::EncodePower(false, sequence) : "coff?";
 		break;
 	case SERIAL_CMD_POWER_ON:
-		command = "con?";
-		SendCommandInternal(command);
+		command = binary ? CBinaryProtocol::EncodePower(true, sequence) : "con?";
 		break;
 	case SERIAL_CMD_SETPOINT:
-		command = FormatSetpointCommand(spt, data);
-		SendCommandInternal(command);
+		command = binary ? CBinaryProtocol::EncodeSetpoint(spt, data, sequence) : FormatSetpointCommand(spt, data);
+		type = spt;
 		break;
 	default:
 		break;
 	}
 
-	std::cout << "CSerialManager::SendCommand -- \"" << command << "\" " << std::endl;
-}
-
-void CSerialManager::Update()
-{
-	if (!IsConnected())
-		return;
-
-	bool didwrite = false;
-
-	if (m_writetimer > 0)
+	if (!binary && sequence != SERIAL_NO_SEQUENCE && !command.empty())
 	{
-		m_writetimer--;
-	}
-	else
-	{
-		didwrite = CheckWrite();
+		command = CSerialCommand::AddSequence(command, static_cast<std::uint16_t>(sequence));
 	}
 
-	if (m_readtimer > 0)
-	{
-		m_readtimer--;
-	}
-	else if (!didwrite) // Only try to read the serial if we didn't write something to it
-	{
-		CheckRead();
-	}
+	serialport->SendCommand(command, type, sequence);
+	std::cout << "CSerialManager::SendCommand -- " << serialport->GetConfig().devicename << " \"" << DescribeCommand(command) << "\" " << std::endl;
 }
 
 void CSerialManager::Notify_SerialReceiver()
@@ -370,31 +1079,39 @@ void CSerialManager::Notify_SerialReceiver()
 
 void CSerialManager::InvokeLogger()
 {
-	m_logger_temp.WriteToFile();
-	m_logger_led.WriteToFile();
-	m_logger_humid.WriteToFile();
+	for (auto& port : m_ports)
+	{
+		port->InvokeLogger();
+	}
 }
 
 void CSerialManager::OnSignal_ReceiveCommand()
 {
-	if (m_receiverthread && m_receiverworker.Done())
+	PortSample sample;
+
+	// Samples were already logged by the receiver thread, only the display is updated here
+	m_receiverworker.ClearNotify();
+
+	while (m_receiverworker.GetSample(&sample))
 	{
-		std::string command = std::string("");
-		m_receiverworker.GetCommand(&command);
-		std::cout << "Received command from multi-threaded serial reader: " << command << std::endl;
-		m_last_cmd = command;
+		m_mainwindow->OnReceiveSerialCommand(sample.port, sample.sample);
+	}
+}
 
-		if (m_receiverthread->joinable())
-			m_receiverthread->join();
+// Stops the receiver before closing the ports it is polling
+void CSerialManager::CloseAll()
+{
+	m_receiverworker.Stop();
 
-		delete m_receiverthread;
-		m_receiverthread = nullptr;
-		ProcessReceivedCommand();
+	for (auto& port : m_ports)
+	{
+		port->Close();
 	}
 }
 
+
 // Reads a single line from the config file
-void CSerialManager::ReadConfigLine(const std::string line)
+void CSerialManager::ReadConfigLine(const std::string line, CSerialConfiguration& config)
 {
 	auto spaceat = line.find(' ');
 	auto newline = line.substr(0, spaceat);
@@ -404,33 +1121,33 @@ void CSerialManager::ReadConfigLine(const std::string line)
 
 	if (setting == "DeviceName")
 	{
-		m_serialcfg.devicename = value;
+		config.devicename = value;
 	}
 	else if (setting == "BaudRate")
 	{
-		m_serialcfg.baudrate = std::stoi(value);
+		config.baudrate = std::stoi(value);
 	}
 	else if (setting == "Databits")
 	{
 		if (value == "SERIAL_DATABITS_5")
 		{
-			m_serialcfg.databits = SERIAL_DATABITS_5;
+			config.databits = SERIAL_DATABITS_5;
 		}
 		else if (value == "SERIAL_DATABITS_6")
 		{
-			m_serialcfg.databits = SERIAL_DATABITS_6;
+			config.databits = SERIAL_DATABITS_6;
 		}
 		else if (value == "SERIAL_DATABITS_7")
 		{
-			m_serialcfg.databits = SERIAL_DATABITS_7;
+			config.databits = SERIAL_DATABITS_7;
 		}
 		else if (value == "SERIAL_DATABITS_8")
 		{
-			m_serialcfg.databits = SERIAL_DATABITS_8;
+			config.databits = SERIAL_DATABITS_8;
 		}
 		else if (value == "SERIAL_DATABITS_16")
 		{
-			m_serialcfg.databits = SERIAL_DATABITS_16;
+			config.databits = SERIAL_DATABITS_16;
 		}
 		else
 		{
@@ -441,143 +1158,148 @@ void CSerialManager::ReadConfigLine(const std::string line)
 	{
 		if (value == "SERIAL_PARITY_NONE")
 		{
-			m_serialcfg.parity = SERIAL_PARITY_NONE;
+			config.parity = SERIAL_PARITY_NONE;
 		}
 		else if (value == "SERIAL_PARITY_EVEN")
 		{
-			m_serialcfg.parity = SERIAL_PARITY_EVEN;
+			config.parity = SERIAL_PARITY_EVEN;
 		}
 		else if (value == "SERIAL_PARITY_ODD")
 		{
-			m_serialcfg.parity = SERIAL_PARITY_ODD;
+			config.parity = SERIAL_PARITY_ODD;
 		}
 		else if (value == "SERIAL_PARITY_MARK")
 		{
-			m_serialcfg.parity = SERIAL_PARITY_MARK;
+			config.parity = SERIAL_PARITY_MARK;
 		}
 		else if (value == "SERIAL_PARITY_SPACE")
 		{
-			m_serialcfg.parity = SERIAL_PARITY_SPACE;
+			config.parity = SERIAL_PARITY_SPACE;
 		}
 		else
 		{
 			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;	
 		}
 	}
-	else if (setting == "Stopbits")
+	else if (setting == "WriteInterval")
 	{
-		if (value == "SERIAL_STOPBITS_1")
-		{
-			m_serialcfg.stopbits = SERIAL_STOPBITS_1;
-		}
-		else if (value == "SERIAL_STOPBITS_1_5")
+		config.writeinterval = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "AckWindow")
+	{
+		config.ackwindow = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "AckTimeout")
+	{
+		config.acktimeout = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "AckRetries")
+	{
+		config.ackretries = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "LogFlushSamples")
+	{
+		config.logflushsamples = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "LogFlushBytes")
+	{
+		config.logflushbytes = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "LogFlushInterval")
+	{
+		config.logflushinterval = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "LogJournalInterval")
+	{
+		config.logjournalinterval = static_cast<unsigned int>(std::stoi(value));
+	}
+	else if (setting == "LogRotateSize")
+	{
+		config.logrotatebytes = std::stoull(value);
+	}
+	else if (setting == "LogRotateDaily")
+	{
+		if (value == "YES")
 		{
-			m_serialcfg.stopbits = SERIAL_STOPBITS_1_5;
+			config.logrotatedaily = true;
 		}
-		else if (value == "SERIAL_STOPBITS_2")
+		else if (value == "NO")
 		{
-			m_serialcfg.stopbits = SERIAL_STOPBITS_2;
+			config.logrotatedaily = false;
 		}
 		else
 		{
-			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;	
+			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;
 		}
 	}
-}
-
-bool CSerialManager::CheckWrite()
-{
-	if (m_cmd_queue.size() > 0)
+	else if (setting == "LogCompactSize")
 	{
-		m_writetimer = SERIAL_WRITE_DELAY;
-		WriteNextCommand();
-		return true;
+		config.logcompactbytes = std::stoull(value);
 	}
-
-	return false;
-}
-
-void CSerialManager::CheckRead()
-{
-	if (m_receiverthread == nullptr)
+	else if (setting == "LogKeepRawDays")
 	{
-		ReceiveCommandInternal();
+		config.logkeeprawdays = static_cast<unsigned int>(std::stoi(value));
 	}
-	else
+	else if (setting == "LogKeepDays")
 	{
-		m_readtimer = SERIAL_READ_WAIT_FOR_THREAD_DELAY;
-		std::cout << "Serial reader thread is busy, waiting..." << std::endl;
+		config.logkeepdays = static_cast<unsigned int>(std::stoi(value));
 	}
-	
-}
-
-void CSerialManager::WriteNextCommand()
-{
-	std::string command = m_cmd_queue.front();
-	m_cmd_queue.pop();
-	m_serialib->writeString(command.c_str());
-	std::cout << "Command written to serial: \"" << command << "\"" << std::endl;
-}
-
-void CSerialManager::SendCommandInternal(const std::string cmd)
-{
-	if (cmd.length() < 2)
-		return;
-
-	std::cout << "Command received: " << cmd << std::endl;
-	m_cmd_queue.push(cmd);
-}
-
-void CSerialManager::ReceiveCommandInternal()
-{
-	if (m_serialib->available() <= 0)
+	else if (setting == "LogCompression")
 	{
-		std::cout << "No serial data available" << std::endl;
-		return;
-	}
-
-	m_readtimer = SERIAL_READ_DELAY;
-
-	m_receiverthread = new std::thread(
-		[this]
+		if (value == "NONE")
 		{
-			m_receiverworker.Update(this, m_serialib.get());
-		});
-
-	// constexpr int size = 40;
-	// std::unique_ptr<char[]> buffer(new char[size]);
-	// m_serialib->readString(buffer.get(), '?', size, SERIAL_READ_TIMEOUT_MS);
-	// std::string command = std::string(buffer.get());
-	// std::cout << "Received buffer from serial: " << command << std::endl;
-}
-
-void CSerialManager::ProcessReceivedCommand()
-{
-	std::unique_ptr<CSerialCommand> command (new CSerialCommand(m_last_cmd));
-	command->Parse();
-
-	switch (command->GetType())
+			config.logencoding = LOGCHUNK_ENCODING_RAW;
+		}
+		else if (value == "GORILLA")
+		{
+			config.logencoding = LOGCHUNK_ENCODING_GORILLA;
+		}
+		else
+		{
+			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;	
+		}
+	}
+	else if (setting == "Protocol")
 	{
-	case SETPOINT_TEMPERATURE:
-		m_logger_temp.Log(command->GetSetpointData(), command->GetSensorData(), command->GetPWMData());
-		break;
-	case SETPOINT_LED:
-		m_logger_led.Log(command->GetSetpointData(), command->GetSensorData(), command->GetPWMData());
-		break;
-	case SETPOINT_HUMIDITY:
-		m_logger_humid.Log(command->GetSetpointData(), command->GetSensorData(), command->GetPWMData());
-		break;
-	default:
-		break;
+		if (value == "ASCII")
+		{
+			config.protocol = PROTOCOL_ASCII;
+		}
+		else if (value == "BINARY")
+		{
+			config.protocol = PROTOCOL_BINARY;
+		}
+		else if (value == "AUTO")
+		{
+			config.protocol = PROTOCOL_AUTO;
+		}
+		else
+		{
+			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;	
+		}
 	}
-
-	if (command->GetType() != SETPOINT_INVALID)
+	else if (setting == "Stopbits")
 	{
-		// std::cout << "Last received command is valid!" << std::endl;
-		m_mainwindow->OnReceiveSerialCommand(command.get());
+		if (value == "SERIAL_STOPBITS_1")
+		{
+			config.stopbits = SERIAL_STOPBITS_1;
+		}
+		else if (value == "SERIAL_STOPBITS_1_5")
+		{
+			config.stopbits = SERIAL_STOPBITS_1_5;
+		}
+		else if (value == "SERIAL_STOPBITS_2")
+		{
+			config.stopbits = SERIAL_STOPBITS_2;
+		}
+		else
+		{
+			std::cout << "Unhandled setting " << setting << " value " << value << std::endl;	
+		}
 	}
 }
 
+
 std::string CSerialManager::FormatSetpointCommand(const SetpointType type, const float data)
 {
 	std::string command;
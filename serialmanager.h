@@ -22,99 +22,267 @@
 #include <gtkmm.h>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <queue>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
 
 #include "logger.h"
+#include "framedecoder.h"
+#include "protocol.h"
+#include "spscqueue.h"
+#include "latencyprobe.h"
 
 class MainWindow;
 
 // BUG? serialib must be included after gtkmm.h or else you get 100+ errors
 #include "lib/serialib.h"
 
-enum SerialCommand
-{
-	SERIAL_CMD_INVALID = 0,
-	SERIAL_CMD_POWER_OFF,
-	SERIAL_CMD_POWER_ON,
-	SERIAL_CMD_SETPOINT,
+class CSerialManager;
+class CSerialReceiver;
 
-	SERIAL_CMD_TYPE_COUNT
-};
+#define SERIAL_DEFAULT_WRITE_INTERVAL_MS 100
+#define SERIAL_SAMPLE_QUEUE_SIZE 1024 // parsed samples waiting for the UI, must be a power of two
+#define SERIAL_MAX_PORTS 16
+#define SERIAL_DEFAULT_ACK_TIMEOUT_MS 250
+#define SERIAL_DEFAULT_ACK_RETRIES 3
 
-enum SetpointType
+class CSerialConfiguration
 {
-	SETPOINT_INVALID = 0,
-	SETPOINT_TEMPERATURE,
-	SETPOINT_LED,
-	SETPOINT_HUMIDITY,
+public:
+	CSerialConfiguration() :
+	name(),
+	devicename()
+	{
+		baudrate = 0;
+		databits = SERIAL_DATABITS_5;
+		stopbits = SERIAL_STOPBITS_1;
+		parity = SERIAL_PARITY_NONE;
+		protocol = PROTOCOL_ASCII;
+		writeinterval = SERIAL_DEFAULT_WRITE_INTERVAL_MS;
+		ackwindow = 0;
+		acktimeout = SERIAL_DEFAULT_ACK_TIMEOUT_MS;
+		ackretries = SERIAL_DEFAULT_ACK_RETRIES;
+		logflushsamples = LOGGER_DEFAULT_FLUSH_SAMPLES;
+		logflushbytes = LOGGER_DEFAULT_FLUSH_BYTES;
+		logflushinterval = LOGGER_DEFAULT_FLUSH_INTERVAL_S;
+		logjournalinterval = LOGGER_DEFAULT_JOURNAL_INTERVAL_MS;
+		logencoding = LOGCHUNK_ENCODING_RAW;
+		logrotatebytes = LOGSEGMENT_DEFAULT_ROTATE_BYTES;
+		logrotatedaily = true;
+		logcompactbytes = LOGSEGMENT_DEFAULT_COMPACT_BYTES;
+		logkeeprawdays = LOGSEGMENT_DEFAULT_KEEP_RAW_DAYS;
+		logkeepdays = 0;
+	}
 
-	SETPOINT_TYPE_COUNT
+	std::string name; // port name, empty for configuration files without port sections
+	std::string devicename;
+	unsigned int baudrate;
+	SerialDataBits databits;
+	SerialStopBits stopbits;
+	SerialParity parity;
+	ProtocolMode protocol;
+	unsigned int writeinterval; // minimum time between commands in milliseconds
+	unsigned int ackwindow; // commands waiting for an acknowledgement at once, 0 disables acknowledgements
+	unsigned int acktimeout; // time to wait for an acknowledgement before sending the command again in milliseconds
+	unsigned int ackretries; // times a command is sent again before giving up
+	unsigned int logflushsamples; // the loggers write once this many samples are waiting, 0 disables
+	unsigned int logflushbytes; // the loggers write once the waiting samples take this many bytes in the log file, 0 disables
+	unsigned int logflushinterval; // the loggers write waiting samples after this many seconds, 0 disables
+	unsigned int logjournalinterval; // the loggers commit new samples to their journal every this many milliseconds, 0 disables
+	LogChunkEncoding logencoding; // compression of the log files
+	std::uint64_t logrotatebytes; // log files are rotated once they are this large, 0 disables
+	bool logrotatedaily; // log files are rotated when the date changes
+	std::uint64_t logcompactbytes; // small rotated segments are merged up to this size, 0 disables
+	unsigned int logkeeprawdays; // older segments are compressed, 0 disables
+	unsigned int logkeepdays; // older segments are deleted, 0 keeps them forever
 };
 
-class CSerialManager;
-
-// Represents a single command received from serial
-class CSerialCommand
+// Dedicated serial writer, sends queued commands while the receiver keeps reading.
+// When acknowledgements are enabled, up to a window of sequenced commands are in flight at once and
+// commands that are not acknowledged in time are sent again, otherwise commands are paced by the write interval.
+class CSerialWriter
 {
 public:
-	CSerialCommand(std::string rawcommand);
+	CSerialWriter();
+	~CSerialWriter();
 
-	void Parse();
+	/// @brief Starts the writer thread for an open serial device
+	void Start(serialib* serialib, const CSerialConfiguration& config);
+	/// @brief Wakes the writer thread and waits for it to exit, pending commands are kept
+	void Stop();
+	/// @brief Queues a command to be sent
+	/// @param type Setpoint the command changes, a pending command for the same setpoint is replaced by this one
+	/// @param sequence Sequence number included in the command, SERIAL_NO_SEQUENCE if the firmware won't acknowledge it
+	void Push(const std::string& command, const SetpointType type = SETPOINT_INVALID, const int sequence = SERIAL_NO_SEQUENCE);
+	/// @brief Marks a command as applied by the firmware, called from the receiver thread
+	void Acknowledge(const std::uint16_t sequence);
+	std::size_t GetPendingCount() const;
+	std::size_t GetInFlightCount() const;
 
-	inline std::string GetSetpointData() const { return m_setpoint; }
-	inline std::string GetSensorData() const { return m_sensor; }
-	inline std::string GetPWMData() const { return m_pwm; }
-	inline SetpointType GetType() const { return m_type; }
+	/// @brief Time from first sending a command until it was acknowledged, power commands are under SETPOINT_INVALID
+	const CLatencyHistogram& GetAckLatency(const SetpointType type) const { return m_acklatency[type]; }
+	std::uint64_t GetAcknowledgedCount() const { return m_acknowledged; }
+	std::uint64_t GetRetransmitCount() const { return m_retransmits; }
+	/// @brief Number of commands given up on after all retries
+	std::uint64_t GetFailedCount() const { return m_failed; }
 private:
-	const std::vector<std::string> Explode();
+	using clock = std::chrono::steady_clock;
+
+	struct QueuedCommand
+	{
+		std::string command;
+		SetpointType type;
+		int sequence;
+	};
 
-	std::string m_string;
-	std::string m_setpoint;
-	std::string m_sensor;
-	std::string m_pwm;
-	SetpointType m_type;
+	struct InFlightCommand
+	{
+		QueuedCommand queued;
+		clock::time_point firstsent;
+		clock::time_point lastsent;
+		unsigned int attempts;
+	};
+
+	void Run(serialib* serialib);
+	void RunAcknowledged(serialib* serialib, std::unique_lock<std::mutex>& lock);
+	void Write(serialib* serialib, const std::string& command, const char* action);
+
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+	bool m_running;
+	unsigned int m_interval;
+	unsigned int m_ackwindow;
+	unsigned int m_acktimeout;
+	unsigned int m_ackretries;
+	std::deque<QueuedCommand> m_queue;
+	std::deque<InFlightCommand> m_inflight; // sent and waiting for an acknowledgement, oldest first
+	CLatencyHistogram m_acklatency[SETPOINT_TYPE_COUNT];
+	std::atomic<std::uint64_t> m_acknowledged;
+	std::atomic<std::uint64_t> m_retransmits;
+	std::atomic<std::uint64_t> m_failed;
 };
 
-// Multi-threaded serial receiver worker
-class CSerialReceiver
+// A serial port connected to one microcontroller, with its own command queue and loggers.
+// The decoding functions are only called from the receiver thread.
+class CSerialPort
 {
 public:
-	CSerialReceiver();
+	CSerialPort(const std::size_t index, const CSerialConfiguration& config);
+	~CSerialPort();
+
+	/// @brief Tries to open the serial connection
+	/// @return true if the connection was open, false otherwise
+	bool Open();
+	void Close();
+	bool IsConnected();
+	/// @brief Checks if there is data available at the serial port
+	/// @return true if there is at least 1 byte available in the serial data
+	bool IsAvailable();
+	/// @brief Queues a command for this port
+	void SendCommand(const std::string& command, const SetpointType type = SETPOINT_INVALID, const int sequence = SERIAL_NO_SEQUENCE);
+	/// @brief Sequence number for the next command, or SERIAL_NO_SEQUENCE if acknowledgements are disabled
+	int NextSequence();
+	void InvokeLogger();
+	/// @brief Writes everything the loggers collected, blocks until it is on the disk
+	void FlushLogger();
 
-	void Update(CSerialManager* caller, serialib* serialib);
-	void FormatCommand();
-	void GetCommand(std::string* command);
-	bool Done() const;
+	std::size_t GetIndex() const { return m_index; }
+	const std::string& GetName() const { return m_config.name; }
+	/// @brief Name used for the logs of a channel, includes the port name when there are port sections
+	std::string GetChannelName(const char* channel) const;
+	LogFlushPolicy GetFlushPolicy() const;
+	LogRetentionPolicy GetRetentionPolicy() const;
+	const CSerialConfiguration& GetConfig() const { return m_config; }
+	serialib* GetSerialib() { return &m_serialib; }
+	int GetPollDescriptor() const { return m_pollfd; }
+	void ClosePollDescriptor();
+	bool IsBinary() const { return m_binary; }
+
+	/// @brief Runs the received data through the decoder of the protocol in use
+	/// @param arrival Time the data was read, given to every sample completed by it
+	/// @return Number of samples decoded
+	std::size_t ProcessData(const char* data, std::size_t size, const SampleTime& arrival, CSerialReceiver* receiver);
+
+	/// @brief Number of received bytes discarded because they were not part of a valid frame
+	std::uint64_t GetDroppedBytes() const { return m_droppedbytes; }
+	/// @brief Number of complete frames that could not be parsed
+	std::uint64_t GetParseErrors() const { return m_parseerrors; }
+	/// @brief Number of binary frames discarded because of a CRC mismatch
+	std::uint64_t GetChecksumErrors() const { return m_checksumerrors; }
+	const CSerialWriter& GetWriter() const { return m_writer; }
 private:
-	// Synchronizes access to member data.
-	mutable std::mutex m_Mutex;
+	void ProcessFrame(std::string_view frame, CSerialReceiver* receiver);
+	void ProcessBinaryFrame(const std::uint8_t* payload, std::size_t size, CSerialReceiver* receiver);
+	void PushSample(const SerialSample& sample, CSerialReceiver* receiver);
 
-	bool m_done;
-	std::string m_message;
+	std::size_t m_index;
+	CSerialConfiguration m_config;
+	serialib m_serialib;
+	CSerialWriter m_writer;
+	std::uint16_t m_sequence; // last sequence number used, only accessed from the main thread
+	int m_pollfd; // read-only descriptor of the serial device, used only to wait for data
+	CFrameDecoder m_decoder;
+	CBinaryFrameDecoder m_binarydecoder;
+	std::atomic<bool> m_binary;
+	std::atomic<std::uint64_t> m_droppedbytes;
+	std::atomic<std::uint64_t> m_parseerrors;
+	std::atomic<std::uint64_t> m_checksumerrors;
+	std::size_t m_decoded; // samples decoded from the current chunk
+	SampleTime m_arrival; // arrival time of the current chunk
+	CDataLogger m_logger_temp;
+	CDataLogger m_logger_led;
+	CDataLogger m_logger_humid;
 };
 
-class CSerialConfiguration
+// A sample and the index of the port it came from
+struct PortSample
+{
+	std::size_t port;
+	SerialSample sample;
+};
+
+// Long-lived serial reader, a single thread sleeps until any of the ports has data, then parses and logs it.
+// Parsed samples are handed to the UI through a lock-free queue.
+class CSerialReceiver
 {
 public:
-	CSerialConfiguration() :
-	devicename()
-	{
-		baudrate = 0;
-		databits = SERIAL_DATABITS_5;
-		stopbits = SERIAL_STOPBITS_1;
-		parity = SERIAL_PARITY_NONE;
-		configurated = false;
-	}
+	CSerialReceiver();
+	~CSerialReceiver();
 
-	std::string devicename;
-	unsigned int baudrate;
-	SerialDataBits databits;
-	SerialStopBits stopbits;
-	SerialParity parity;
-	bool configurated; // True if the serial is configurated and not just using default values
+	/// @brief Starts the reader thread for the open ports
+	/// @return true if the reader is running
+	bool Start(CSerialManager* caller, const std::vector<CSerialPort*>& ports);
+	/// @brief Wakes the reader thread and waits for it to exit
+	void Stop();
+	bool IsRunning() const;
+	/// @brief Pops the oldest received sample, only call from the main thread
+	/// @return false if there are no samples waiting
+	bool GetSample(PortSample* sample);
+	/// @brief Allows the reader to notify the main thread again, call before draining the samples
+	void ClearNotify() { m_notifypending = false; }
+	/// @brief Queues a decoded sample for the UI, only call from the reader thread
+	void QueueSample(const std::size_t port, const SerialSample& sample);
+	/// @brief Number of samples that were logged but not displayed because the UI fell behind
+	std::uint64_t GetDisplayOverflows() const { return m_overflows; }
+private:
+	void Run();
+	bool WaitForData(std::vector<CSerialPort*>& ready);
+	bool ReadPort(CSerialPort* port, char* buffer);
+
+	CSerialManager* m_caller;
+	std::vector<CSerialPort*> m_ports;
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+	int m_wakefd[2]; // pipe used to wake the reader thread when stopping
+	std::atomic<std::uint64_t> m_overflows;
+	std::atomic<bool> m_notifypending; // the main thread was notified and didn't start draining yet
+	CSpscQueue<PortSample, SERIAL_SAMPLE_QUEUE_SIZE> m_samplequeue;
 };
 
 class CSerialManager
@@ -126,48 +294,47 @@ public:
 	/// @brief Opens and read the serial configuration file
 	/// @return true if the file was read successfully
 	bool ReadConfigFile();
-	/// @brief Tries to open a serial connection
-	/// @return true if the connection was open, false otherwise
+	/// @brief Tries to open the serial connection of every port
+	/// @return true if at least one connection was open, false otherwise
 	bool OpenConnection();
+	/// @return true if at least one port is connected
 	bool IsConnected();
-	/// @brief Checks if there is data available at the serial port
+	/// @brief Checks if there is data available at any serial port
 	/// @return true if there is at least 1 byte available in the serial data
 	bool IsAvailable();
 	bool ReloadConfig();
+	/// @brief Changes the configuration file read by ReadConfigFile, serial.cfg by default
+	void SetConfigFile(const std::string& filename) { m_configfile = filename; }
+	/// @brief Sends a command to every port
 	void SendCommand(const SerialCommand cmd, const SetpointType spt = SETPOINT_INVALID, const float data = 0.0f);
-	void Update();
+	/// @brief Sends a command to a single port
+	void SendCommand(const std::size_t port, const SerialCommand cmd, const SetpointType spt = SETPOINT_INVALID, const float data = 0.0f);
 	void Notify_SerialReceiver();
 
+	std::size_t GetPortCount() const { return m_ports.size(); }
+	CSerialPort* GetPort(const std::size_t port) const { return m_ports[port].get(); }
+
 	void SetMainWindow(MainWindow* window) { m_mainwindow = window; }
 
 	void InvokeLogger();
 
+	/// @brief Builds the ASCII command that changes a setpoint, ie: cspt_24.00?
+	/// @return The command or an empty string if the setpoint type is invalid
+	static std::string FormatSetpointCommand(const SetpointType type, const float data);
+
 protected:
 	void OnSignal_ReceiveCommand();
 
 private:
-	void ReadConfigLine(const std::string line);
-	bool CheckWrite();
-	void CheckRead();
-	void WriteNextCommand();
-	void SendCommandInternal(const std::string cmd);
-	void ReceiveCommandInternal();
-	void ProcessReceivedCommand();
-	std::string FormatSetpointCommand(const SetpointType type, const float data);
-
-	CSerialConfiguration m_serialcfg;
-	std::shared_ptr<serialib> m_serialib;
-	int m_writetimer;
-	int m_readtimer;
-	std::queue<std::string> m_cmd_queue;
-	std::string m_last_cmd; // Last received command from the microcontroller
+	void ReadConfigLine(const std::string line, CSerialConfiguration& config);
+	void CloseAll();
+
+	bool m_configurated; // True if the serial is configurated and not just using default values
+	std::string m_configfile;
+	std::vector<std::unique_ptr<CSerialPort>> m_ports;
 	Glib::Dispatcher m_receiverdispatcher;
 	CSerialReceiver m_receiverworker;
-	std::thread* m_receiverthread;
 	MainWindow* m_mainwindow;
-	CDataLogger m_logger_temp;
-	CDataLogger m_logger_led;
-	CDataLogger m_logger_humid;
 };
 
 #endif
\ No newline at end of file
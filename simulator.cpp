@@ -0,0 +1,523 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "simulator.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/stat.h>
+
+#define SIMULATOR_READ_CHUNK_SIZE 256
+#define SIMULATOR_MAX_COMMAND_LENGTH 64
+#define SIMULATOR_MAX_CATCHUP_TICKS 1000 // ticks sent at once when the simulator falls behind
+#define SIMULATOR_SPLIT_DELAY_US 50 // pause between the pieces of a split frame
+#define SIMULATOR_WRITE_TIMEOUT_MS 10 // how long a write waits for the host to drain the terminal
+#define SIMULATOR_RESPONSE 0.05f // how fast the sensors follow the setpoint on each frame
+#define SIMULATOR_PWM_GAIN 40.0f
+#define SIMULATOR_PWM_MAX 255.0f
+
+// Sensor readings while the greenhouse is powered off
+static const float s_ambient[SETPOINT_TYPE_COUNT] = { 0.0f, 20.0f, 0.0f, 50.0f };
+static const float s_defaultsetpoints[SETPOINT_TYPE_COUNT] = { 0.0f, 24.0f, 50.0f, 60.0f };
+
+CDeviceSimulator::CDeviceSimulator(const SimulatorOptions& options) :
+m_options(options),
+m_master(-1),
+m_slave(-1),
+m_slavepath(),
+m_running(false),
+m_binary(options.binary),
+m_power(false),
+m_nextchannel(SETPOINT_TEMPERATURE),
+m_input(),
+m_binarydecoder(),
+m_random(std::random_device{}()),
+m_callback(),
+m_sequence(0),
+m_framessent(0),
+m_framesdropped(0),
+m_commands(0)
+{
+	for (int i = 0; i < SETPOINT_TYPE_COUNT; i++)
+	{
+		m_setpoints[i] = s_defaultsetpoints[i];
+		m_sensors[i] = s_ambient[i];
+	}
+
+	m_input.reserve(SIMULATOR_MAX_COMMAND_LENGTH);
+}
+
+CDeviceSimulator::~CDeviceSimulator()
+{
+	Close();
+}
+
+bool CDeviceSimulator::Open()
+{
+	m_master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if (m_master < 0 || grantpt(m_master) != 0 || unlockpt(m_master) != 0)
+	{
+		std::cout << "Failed to create pseudo-terminal!" << std::endl;
+		Close();
+		return false;
+	}
+
+	const char* name = ptsname(m_master);
+
+	if (name == nullptr)
+	{
+		std::cout << "Failed to get pseudo-terminal name!" << std::endl;
+		Close();
+		return false;
+	}
+
+	m_slavepath = name;
+	m_slave = open(m_slavepath.c_str(), O_RDWR | O_NOCTTY);
+
+	if (m_slave < 0)
+	{
+		std::cout << "Failed to open " << m_slavepath << "!" << std::endl;
+		Close();
+		return false;
+	}
+
+	// Raw mode so commands are not echoed back before the program configures the port
+	termios options;
+	tcgetattr(m_slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(m_slave, TCSANOW, &options);
+
+	fcntl(m_master, F_SETFL, fcntl(m_master, F_GETFL) | O_NONBLOCK);
+
+	if (!m_options.link.empty())
+	{
+		struct stat info;
+
+		if (lstat(m_options.link.c_str(), &info) == 0 && S_ISLNK(info.st_mode))
+		{
+			unlink(m_options.link.c_str());
+		}
+
+		if (symlink(m_slavepath.c_str(), m_options.link.c_str()) != 0)
+		{
+			std::cout << "Failed to create link " << m_options.link << "!" << std::endl;
+		}
+	}
+
+	return true;
+}
+
+void CDeviceSimulator::Close()
+{
+	if (!m_options.link.empty() && !m_slavepath.empty())
+	{
+		unlink(m_options.link.c_str());
+	}
+
+	if (m_slave >= 0)
+	{
+		close(m_slave);
+		m_slave = -1;
+	}
+
+	if (m_master >= 0)
+	{
+		close(m_master);
+		m_master = -1;
+	}
+
+	m_slavepath.clear();
+}
+
+void CDeviceSimulator::Run()
+{
+	if (m_master < 0)
+		return;
+
+	using clock = std::chrono::steady_clock;
+	const double rate = std::max(m_options.rate, 0.001);
+	const clock::time_point start = clock::now();
+	std::uint64_t ticks = 0;
+	m_running = true;
+
+	while (m_running)
+	{
+		const double elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+		if (m_options.duration > 0.0 && elapsed >= m_options.duration)
+			break;
+
+		// Catch up on every tick that is due, this keeps high rates accurate even though the sleep is coarse
+		const std::uint64_t due = static_cast<std::uint64_t>(elapsed * rate) + 1;
+
+		if (due > ticks)
+		{
+			const std::uint64_t count = std::min<std::uint64_t>(due - ticks, SIMULATOR_MAX_CATCHUP_TICKS);
+			SendFrames(static_cast<unsigned int>(count * std::max(m_options.burst, 1u)));
+			ticks = due; // ticks over the catch up limit are skipped
+		}
+
+		// Sleep until the next tick or until the program sends a command
+		const double wait = std::max(static_cast<double>(ticks) / rate - std::chrono::duration<double>(clock::now() - start).count(), 0.0);
+		timespec timeout;
+		timeout.tv_sec = static_cast<time_t>(wait);
+		timeout.tv_nsec = static_cast<long>((wait - static_cast<double>(timeout.tv_sec)) * 1e9);
+		pollfd fd;
+		fd.fd = m_master;
+		fd.events = POLLIN;
+		fd.revents = 0;
+
+		if (ppoll(&fd, 1, &timeout, nullptr) > 0 && (fd.revents & POLLIN) != 0)
+		{
+			ReadCommands();
+		}
+	}
+
+	m_running = false;
+}
+
+std::uint64_t CDeviceSimulator::GetSequence(const float setpoint)
+{
+	return static_cast<std::uint64_t>(std::llround(setpoint * BINARY_VALUE_SCALE));
+}
+
+void CDeviceSimulator::SendFrames(const unsigned int count)
+{
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	std::uniform_int_distribution<int> garbagesize(1, 8);
+	std::uniform_int_distribution<int> garbagebyte(0x01, 0xFF);
+	std::string batch;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (m_options.garbage > 0.0 && chance(m_random) < m_options.garbage)
+		{
+			const int size = garbagesize(m_random);
+
+			for (int j = 0; j < size; j++)
+			{
+				batch.push_back(static_cast<char>(garbagebyte(m_random)));
+			}
+		}
+
+		SerialSample sample;
+		const SetpointType type = static_cast<SetpointType>(m_nextchannel);
+		UpdateChannel(type, sample);
+		m_nextchannel = m_nextchannel + 1 < SETPOINT_TYPE_COUNT ? m_nextchannel + 1 : SETPOINT_TEMPERATURE;
+
+		if (m_callback)
+		{
+			m_callback(m_sequence, sample);
+		}
+
+		m_sequence++;
+
+		const std::string frame = EncodeSample(sample);
+
+		if (m_options.verbose)
+		{
+			std::cout << "Sending " << (m_binary ? "binary frame" : frame) << std::endl;
+		}
+
+		if (!m_options.split)
+		{
+			batch += frame;
+			continue;
+		}
+
+		// Send the frame in up to three pieces so the program has to put it back together
+		std::uniform_int_distribution<std::size_t> cut(1, frame.size() - 1);
+		std::size_t first = cut(m_random);
+		std::size_t second = cut(m_random);
+
+		if (first > second)
+			std::swap(first, second);
+
+		batch += frame.substr(0, first);
+		bool written = WriteAll(batch);
+		batch.clear();
+		usleep(SIMULATOR_SPLIT_DELAY_US);
+		written = WriteAll(frame.substr(first, second - first)) && written;
+		usleep(SIMULATOR_SPLIT_DELAY_US);
+		written = WriteAll(frame.substr(second)) && written;
+
+		if (written)
+			m_framessent++;
+		else
+			m_framesdropped++;
+	}
+
+	if (m_options.split)
+		return;
+
+	if (WriteAll(batch))
+		m_framessent += count;
+	else
+		m_framesdropped += count;
+}
+
+// Simple first order model, the sensor follows the setpoint and the PWM is proportional to the error
+void CDeviceSimulator::UpdateChannel(const SetpointType type, SerialSample& sample)
+{
+	float& sensor = m_sensors[type];
+	const float target = m_power ? m_setpoints[type] : s_ambient[type];
+	const float error = m_setpoints[type] - sensor;
+	sensor += (target - sensor) * SIMULATOR_RESPONSE;
+
+	sample.type = type;
+	sample.setpoint = m_setpoints[type];
+	sample.sensor = sensor;
+	sample.pwm = m_power ? std::clamp(error * SIMULATOR_PWM_GAIN, 0.0f, SIMULATOR_PWM_MAX) : 0.0f;
+
+	if (m_options.noise > 0.0)
+	{
+		std::uniform_real_distribution<float> noise(static_cast<float>(-m_options.noise), static_cast<float>(m_options.noise));
+		sample.sensor += noise(m_random);
+	}
+
+	if (m_options.sequence)
+	{
+		sample.setpoint = static_cast<float>(m_sequence % SIMULATOR_SEQUENCE_MODULO) / BINARY_VALUE_SCALE;
+	}
+}
+
+std::string CDeviceSimulator::EncodeSample(const SerialSample& sample) const
+{
+	if (m_binary)
+	{
+		return CBinaryProtocol::EncodeTelemetry(sample);
+	}
+
+	static const char* const prefixes[SETPOINT_TYPE_COUNT] = { "", "sdt", "sdl", "sdh" };
+	char buffer[SIMULATOR_MAX_COMMAND_LENGTH];
+	int size = snprintf(buffer, sizeof(buffer), "%s_%.2f_%.2f_%.2f?\r\n", prefixes[sample.type], sample.setpoint, sample.sensor, sample.pwm);
+	return std::string(buffer, static_cast<std::size_t>(std::clamp(size, 0, static_cast<int>(sizeof(buffer)) - 1)));
+}
+
+// Returns false if the program didn't read the data in time. Like a real UART nobody is listening to,
+// the data waiting in the terminal is thrown away so the program gets fresh frames when it connects.
+bool CDeviceSimulator::WriteAll(const std::string& data)
+{
+	std::size_t offset = 0;
+
+	while (offset < data.size())
+	{
+		ssize_t written = write(m_master, data.data() + offset, data.size() - offset);
+
+		if (written > 0)
+		{
+			offset += static_cast<std::size_t>(written);
+			continue;
+		}
+
+		pollfd fd;
+		fd.fd = m_master;
+		fd.events = POLLOUT;
+		fd.revents = 0;
+
+		if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			return false;
+
+		if (poll(&fd, 1, SIMULATOR_WRITE_TIMEOUT_MS) <= 0)
+		{
+			tcflush(m_slave, TCIFLUSH);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void CDeviceSimulator::ReadCommands()
+{
+	char buffer[SIMULATOR_READ_CHUNK_SIZE];
+	ssize_t size = read(m_master, buffer, sizeof(buffer));
+
+	if (size <= 0)
+		return;
+
+	for (ssize_t i = 0; i < size; i++)
+	{
+		// Switching to binary happens in the middle of a chunk when the handshake is followed by binary commands
+		if (m_binary)
+		{
+			m_binarydecoder.Feed(&buffer[i], static_cast<std::size_t>(size - i), [this](const std::uint8_t* payload, std::size_t length) {
+				HandleBinaryCommand(payload, length);
+			});
+			break;
+		}
+
+		const char c = buffer[i];
+
+		if (c == '?')
+		{
+			HandleCommand(m_input);
+			m_input.clear();
+		}
+		else if (c != '\r' && c != '\n' && m_input.size() < SIMULATOR_MAX_COMMAND_LENGTH)
+		{
+			m_input.push_back(c);
+		}
+	}
+}
+
+void CDeviceSimulator::HandleCommand(std::string_view command)
+{
+	m_commands++;
+	std::cout << "Received command: " << command << "?" << std::endl;
+
+	if (LoseCommand())
+		return;
+
+	if (command == std::string_view(BINARY_HANDSHAKE_COMMAND, sizeof(BINARY_HANDSHAKE_COMMAND) - 2))
+	{
+		// A lone delimiter first, so the program drops any text still in its decoder
+		std::string hello(1, static_cast<char>(BINARY_FRAME_DELIMITER));
+		hello += CBinaryProtocol::EncodeHello();
+		WriteAll(hello);
+		m_binary = true;
+		m_binarydecoder.Reset();
+		std::cout << "Switched to the binary protocol." << std::endl;
+		return;
+	}
+
+	// Split the command in fields, ie: cspt_24.00_17 is the name, the value and the sequence number
+	std::string_view fields[4];
+	std::size_t count = 0;
+
+	while (count < 4)
+	{
+		const std::size_t delimiter = command.find('_');
+		fields[count++] = command.substr(0, delimiter);
+
+		if (delimiter == std::string_view::npos)
+			break;
+
+		command.remove_prefix(delimiter + 1);
+	}
+
+	const std::string_view name = fields[0];
+	const bool power = name == "con" || name == "coff";
+	SetpointType type = SETPOINT_INVALID;
+
+	if (name == "cspt")
+		type = SETPOINT_TEMPERATURE;
+	else if (name == "cspl")
+		type = SETPOINT_LED;
+	else if (name == "csph")
+		type = SETPOINT_HUMIDITY;
+
+	const std::size_t fieldcount = power ? 1 : 2; // fields without the sequence number
+	float value = 0.0f;
+	std::uint16_t sequence = 0;
+
+	if ((!power && type == SETPOINT_INVALID) || count < fieldcount || count > fieldcount + 1
+		|| (!power && !ParseField(fields[1], value)) || (count > fieldcount && !ParseField(fields[fieldcount], sequence)))
+	{
+		std::cout << "Unknown command!" << std::endl;
+		return;
+	}
+
+	if (power)
+		m_power = name == "con";
+	else
+		m_setpoints[type] = value;
+
+	if (count > fieldcount)
+	{
+		WriteAck(sequence);
+	}
+}
+
+void CDeviceSimulator::HandleBinaryCommand(const std::uint8_t* payload, std::size_t size)
+{
+	m_commands++;
+
+	if (LoseCommand())
+		return;
+
+	bool on = false;
+	SetpointType type = SETPOINT_INVALID;
+	float value = 0.0f;
+	int sequence = SERIAL_NO_SEQUENCE;
+
+	if (CBinaryProtocol::ParsePower(payload, size, on, sequence) == SERIAL_PARSE_OK)
+	{
+		m_power = on;
+		std::cout << "Received binary command: power " << (m_power ? "on" : "off") << std::endl;
+	}
+	else if (CBinaryProtocol::ParseSetpoint(payload, size, type, value, sequence) == SERIAL_PARSE_OK)
+	{
+		m_setpoints[type] = value;
+		std::cout << "Received binary command: setpoint " << static_cast<int>(type) << " " << value << std::endl;
+	}
+	else
+	{
+		std::cout << "Unknown binary command!" << std::endl;
+		return;
+	}
+
+	if (sequence != SERIAL_NO_SEQUENCE)
+	{
+		WriteAck(static_cast<std::uint16_t>(sequence));
+	}
+}
+
+// Simulates a command corrupted on the way, the firmware neither applies nor acknowledges it
+bool CDeviceSimulator::LoseCommand()
+{
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+	if (m_options.commandloss <= 0.0 || chance(m_random) >= m_options.commandloss)
+		return false;
+
+	std::cout << "Losing the command." << std::endl;
+	return true;
+}
+
+void CDeviceSimulator::WriteAck(const std::uint16_t sequence)
+{
+	if (m_binary)
+	{
+		WriteAll(CBinaryProtocol::EncodeAck(sequence));
+		return;
+	}
+
+	char buffer[SIMULATOR_MAX_COMMAND_LENGTH];
+	int size = snprintf(buffer, sizeof(buffer), "%s_%u?\r\n", SERIAL_ACK_COMMAND, static_cast<unsigned int>(sequence));
+	WriteAll(std::string(buffer, static_cast<std::size_t>(size)));
+}
+
+template <typename T>
+bool CDeviceSimulator::ParseField(std::string_view field, T& value)
+{
+	const char* end = field.data() + field.size();
+	const std::from_chars_result result = std::from_chars(field.data(), end, value);
+	return !field.empty() && result.ec == std::errc() && result.ptr == end;
+}
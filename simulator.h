@@ -0,0 +1,108 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_SIMULATOR_
+#define _H_SIMULATOR_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "protocol.h"
+
+#define SIMULATOR_SEQUENCE_MODULO 30000 // sequence numbers wrap here so they fit the binary protocol
+
+struct SimulatorOptions
+{
+	double rate = 1.0; // frames per second, all channels combined
+	double duration = 0.0; // seconds to run, 0 runs until stopped
+	double noise = 0.0; // maximum random offset added to the sensor values
+	unsigned int burst = 1; // frames written back to back on each tick
+	bool split = false; // write each frame in several pieces
+	double garbage = 0.0; // chance of writing random bytes before a frame (0 to 1)
+	bool binary = false; // start in binary mode instead of waiting for the handshake
+	bool sequence = false; // replace the setpoint value with a frame counter, see CDeviceSimulator::GetSequence
+	double commandloss = 0.0; // chance of ignoring a command without acknowledging it (0 to 1)
+	bool verbose = false;
+	std::string link; // optional symlink pointing to the pseudo-terminal
+};
+
+// Behaves like the greenhouse microcontroller on a Linux pseudo-terminal.
+// Point DeviceName at the slave path to test the program without hardware.
+class CDeviceSimulator
+{
+public:
+	// Called right before a frame is written, with the frame sequence number
+	using FrameCallback = std::function<void(const std::uint64_t sequence, const SerialSample& sample)>;
+
+	CDeviceSimulator(const SimulatorOptions& options);
+	~CDeviceSimulator();
+
+	/// @brief Creates the pseudo-terminal
+	/// @return true on success
+	bool Open();
+	void Close();
+	/// @brief Sends frames and answers commands until the duration expires or Stop is called
+	void Run();
+	void Stop() { m_running = false; }
+
+	const std::string& GetSlavePath() const { return m_slavepath; }
+	void SetFrameCallback(FrameCallback callback) { m_callback = std::move(callback); }
+
+	std::uint64_t GetFramesSent() const { return m_framessent; }
+	std::uint64_t GetFramesDropped() const { return m_framesdropped; }
+	std::uint64_t GetCommandsReceived() const { return m_commands; }
+
+	/// @brief Recovers the sequence number from the setpoint of a frame sent in sequence mode
+	static std::uint64_t GetSequence(const float setpoint);
+private:
+	void SendFrames(const unsigned int count);
+	void ReadCommands();
+	void HandleCommand(std::string_view command);
+	void HandleBinaryCommand(const std::uint8_t* payload, std::size_t size);
+	bool LoseCommand();
+	void WriteAck(const std::uint16_t sequence);
+	template <typename T>
+	static bool ParseField(std::string_view field, T& value);
+	void UpdateChannel(const SetpointType type, SerialSample& sample);
+	std::string EncodeSample(const SerialSample& sample) const;
+	bool WriteAll(const std::string& data);
+
+	SimulatorOptions m_options;
+	int m_master;
+	int m_slave; // kept open so the master never sees a hang up while the program reconnects
+	std::string m_slavepath;
+	std::atomic<bool> m_running;
+	bool m_binary;
+	bool m_power;
+	float m_setpoints[SETPOINT_TYPE_COUNT];
+	float m_sensors[SETPOINT_TYPE_COUNT];
+	int m_nextchannel;
+	std::string m_input; // partial ASCII command
+	CBinaryFrameDecoder m_binarydecoder;
+	std::mt19937 m_random;
+	FrameCallback m_callback;
+	std::uint64_t m_sequence; // number of frames generated, including dropped ones
+	std::uint64_t m_framessent;
+	std::uint64_t m_framesdropped;
+	std::uint64_t m_commands;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_SPSC_QUEUE_
+#define _H_SPSC_QUEUE_
+
+#include <atomic>
+#include <cstddef>
+
+#define SPSC_CACHE_LINE_SIZE 64
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Each side caches the other side's index so it only touches the shared cache line when the queue looks full/empty.
+template <typename T, std::size_t Capacity>
+class CSpscQueue
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "SPSC queue capacity must be a power of two!");
+public:
+	CSpscQueue() :
+	m_head(0),
+	m_tailcache(0),
+	m_tail(0),
+	m_headcache(0),
+	m_items()
+	{
+	}
+
+	/// @brief Adds an item, only call from the producer thread
+	/// @return false if the queue is full
+	bool Push(const T& item)
+	{
+		const std::size_t tail = m_tail.load(std::memory_order_relaxed);
+
+		if (tail - m_headcache == Capacity)
+		{
+			m_headcache = m_head.load(std::memory_order_acquire);
+
+			if (tail - m_headcache == Capacity)
+			{
+				return false;
+			}
+		}
+
+		m_items[tail & (Capacity - 1)] = item;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/// @brief Removes the oldest item, only call from the consumer thread
+	/// @return false if the queue is empty
+	bool Pop(T& item)
+	{
+		const std::size_t head = m_head.load(std::memory_order_relaxed);
+
+		if (head == m_tailcache)
+		{
+			m_tailcache = m_tail.load(std::memory_order_acquire);
+
+			if (head == m_tailcache)
+			{
+				return false;
+			}
+		}
+
+		item = m_items[head & (Capacity - 1)];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Approximate when called while the other thread is active
+	std::size_t Size() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+	static constexpr std::size_t GetCapacity() { return Capacity; }
+private:
+	// consumer side
+	alignas(SPSC_CACHE_LINE_SIZE) std::atomic<std::size_t> m_head;
+	std::size_t m_tailcache;
+	// producer side
+	alignas(SPSC_CACHE_LINE_SIZE) std::atomic<std::size_t> m_tail;
+	std::size_t m_headcache;
+	alignas(SPSC_CACHE_LINE_SIZE) T m_items[Capacity];
+};
+
+#endif
@@ -1,7 +1,20 @@
-OBJS	= lib/serialib.o logger.o serialmanager.o serialcontrol.o controlframe.o dataframe.o app.o main.o
-SOURCE	= lib/serialib.cpp logger.cpp serialmanager.cpp serialcontrol.cpp controlframe.cpp dataframe.cpp app.cpp main.cpp
+OBJS	= lib/serialib.o framedecoder.o protocol.o latencyprobe.o logfile.o logindex.o logsegment.o logrollup.o logjournal.o logger.o serialmanager.o serialcontrol.o controlframe.o trendchart.o dataframe.o portframe.o app.o main.o
+SOURCE	= lib/serialib.cpp framedecoder.cpp protocol.cpp latencyprobe.cpp logfile.cpp logindex.cpp logsegment.cpp logrollup.cpp logjournal.cpp logger.cpp serialmanager.cpp serialcontrol.cpp controlframe.cpp trendchart.cpp dataframe.cpp portframe.cpp app.cpp main.cpp
 HEADER	= 
 OUT	= supervisorio
+SIM_OBJS	= protocol.o simulator.o devsim.o
+SIM_OUT	= devsim
+PROBE_OBJS	= serialmanager.o logger.o dataframe.o
+BENCH_OBJS	= $(filter-out main.o $(PROBE_OBJS), $(OBJS)) $(PROBE_OBJS:.o=.probe.o) simulator.o latencybench.o
+BENCH_OUT	= latencybench
+MICROBENCH_OBJS	= $(filter-out main.o, $(OBJS)) microbench.o
+MICROBENCH_OUT	= microbench
+LOGDUMP_OBJS	= logfile.o logdump.o
+LOGDUMP_OUT	= logdump
+LOGQUERY_OBJS	= logfile.o logindex.o logsegment.o logrollup.o logquery.o
+LOGQUERY_OUT	= logquery
+LOGEXPORT_OBJS	= logfile.o logindex.o logsegment.o logcsv.o logexport.o
+LOGEXPORT_OUT	= logexport
 CC	 = g++
 FLAGS	 = -g3 -c -O2 -Wall -Wextra -Werror $(shell pkg-config gtkmm-4.0 --cflags) -mavx2 -march=x86-64 -m64
 LFLAGS	 = -lm
@@ -13,6 +26,30 @@ LIBS  = $(shell pkg-config gtkmm-4.0 --libs)
 all: $(OBJS)
 	$(CC) -g $(OBJS) -o $(OUT) $(LFLAGS) $(LIBS)
 
+# serial device simulator, does not need gtkmm
+devsim: $(SIM_OBJS)
+	$(CC) -g $(SIM_OBJS) -o $(SIM_OUT) $(LFLAGS)
+
+# end to end latency benchmark, runs the program against the simulator
+latencybench: $(BENCH_OBJS)
+	$(CC) -g $(BENCH_OBJS) -o $(BENCH_OUT) $(LFLAGS) $(LIBS)
+
+# protocol codec and log formatting microbenchmarks
+microbench: $(MICROBENCH_OBJS)
+	$(CC) -g $(MICROBENCH_OBJS) -o $(MICROBENCH_OUT) $(LFLAGS) $(LIBS)
+
+# prints binary log files as text, does not need gtkmm
+logdump: $(LOGDUMP_OBJS)
+	$(CC) -g $(LOGDUMP_OBJS) -o $(LOGDUMP_OUT) $(LFLAGS)
+
+# time range queries over binary log files, does not need gtkmm
+logquery: $(LOGQUERY_OBJS)
+	$(CC) -g $(LOGQUERY_OBJS) -o $(LOGQUERY_OUT) $(LFLAGS) -pthread
+
+# parallel CSV export of binary log files, does not need gtkmm
+logexport: $(LOGEXPORT_OBJS)
+	$(CC) -g $(LOGEXPORT_OBJS) -o $(LOGEXPORT_OUT) $(LFLAGS) -pthread
+
 # create/compile the individual files >>separately<<
 main.o: main.cpp
 	$(CC) $(FLAGS) main.cpp -std=c++17
@@ -20,9 +57,15 @@ main.o: main.cpp
 app.o: app.cpp
 	$(CC) $(FLAGS) app.cpp -std=c++17
 
+trendchart.o: trendchart.cpp
+	$(CC) $(FLAGS) trendchart.cpp -std=c++17
+
 dataframe.o: dataframe.cpp
 	$(CC) $(FLAGS) dataframe.cpp -std=c++17
 
+portframe.o: portframe.cpp
+	$(CC) $(FLAGS) portframe.cpp -std=c++17
+
 controlframe.o: controlframe.cpp
 	$(CC) $(FLAGS) controlframe.cpp -std=c++17
 
@@ -32,6 +75,64 @@ serialmanager.o: serialmanager.cpp
 serialcontrol.o: serialcontrol.cpp
 	$(CC) $(FLAGS) serialcontrol.cpp -std=c++17
 
+framedecoder.o: framedecoder.cpp
+	$(CC) $(FLAGS) framedecoder.cpp -std=c++17
+
+protocol.o: protocol.cpp
+	$(CC) $(FLAGS) protocol.cpp -std=c++17
+
+simulator.o: simulator.cpp
+	$(CC) $(FLAGS) simulator.cpp -std=c++17
+
+devsim.o: devsim.cpp
+	$(CC) $(FLAGS) devsim.cpp -std=c++17
+
+latencyprobe.o: latencyprobe.cpp
+	$(CC) $(FLAGS) latencyprobe.cpp -std=c++17
+
+latencybench.o: latencybench.cpp
+	$(CC) $(FLAGS) -DLATENCY_PROBE latencybench.cpp -std=c++17
+
+# receive pipeline of the latency benchmark, built again with the latency probe marks
+serialmanager.probe.o: serialmanager.cpp
+	$(CC) $(FLAGS) -DLATENCY_PROBE serialmanager.cpp -o serialmanager.probe.o -std=c++17
+
+logger.probe.o: logger.cpp
+	$(CC) $(FLAGS) -DLATENCY_PROBE logger.cpp -o logger.probe.o -std=c++17
+
+dataframe.probe.o: dataframe.cpp
+	$(CC) $(FLAGS) -DLATENCY_PROBE dataframe.cpp -o dataframe.probe.o -std=c++17
+
+microbench.o: microbench.cpp
+	$(CC) $(FLAGS) microbench.cpp -std=c++17
+
+logfile.o: logfile.cpp
+	$(CC) $(FLAGS) logfile.cpp -std=c++17
+
+logindex.o: logindex.cpp
+	$(CC) $(FLAGS) logindex.cpp -std=c++17
+
+logsegment.o: logsegment.cpp
+	$(CC) $(FLAGS) logsegment.cpp -std=c++17
+
+logrollup.o: logrollup.cpp
+	$(CC) $(FLAGS) logrollup.cpp -std=c++17
+
+logjournal.o: logjournal.cpp
+	$(CC) $(FLAGS) logjournal.cpp -std=c++17
+
+logquery.o: logquery.cpp
+	$(CC) $(FLAGS) logquery.cpp -std=c++17
+
+logcsv.o: logcsv.cpp
+	$(CC) $(FLAGS) logcsv.cpp -std=c++17
+
+logexport.o: logexport.cpp
+	$(CC) $(FLAGS) logexport.cpp -std=c++17
+
+logdump.o: logdump.cpp
+	$(CC) $(FLAGS) logdump.cpp -std=c++17
+
 logger.o: logger.cpp
 	$(CC) $(FLAGS) logger.cpp -std=c++17
 
@@ -40,4 +141,4 @@ lib/serialib.o: lib/serialib.cpp
 
 # clean house
 clean:
-	rm -f $(OBJS) $(OUT)
\ No newline at end of file
+	rm -f $(OBJS) $(OUT) $(SIM_OBJS) $(SIM_OUT) latencybench.o $(PROBE_OBJS:.o=.probe.o) $(BENCH_OUT) microbench.o $(MICROBENCH_OUT) logdump.o $(LOGDUMP_OUT) logquery.o $(LOGQUERY_OUT) logcsv.o logexport.o $(LOGEXPORT_OUT)
\ No newline at end of file
@@ -0,0 +1,234 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "trendchart.h"
+#include <cstdio>
+#include <limits>
+
+#define TRENDCHART_NANOSECONDS_PER_SECOND 1000000000LL
+#define TRENDCHART_MARGIN 4.0
+
+// Colors of the series, setpoint then sensor
+static const double s_seriescolors[TRENDCHART_SERIES][3] = { { 0.85, 0.33, 0.10 }, { 0.00, 0.45, 0.74 } };
+static const char* const s_seriesnames[TRENDCHART_SERIES] = { "Setpoint", "Sensor" };
+
+CTrendChart::CTrendChart(const unsigned int span) :
+m_history(),
+m_historytime(1),
+m_historylatest(0),
+m_columns(),
+m_span(static_cast<std::int64_t>(span) * TRENDCHART_NANOSECONDS_PER_SECOND),
+m_columntime(1),
+m_latest(0)
+{
+	set_content_height(TRENDCHART_HEIGHT);
+	set_draw_func(sigc::mem_fun(*this, &CTrendChart::OnDraw));
+
+	m_historytime = m_span / TRENDCHART_HISTORY_BUCKETS;
+	m_historytime = m_historytime > 0 ? m_historytime : 1;
+}
+
+CTrendChart::~CTrendChart()
+{
+}
+
+void CTrendChart::AddSample(const SampleTime& time, const float setpoint, const float sensor)
+{
+	const float values[TRENDCHART_SERIES] = { setpoint, sensor };
+
+	// A chart of a port that never receives anything doesn't take memory
+	if (m_history.empty())
+		m_history.resize(TRENDCHART_HISTORY_BUCKETS);
+
+	AddToColumn(m_history, m_historylatest, time.monotonic / m_historytime, values, values);
+
+	// Before the first draw the width isn't known yet
+	if (!m_columns.empty())
+		AddToColumn(m_columns, m_latest, time.monotonic / m_columntime, values, values);
+}
+
+void CTrendChart::AddToColumn(std::vector<TrendColumn>& ring, std::int64_t& latest, const std::int64_t bucket, const float* min, const float* max)
+{
+	const std::int64_t columns = static_cast<std::int64_t>(ring.size());
+
+	// Scrolled out of the chart
+	if (bucket <= latest - columns)
+		return;
+
+	TrendColumn& column = ring[static_cast<std::size_t>(bucket % columns)];
+
+	if (column.bucket != bucket)
+	{
+		column.bucket = bucket;
+
+		for (int s = 0; s < TRENDCHART_SERIES; s++)
+		{
+			column.min[s] = min[s];
+			column.max[s] = max[s];
+		}
+	}
+	else
+	{
+		for (int s = 0; s < TRENDCHART_SERIES; s++)
+		{
+			column.min[s] = min[s] < column.min[s] ? min[s] : column.min[s];
+			column.max[s] = max[s] > column.max[s] ? max[s] : column.max[s];
+		}
+	}
+
+	latest = bucket > latest ? bucket : latest;
+}
+
+const TrendColumn* CTrendChart::GetColumn(const std::vector<TrendColumn>& ring, const std::int64_t bucket)
+{
+	if (bucket < 0)
+		return nullptr;
+
+	const TrendColumn& column = ring[static_cast<std::size_t>(bucket % static_cast<std::int64_t>(ring.size()))];
+	return column.bucket == bucket ? &column : nullptr;
+}
+
+void CTrendChart::Rebuild(const std::size_t columns)
+{
+	m_columns.assign(columns, TrendColumn());
+	m_columntime = m_span / static_cast<std::int64_t>(columns);
+	m_columntime = m_columntime > 0 ? m_columntime : 1;
+	m_latest = 0;
+
+	if (m_history.empty())
+		return;
+
+	// The newest column first, the history buckets that are older than the chart are left out
+	const std::int64_t buckets = static_cast<std::int64_t>(m_history.size());
+	m_latest = m_historylatest * m_historytime / m_columntime;
+
+	for (std::int64_t bucket = m_historylatest - buckets + 1; bucket <= m_historylatest; bucket++)
+	{
+		const TrendColumn* history = GetColumn(m_history, bucket);
+
+		if (history != nullptr)
+			AddToColumn(m_columns, m_latest, bucket * m_historytime / m_columntime, history->min, history->max);
+	}
+}
+
+void CTrendChart::OnDraw(const Cairo::RefPtr<Cairo::Context>& context, int width, int height)
+{
+	context->set_source_rgb(1.0, 1.0, 1.0);
+	context->paint();
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (m_columns.size() != static_cast<std::size_t>(width))
+		Rebuild(static_cast<std::size_t>(width));
+
+	const std::int64_t columns = static_cast<std::int64_t>(m_columns.size());
+	const std::int64_t firstbucket = m_latest - columns + 1;
+	float low = std::numeric_limits<float>::infinity();
+	float high = -std::numeric_limits<float>::infinity();
+
+	// The vertical scale fits the visible columns
+	for (std::int64_t x = 0; x < columns; x++)
+	{
+		const TrendColumn* column = GetColumn(m_columns, firstbucket + x);
+
+		if (column == nullptr)
+			continue;
+
+		for (int s = 0; s < TRENDCHART_SERIES; s++)
+		{
+			low = column->min[s] < low ? column->min[s] : low;
+			high = column->max[s] > high ? column->max[s] : high;
+		}
+	}
+
+	// Quarter lines
+	context->set_source_rgb(0.85, 0.85, 0.85);
+	context->set_line_width(1.0);
+
+	for (int i = 1; i < 4; i++)
+	{
+		const double y = static_cast<int>(height * i / 4) + 0.5;
+		context->move_to(0.0, y);
+		context->line_to(width, y);
+	}
+
+	context->stroke();
+
+	if (low > high)
+		return;
+
+	// A flat trend is drawn in the middle
+	if (high - low < 1e-3f)
+	{
+		low -= 1.0f;
+		high += 1.0f;
+	}
+
+	const double scale = (height - 2.0 * TRENDCHART_MARGIN) / static_cast<double>(high - low);
+
+	for (int s = 0; s < TRENDCHART_SERIES; s++)
+	{
+		bool drawing = false;
+
+		context->set_source_rgb(s_seriescolors[s][0], s_seriescolors[s][1], s_seriescolors[s][2]);
+
+		// Two points per column, the line is broken where there are no samples
+		for (std::int64_t x = 0; x < columns; x++)
+		{
+			const TrendColumn* column = GetColumn(m_columns, firstbucket + x);
+
+			if (column == nullptr)
+			{
+				drawing = false;
+				continue;
+			}
+
+			const double top = height - TRENDCHART_MARGIN - (column->max[s] - low) * scale;
+			const double bottom = height - TRENDCHART_MARGIN - (column->min[s] - low) * scale;
+
+			if (drawing)
+				context->line_to(x + 0.5, bottom);
+			else
+				context->move_to(x + 0.5, bottom);
+
+			context->line_to(x + 0.5, top);
+			drawing = true;
+		}
+
+		context->stroke();
+	}
+
+	// Range of the scale and legend
+	char buffer[32];
+	context->set_font_size(10.0);
+	context->set_source_rgb(0.3, 0.3, 0.3);
+	std::snprintf(buffer, sizeof(buffer), "%.2f", high);
+	context->move_to(TRENDCHART_MARGIN, TRENDCHART_MARGIN + 10.0);
+	context->show_text(buffer);
+	std::snprintf(buffer, sizeof(buffer), "%.2f", low);
+	context->move_to(TRENDCHART_MARGIN, height - TRENDCHART_MARGIN);
+	context->show_text(buffer);
+
+	for (int s = 0; s < TRENDCHART_SERIES; s++)
+	{
+		context->set_source_rgb(s_seriescolors[s][0], s_seriescolors[s][1], s_seriescolors[s][2]);
+		context->move_to(width - 120.0 + s * 60.0, TRENDCHART_MARGIN + 10.0);
+		context->show_text(s_seriesnames[s]);
+	}
+}
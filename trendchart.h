@@ -0,0 +1,75 @@
+/*
+	Greenhouse SCADA - A simple GUI SCADA software for a small greenhouse project
+	Copyright (C) 2023  caxanga334
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _H_TRENDCHART_
+#define _H_TRENDCHART_
+
+#include <gtkmm.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "protocol.h"
+
+#define TRENDCHART_HISTORY_BUCKETS 4096 // min and max kept across the span to rebuild the chart at a new width, finer than the widest chart
+#define TRENDCHART_DEFAULT_SPAN_S 10800 // time shown across the chart
+#define TRENDCHART_HEIGHT 120
+#define TRENDCHART_SERIES 2 // setpoint and sensor
+
+// Extremes of every series over the time of one pixel column or history bucket
+struct TrendColumn
+{
+	std::int64_t bucket = -1; // arrival time divided by the column duration, -1 if the column is empty
+	float min[TRENDCHART_SERIES];
+	float max[TRENDCHART_SERIES];
+};
+
+// Setpoint and sensor of a channel over the last hours, the newest sample is at the right edge.
+// Samples go into the min and max of their pixel column as they arrive,
+// a redraw draws two points per column no matter how many samples there are.
+// They also go into a fixed number of finer history buckets over the span, the columns are rebuilt
+// from the history when the width changes. The memory used doesn't depend on the sample rate.
+class CTrendChart : public Gtk::DrawingArea
+{
+public:
+	CTrendChart(const unsigned int span = TRENDCHART_DEFAULT_SPAN_S);
+	virtual ~CTrendChart();
+
+	/// @brief Stores a sample, the owner queues the redraw
+	void AddSample(const SampleTime& time, const float setpoint, const float sensor);
+
+private:
+	void OnDraw(const Cairo::RefPtr<Cairo::Context>& context, int width, int height);
+	// Reduces the history buckets to a number of columns
+	void Rebuild(const std::size_t columns);
+	// Widens the extremes of the column of a bucket, the ones that scrolled out of the ring are ignored
+	// @param latest Newest bucket of the ring, updated
+	static void AddToColumn(std::vector<TrendColumn>& ring, std::int64_t& latest, const std::int64_t bucket, const float* min, const float* max);
+	// Column of a ring that holds a bucket, nullptr if it has no samples of that bucket
+	static const TrendColumn* GetColumn(const std::vector<TrendColumn>& ring, const std::int64_t bucket);
+
+	std::vector<TrendColumn> m_history; // allocated by the first sample, bucket of a column is bucket % size
+	std::int64_t m_historytime; // nanoseconds of a history bucket
+	std::int64_t m_historylatest; // history bucket of the newest sample
+	std::vector<TrendColumn> m_columns; // column of a bucket is bucket % size
+	std::int64_t m_span; // nanoseconds across the chart
+	std::int64_t m_columntime; // nanoseconds of a column
+	std::int64_t m_latest; // bucket of the newest sample
+};
+
+#endif